@@ -0,0 +1,150 @@
+// Measure how fast build versions are read out of local binary
+// packages, in-process versus by spawning pkg_info(1) for each
+// package. The latter is emulated with tar(1) so that this runs without
+// pkg_install, which only makes it look better than it really is.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <pkgxx/build_version.hxx>
+#include <pkgxx/gzipstream.hxx>
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::size_t const n_packages   = 200;
+    constexpr std::size_t const payload_size = 4 * 1024 * 1024;
+
+    char const* const fake_pkg_info = R"SH(#!/bin/sh
+# pkg_info -q -b FILE
+exec tar -xzOf "$3" --occurrence=1 +BUILD_VERSION
+)SH";
+
+    // Write a ustar member.
+    void
+    put_member(std::ostream& out, std::string const& name, std::string const& contents) {
+        char header[512] = {};
+        name.copy(header, 99);
+        std::snprintf(header + 100, 8, "%07o", 0644);
+        std::snprintf(header + 108, 8, "%07o", 0);
+        std::snprintf(header + 116, 8, "%07o", 0);
+        std::snprintf(header + 124, 12, "%011zo", contents.size());
+        std::snprintf(header + 136, 12, "%011o", 1700000000);
+        header[156] = '0';
+        std::string("ustar").copy(header + 257, 5);
+        header[263] = '0';
+        header[264] = '0';
+
+        unsigned sum = ' ' * 8;
+        for (std::size_t i = 0; i < sizeof(header); i++) {
+            if (i < 148 || i >= 156) {
+                sum += static_cast<unsigned char>(header[i]);
+            }
+        }
+        std::snprintf(header + 148, 8, "%06o", sum);
+        header[155] = ' ';
+
+        out.write(header, sizeof(header));
+        out << contents;
+        out << std::string((512 - contents.size() % 512) % 512, '\0');
+    }
+
+    // A package with metadata first, like pkg_create(1) makes, followed
+    // by a payload that doesn't compress well.
+    void
+    create_package(fs::path const& file, std::size_t i) {
+        std::string bv;
+        for (std::size_t j = 0; j < 20; j++) {
+            bv += "devel/foo" + std::to_string(i) + "/patches/patch-" + std::to_string(j) +
+                ": $NetBSD: patch-" + std::to_string(j) + ",v 1.1 2024/01/01 00:00:00 foo Exp $\n";
+        }
+
+        std::string payload(payload_size, '\0');
+        std::uint32_t x = static_cast<std::uint32_t>(i) + 1;
+        for (auto& c: payload) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            c = static_cast<char>(x);
+        }
+
+        std::ofstream raw(file, std::ios_base::out | std::ios_base::binary);
+        pkgxx::gzipostream out(raw);
+        put_member(out, "+CONTENTS", "@name foo" + std::to_string(i) + "-1.0\nbin/foo\n");
+        put_member(out, "+COMMENT", "A package for benchmarking\n");
+        put_member(out, "+BUILD_VERSION", bv);
+        put_member(out, "bin/foo", payload);
+        out << std::string(1024, '\0');
+        out.close();
+    }
+
+    void
+    run(std::string const& label,
+        std::vector<fs::path> const& files,
+        std::function<std::optional<pkgxx::build_version> (fs::path const&)> const& f) {
+
+        auto const start = std::chrono::steady_clock::now();
+        for (auto const& file: files) {
+            auto const bv = f(file);
+            if (!bv || bv->size() != 20) {
+                std::cerr << label << ": failed to read " << file << std::endl;
+                std::exit(1);
+            }
+        }
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+
+        double const secs = std::chrono::duration<double>(elapsed).count();
+        std::cout << std::left << std::setw(24) << label << std::right
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << static_cast<double>(files.size()) / secs << " packages/s"
+                  << std::setw(10) << secs * 1000 / static_cast<double>(files.size()) << " ms/package"
+                  << std::endl;
+    }
+}
+
+int main() {
+    std::string tmpl = (fs::temp_directory_path() / "build_version_bench.XXXXXX").string();
+    if (!mkdtemp(tmpl.data())) {
+        throw std::system_error(errno, std::generic_category(), "mkdtemp");
+    }
+    fs::path const dir = tmpl;
+
+    auto const pkg_info = dir / "pkg_info";
+    {
+        std::ofstream out(pkg_info);
+        out << fake_pkg_info;
+    }
+    fs::permissions(pkg_info, fs::perms::owner_all);
+
+    std::vector<fs::path> files;
+    for (std::size_t i = 0; i < n_packages; i++) {
+        files.push_back(dir / ("foo" + std::to_string(i) + "-1.0.tgz"));
+        create_package(files.back(), i);
+    }
+
+    std::cout << "Reading +BUILD_VERSION of " << n_packages << " packages with "
+              << payload_size / (1024 * 1024) << " MiB payloads, one at a time" << std::endl;
+    run("in-process",
+        files,
+        [](auto const& file) {
+            return pkgxx::build_version::from_binary_native(file);
+        });
+    run("spawning pkg_info(1)",
+        files,
+        [&](auto const& file) {
+            return pkgxx::build_version::from_binary_pkg_info(pkg_info.string(), file);
+        });
+
+    fs::remove_all(dir);
+    return 0;
+}
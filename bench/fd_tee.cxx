@@ -0,0 +1,176 @@
+// Measure the throughput and the number of syscalls per megabyte of
+// copying the output of make(1) to both stdout and a log file.
+
+// Fortified inline wrappers would hide our definitions of read(2) and
+// friends below.
+#undef _FORTIFY_SOURCE
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <pkgxx/fd_tee.hxx>
+#include <pkgxx/fdstream.hxx>
+
+namespace {
+    constexpr std::size_t const total_size = 64 * 1024 * 1024;
+
+    // Only syscalls made by the thread being measured are counted.
+    thread_local bool counting = false;
+    std::size_t n_syscalls = 0;
+
+    void
+    count_syscall() {
+        if (counting) {
+            n_syscalls++;
+        }
+    }
+}
+
+#if defined(__linux__)
+// Count the calls by interposing the libc functions. Our libraries call
+// them directly, so every call goes through these.
+extern "C" {
+    ssize_t
+    read(int fd, void* buf, size_t len) {
+        count_syscall();
+        return static_cast<ssize_t>(syscall(SYS_read, fd, buf, len));
+    }
+
+    ssize_t
+    write(int fd, void const* buf, size_t len) {
+        count_syscall();
+        return static_cast<ssize_t>(syscall(SYS_write, fd, buf, len));
+    }
+
+    ssize_t
+    writev(int fd, struct iovec const* iov, int iovcnt) {
+        count_syscall();
+        return static_cast<ssize_t>(syscall(SYS_writev, fd, iov, iovcnt));
+    }
+
+    ssize_t
+    splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags) {
+        count_syscall();
+        return static_cast<ssize_t>(syscall(SYS_splice, fd_in, off_in, fd_out, off_out, len, flags));
+    }
+
+    ssize_t
+    tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+        count_syscall();
+        return static_cast<ssize_t>(syscall(SYS_tee, fd_in, fd_out, len, flags));
+    }
+}
+#endif
+
+namespace {
+    void
+    check(bool ok, char const* what) {
+        if (!ok) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    // The loop pkg_rr used before tee_fd(): 1 KiB reads through a stream
+    // buffer, and buffered writes to stdout and the log.
+    void
+    copy_with_streams(int in, int out1, int out2) {
+        pkgxx::fdistream src(in, false, 1024);
+        pkgxx::fdostream dst1(out1, false, BUFSIZ);
+        pkgxx::fdostream dst2(out2, false, BUFSIZ);
+
+        std::vector<char> buf(1024);
+        using traits = std::istream::traits_type;
+        while (true) {
+            if (auto const n_read = src.readsome(buf.data(), static_cast<std::streamsize>(buf.size())); n_read > 0) {
+                dst1.write(buf.data(), n_read);
+                dst2.write(buf.data(), n_read);
+            }
+            else if (traits::eq_int_type(src.peek(), traits::eof())) {
+                break;
+            }
+        }
+    }
+
+    void
+    run(std::string const& label,
+        std::function<void (int, int, int)> const& copy,
+        bool append_log) {
+
+        int in[2];
+        int out1[2];
+        check(pipe(in) == 0, "pipe");
+        check(pipe(out1) == 0, "pipe");
+
+        char log_path[] = "/tmp/fd_tee_bench.XXXXXX";
+        int const log = mkstemp(log_path);
+        check(log != -1, "mkstemp");
+        unlink(log_path);
+        if (append_log) {
+            check(fcntl(log, F_SETFL, O_APPEND) == 0, "fcntl");
+        }
+
+        // Feed the input like make(1) would, and drain stdout like a
+        // pager would. Neither is counted.
+        std::thread producer(
+            [fd = in[1]]() {
+                std::vector<char> chunk(16 * 1024, 'x');
+                for (std::size_t n = 0; n < total_size; n += chunk.size()) {
+                    for (std::size_t off = 0; off < chunk.size(); ) {
+                        auto const n_written = write(fd, chunk.data() + off, chunk.size() - off);
+                        check(n_written > 0, "write");
+                        off += static_cast<std::size_t>(n_written);
+                    }
+                }
+                close(fd);
+            });
+        std::thread consumer(
+            [fd = out1[0]]() {
+                std::vector<char> buf(64 * 1024);
+                while (read(fd, buf.data(), buf.size()) > 0);
+                close(fd);
+            });
+
+        n_syscalls = 0;
+        counting   = true;
+        auto const start = std::chrono::steady_clock::now();
+        copy(in[0], out1[1], log);
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        counting   = false;
+
+        close(in[0]);
+        close(out1[1]);
+        producer.join();
+        consumer.join();
+        check(lseek(log, 0, SEEK_END) == static_cast<off_t>(total_size), "short log");
+        close(log);
+
+        double const mb   = static_cast<double>(total_size) / (1024 * 1024);
+        double const secs = std::chrono::duration<double>(elapsed).count();
+        std::cout << std::left << std::setw(36) << label << std::right
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << mb / secs << " MB/s"
+                  << std::setw(10) << static_cast<double>(n_syscalls) / mb << " syscalls/MB"
+                  << std::endl;
+    }
+}
+
+int main() {
+    std::cout << "Copying " << total_size / (1024 * 1024)
+              << " MiB from a pipe to a pipe and a log file" << std::endl;
+    run("1 KiB stream reads", copy_with_streams, false);
+    run("tee_fd(), log opened with O_APPEND", pkgxx::tee_fd, true);
+    run("tee_fd(), log without O_APPEND", pkgxx::tee_fd, false);
+    return 0;
+}
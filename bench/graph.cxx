@@ -0,0 +1,146 @@
+// Measure graph operations pkg_chk and pkg_rr rely on, using synthetic
+// dependency graphs about the size of pkgsrc: some 25,000 packages, most
+// of which depend on a handful of others, and a few of which nearly
+// everything depends on.
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <pkgxx/graph.hxx>
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr std::size_t const n_packages = 25000;
+
+    std::string
+    name_of(std::size_t i) {
+        return "category/package" + std::to_string(i);
+    }
+
+    // Edges from dependants to their dependencies. A package only
+    // depends on packages with smaller numbers, and those with small
+    // numbers are far more popular, like pkgtools/cwrappers or
+    // devel/gettext-lib are.
+    std::vector<std::pair<std::size_t, std::size_t>>
+    synthetic_edges(std::size_t n) {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::geometric_distribution<std::size_t> n_deps(0.2);
+
+        std::vector<std::pair<std::size_t, std::size_t>> edges;
+        for (std::size_t i = 1; i < n; i++) {
+            auto const k = std::min<std::size_t>(1 + n_deps(rng), 40);
+            for (std::size_t j = 0; j < k; j++) {
+                auto const u = uniform(rng);
+                edges.emplace_back(i, static_cast<std::size_t>(static_cast<double>(i) * u * u * u));
+            }
+        }
+        return edges;
+    }
+
+    void
+    measure(std::string const& label, std::size_t n_ops, std::function<void ()> const& f) {
+        auto const start = clock_type::now();
+        f();
+        auto const elapsed = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+        std::cout << std::left << std::setw(36) << label << std::right
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << elapsed << " ms";
+        if (n_ops > 1) {
+            std::cout << std::setw(10) << elapsed * 1000 / static_cast<double>(n_ops) << " us/op";
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main() {
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < n_packages; i++) {
+        names.push_back(name_of(i));
+    }
+    auto const edges = synthetic_edges(n_packages);
+    std::cout << n_packages << " vertices, " << edges.size() << " edges" << std::endl;
+
+    pkgxx::graph<std::string> g;
+    measure("build", edges.size(),
+            [&]() {
+                for (auto const& name: names) {
+                    g.add_vertex(name);
+                }
+                for (auto const& [src, dest]: edges) {
+                    g.add_edge(names[src], names[dest]);
+                }
+            });
+
+    measure("tsort", 1,
+            [&]() {
+                if (g.tsort(false).size() != n_packages) {
+                    std::abort();
+                }
+            });
+
+    measure("tsort_levels", 1,
+            [&]() {
+                if (g.tsort_levels().empty()) {
+                    std::abort();
+                }
+            });
+
+    // From dependants to packages they may depend on, like pkg_chk does
+    // when explaining why a package is needed.
+    constexpr std::size_t const n_paths = 1000;
+    std::size_t n_found = 0;
+    measure("shortest_path", n_paths,
+            [&]() {
+                std::mt19937 rng(1);
+                std::uniform_int_distribution<std::size_t> pick(1, n_packages - 1);
+                for (std::size_t i = 0; i < n_paths; i++) {
+                    auto const src = pick(rng);
+                    auto const dest = std::uniform_int_distribution<std::size_t>(0, src - 1)(rng);
+                    if (g.shortest_path(names[src], names[dest])) {
+                        n_found++;
+                    }
+                }
+            });
+    std::cout << "  (" << n_found << " of " << n_paths << " pairs were connected)" << std::endl;
+
+    // pkg_rr keeps the order up to date while it adds dependencies of
+    // packages it is about to replace.
+    pkgxx::graph<std::string, void, true> bg;
+    for (auto const& name: names) {
+        bg.add_vertex(name);
+    }
+    auto const half = edges.size() / 2;
+    for (std::size_t i = 0; i < half; i++) {
+        bg.add_edge(names[edges[i].first], names[edges[i].second]);
+    }
+    bg.tsort();
+    measure("incremental add_edge, bidirectional", edges.size() - half,
+            [&]() {
+                for (std::size_t i = half; i < edges.size(); i++) {
+                    bg.add_edge(names[edges[i].first], names[edges[i].second]);
+                }
+            });
+
+    measure("tsort_position", n_packages,
+            [&]() {
+                std::size_t sum = 0;
+                for (auto const& name: names) {
+                    sum += bg.tsort_position(name).value();
+                }
+                if (sum == 0) {
+                    std::abort();
+                }
+            });
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Stress graph algorithms with graphs far larger than pkgsrc, up to a
+// million vertices. A chain is the worst case for anything recursive,
+// since its depth equals its size.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <pkgxx/graph.hxx>
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+    using graph_type = pkgxx::graph<std::size_t>;
+
+    void
+    measure(std::string const& label, std::size_t n, std::function<void ()> const& f) {
+        auto const start = clock_type::now();
+        f();
+        auto const elapsed = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+        std::cout << std::left << std::setw(24) << label << std::right
+                  << std::setw(9) << n << " vertices"
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << elapsed << " ms"
+                  << std::setw(10) << elapsed * 1e6 / static_cast<double>(n) << " ns/vertex"
+                  << std::endl;
+    }
+
+    // Each vertex depends on the previous one.
+    graph_type
+    chain(std::size_t n) {
+        graph_type g;
+        g.add_vertex(0);
+        for (std::size_t i = 1; i < n; i++) {
+            g.add_edge(i, i - 1);
+        }
+        return g;
+    }
+
+    // Each vertex depends on a few random earlier ones.
+    graph_type
+    random_dag(std::size_t n) {
+        std::mt19937 rng(42);
+        graph_type g;
+        g.add_vertex(0);
+        for (std::size_t i = 1; i < n; i++) {
+            std::uniform_int_distribution<std::size_t> pick(0, i - 1);
+            for (int j = 0; j < 3; j++) {
+                g.add_edge(i, pick(rng));
+            }
+        }
+        return g;
+    }
+
+    void
+    check(bool ok) {
+        if (!ok) {
+            std::cerr << "unexpected result" << std::endl;
+            std::exit(1);
+        }
+    }
+}
+
+int main() {
+    for (std::size_t const n: {10000ul, 100000ul, 1000000ul}) {
+        {
+            auto g = chain(n);
+            measure("chain: tsort", n,
+                    [&]() {
+                        auto const order = g.tsort(false);
+                        check(order.size() == n && order.front().get() == 0);
+                    });
+            measure("chain: tsort_levels", n,
+                    [&]() {
+                        check(g.tsort_levels().size() == n);
+                    });
+            measure("chain: shortest_path", n,
+                    [&]() {
+                        check(g.shortest_path(n - 1, 0)->size() == n);
+                    });
+
+            // Closing the chain into a cycle makes the DFS walk all of it
+            // before it can report the cycle.
+            g.add_edge(0, n - 1);
+            measure("chain: cycle detection", n,
+                    [&]() {
+                        try {
+                            g.tsort(false);
+                            check(false);
+                        }
+                        catch (pkgxx::not_a_dag<std::size_t> const&) {
+                            // Expected.
+                        }
+                    });
+        }
+        {
+            auto const g = random_dag(n);
+            measure("random DAG: tsort", n,
+                    [&]() {
+                        check(g.tsort(false).size() == n);
+                    });
+            measure("random DAG: tsort_levels", n,
+                    [&]() {
+                        check(!g.tsort_levels().empty());
+                    });
+        }
+    }
+    return 0;
+}
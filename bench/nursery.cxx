@@ -0,0 +1,77 @@
+// Measure the throughput of nursery tasks that do next to nothing, so
+// that the overhead of scheduling them dominates. Nested nurseries block
+// workers of the pool, which then run their own tasks instead of
+// waiting.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <pkgxx/nursery.hxx>
+
+namespace {
+    std::atomic<std::size_t> counter = 0;
+
+    void
+    tiny_task() {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    flat(unsigned concurrency, std::size_t n_tasks) {
+        pkgxx::nursery n(concurrency);
+        for (std::size_t i = 0; i < n_tasks; i++) {
+            n.start_soon(tiny_task);
+        }
+    }
+
+    void
+    nested(unsigned concurrency, std::size_t n_tasks) {
+        constexpr std::size_t const fanout = 100;
+        pkgxx::nursery n(concurrency);
+        for (std::size_t i = 0; i < n_tasks / fanout; i++) {
+            n.start_soon(
+                [concurrency]() {
+                    pkgxx::nursery inner(concurrency);
+                    for (std::size_t j = 0; j < fanout; j++) {
+                        inner.start_soon(tiny_task);
+                    }
+                });
+        }
+    }
+
+    void
+    run(std::string const& label,
+        std::function<void (unsigned, std::size_t)> const& f,
+        unsigned concurrency) {
+
+        constexpr std::size_t const n_tasks = 200000;
+        counter = 0;
+        auto const start = std::chrono::steady_clock::now();
+        f(concurrency, n_tasks);
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        if (counter != n_tasks) {
+            std::cerr << label << ": only " << counter << " tasks ran" << std::endl;
+            std::exit(1);
+        }
+
+        double const secs = std::chrono::duration<double>(elapsed).count();
+        std::cout << std::left << std::setw(10) << label << std::right
+                  << std::setw(4) << concurrency << " threads"
+                  << std::fixed << std::setprecision(0)
+                  << std::setw(14) << static_cast<double>(n_tasks) / secs << " tasks/s"
+                  << std::endl;
+    }
+}
+
+int main() {
+    for (auto const concurrency: {1u, 8u, 64u}) {
+        run("flat", flat, concurrency);
+        run("nested", nested, concurrency);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Measure how long xargs_fold() takes when some arguments take much
+// longer than others, compared to the ideal schedule. Each argument is
+// a duration that the command sleeps for.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <istream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <pkgxx/harness.hxx>
+#include <pkgxx/xargs_fold.hxx>
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+    using seconds    = std::chrono::duration<double>;
+
+    constexpr unsigned const concurrency = 8;
+
+    // When each invocation finished.
+    struct finish_times {
+        std::vector<clock_type::time_point> times;
+
+        finish_times&
+        operator+= (finish_times&& other) {
+            times.insert(times.end(), other.times.begin(), other.times.end());
+            return *this;
+        }
+    };
+
+    // Mostly quick ones, some slow ones, and a few very slow ones, in a
+    // random but fixed order.
+    std::vector<double>
+    mixed_durations() {
+        std::vector<double> ds;
+        ds.insert(ds.end(), 360, 0.005);
+        ds.insert(ds.end(), 36, 0.05);
+        ds.insert(ds.end(), 4, 0.3);
+        std::shuffle(ds.begin(), ds.end(), std::mt19937(42));
+        return ds;
+    }
+
+    void
+    run(std::string const& label, std::optional<unsigned> batch_size) {
+        auto const ds = mixed_durations();
+        double total = 0;
+        for (auto const d: ds) {
+            total += d;
+        }
+        double const ideal = std::max(total / concurrency, *std::max_element(ds.begin(), ds.end()));
+
+        auto const start = clock_type::now();
+        auto const result = pkgxx::xargs_fold(
+            {pkgxx::shell, "-c", "for d; do sleep $d; done", pkgxx::shell},
+            [&](auto&& args) {
+                for (auto const d: ds) {
+                    args.push_back(std::to_string(d));
+                }
+            },
+            [](std::istream& in) {
+                in.ignore(std::numeric_limits<std::streamsize>::max());
+                return finish_times {{clock_type::now()}};
+            },
+            concurrency,
+            batch_size);
+        auto const elapsed = seconds(clock_type::now() - start).count();
+
+        auto times = result.times;
+        std::sort(times.begin(), times.end());
+        auto const median = seconds(times[times.size() / 2] - start).count();
+
+        std::cout << std::left << std::setw(16) << label << std::right
+                  << std::setw(6) << times.size() << " runs"
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(8) << median  << " s median"
+                  << std::setw(8) << elapsed << " s last"
+                  << std::setw(8) << elapsed - ideal << " s over ideal"
+                  << std::endl;
+    }
+}
+
+int main() {
+    std::cout << "Sleeping for 400 mixed durations with " << concurrency
+              << " invocations in parallel" << std::endl;
+    run("default", std::nullopt);
+    run("batch size 32", 32);
+    run("batch size 8", 8);
+    run("batch size 1", 1);
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <thread>
+
+#include "adaptive_concurrency.hxx"
+#include "line_reader.hxx"
+#include "string_algo.hxx"
+
+namespace {
+    using namespace pkgxx;
+
+    // The process-wide controller, or nullptr if it's not enabled.
+    std::shared_ptr<pkgxx::adaptive_concurrency> global;
+
+    // CPU time counters read from /proc/stat.
+    struct cpu_times {
+        unsigned long long total;
+        unsigned long long iowait;
+    };
+
+    // Read /proc/stat on Linux. On other platforms this silently fails
+    // and the controller relies solely on the load average.
+    void
+    read_proc_stat(std::optional<cpu_times>& times, std::optional<double>& procs_running) {
+        std::ifstream in("/proc/stat");
+        if (!in) {
+            return;
+        }
+        for (auto const line: line_reader(in)) {
+            words const ws(line);
+            auto w = ws.begin();
+            if (w == ws.end()) {
+                continue;
+            }
+            auto const key = *w++;
+            if (key == "cpu") {
+                // user nice system idle iowait irq softirq steal ...
+                unsigned long long total = 0, iowait = 0;
+                for (int i = 0; w != ws.end(); w++, i++) {
+                    if (auto const v = parse_integer<unsigned long long>(*w); v) {
+                        total += *v;
+                        if (i == 4) {
+                            iowait = *v;
+                        }
+                    }
+                    else {
+                        break;
+                    }
+                }
+                times = cpu_times { total, iowait };
+            }
+            else if (key == "procs_running" && w != ws.end()) {
+                if (auto const v = parse_integer<unsigned>(*w); v) {
+                    procs_running = *v;
+                }
+            }
+        }
+    }
+}
+
+namespace pkgxx {
+    std::ostream&
+    operator<< (std::ostream& out, load_sample const& s) {
+        char const* sep = "";
+        if (s.loadavg) {
+            out << sep << "load average " << std::fixed << std::setprecision(2) << *s.loadavg;
+            sep = ", ";
+        }
+        if (s.run_queue) {
+            out << sep << "run queue " << std::fixed << std::setprecision(0) << *s.run_queue;
+            sep = ", ";
+        }
+        if (s.iowait) {
+            out << sep << "I/O wait " << std::fixed << std::setprecision(0) << (*s.iowait * 100) << '%';
+            sep = ", ";
+        }
+        if (*sep == '\0') {
+            out << "no load information";
+        }
+        return out;
+    }
+
+    std::optional<concurrency_option>
+    concurrency_option::parse(std::string_view const& str) {
+        if (str == "auto") {
+            return concurrency_option {
+                2 * std::max(1u, std::thread::hardware_concurrency()),
+                true
+            };
+        }
+        else if (auto const n = parse_integer<unsigned>(str); n && *n > 0) {
+            return concurrency_option { *n, false };
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
+    adaptive_concurrency::adaptive_concurrency(
+        unsigned min,
+        unsigned max,
+        reporter_type const& report,
+        std::chrono::steady_clock::duration const& interval)
+        : _min(std::max(1u, min))
+        , _max(std::max(_min, max))
+        , _ncpu(std::max(1u, std::thread::hardware_concurrency()))
+        , _report(report)
+        , _interval(interval)
+        , _limit(std::clamp(_ncpu, _min, _max))
+        , _last_sampled() {}
+
+    load_sample
+    adaptive_concurrency::sample() {
+        load_sample s;
+
+#if defined(HAVE_GETLOADAVG)
+        double avg[1];
+        if (getloadavg(avg, 1) == 1) {
+            s.loadavg = avg[0];
+        }
+#endif
+
+        std::optional<cpu_times> times;
+        read_proc_stat(times, s.run_queue);
+        if (times) {
+            if (_prev_total && times->total > *_prev_total) {
+                s.iowait =
+                    static_cast<double>(times->iowait - *_prev_iowait) /
+                    static_cast<double>(times->total  - *_prev_total );
+            }
+            _prev_total  = times->total;
+            _prev_iowait = times->iowait;
+        }
+
+        return s;
+    }
+
+    unsigned
+    adaptive_concurrency::limit() {
+        lock_t lk(_mtx);
+
+        auto const now = std::chrono::steady_clock::now();
+        if (now - _last_sampled < _interval) {
+            return _limit;
+        }
+        _last_sampled = now;
+
+        auto const s = sample();
+
+        // The run queue reflects the current moment better than the load
+        // average, which lags behind by design. Prefer it when we have
+        // one.
+        std::optional<double> pressure;
+        if (s.run_queue) {
+            pressure = *s.run_queue / _ncpu;
+        }
+        else if (s.loadavg) {
+            pressure = *s.loadavg / _ncpu;
+        }
+
+        auto const old = _limit;
+        if (s.iowait && *s.iowait >= 0.25) {
+            // CPUs are mostly waiting for disks. Adding more tasks would
+            // only make things worse.
+            _limit -= std::min(_limit, std::max(1u, _limit / 4));
+        }
+        else if (pressure && *pressure > 1.25) {
+            _limit -= std::min(_limit, std::max(1u, _limit / 4));
+        }
+        else if (pressure && *pressure < 0.75) {
+            _limit++;
+        }
+        _limit = std::clamp(_limit, _min, _max);
+
+        if (_limit != old && _report) {
+            _report(_limit, s);
+        }
+        return _limit;
+    }
+
+    void
+    adaptive_concurrency::enable(unsigned max, reporter_type const& report) {
+        global = std::make_shared<adaptive_concurrency>(1, max, report);
+    }
+
+    unsigned
+    adaptive_concurrency::clamp(unsigned requested) {
+        if (global) {
+            return std::max(1u, std::min(requested, global->limit()));
+        }
+        else {
+            return requested;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <optional>
+#include <string_view>
+
+namespace pkgxx {
+    /** A snapshot of how busy the host is. Fields that cannot be obtained
+     * on the running platform are left as \c std::nullopt.
+     */
+    struct load_sample {
+        /// The 1-minute load average obtained with \c getloadavg(3).
+        std::optional<double> loadavg;
+        /// The number of runnable threads at the moment.
+        std::optional<double> run_queue;
+        /// The fraction of CPU time spent waiting for I/O since the
+        /// previous sample, ranging from 0 to 1.
+        std::optional<double> iowait;
+    };
+
+    /** Print a human-readable summary of a \ref load_sample, such as
+     * "load average 3.20, run queue 4, I/O wait 2%".
+     */
+    std::ostream&
+    operator<< (std::ostream& out, load_sample const& s);
+
+    /** A value of the \c -j option our commands take, which is either a
+     * positive integer or \c auto.
+     */
+    struct concurrency_option {
+        /** Parse an option argument, or return \c std::nullopt if it's
+         * invalid. \c auto lets the adaptive controller decide the
+         * actual concurrency, up to twice the number of CPUs because
+         * many of our tasks are I/O-bound.
+         */
+        static std::optional<concurrency_option>
+        parse(std::string_view const& str);
+
+        /// The maximum concurrency.
+        unsigned concurrency;
+        /// True if \ref adaptive_concurrency is to be enabled.
+        bool adaptive;
+    };
+
+    /** A controller that adjusts the number of in-flight tasks of \ref
+     * nursery instances according to the load of the host. It raises the
+     * limit additively while CPUs are underutilised, and lowers it
+     * multiplicatively when the host is overloaded or is mostly waiting
+     * for I/O.
+     *
+     * The controller is process-wide. Once enabled with \ref enable(),
+     * every \ref nursery consults it before starting a task, and the
+     * concurrency given to a \ref nursery acts as an upper bound.
+     *
+     * Instances of this class are thread-safe.
+     */
+    struct adaptive_concurrency {
+        /// A function to be called when the limit changes.
+        using reporter_type = std::function<void (unsigned, load_sample const&)>;
+
+        /** Construct a controller that keeps the limit within \c [min,
+         * max]. The initial limit is the number of available CPUs.
+         */
+        adaptive_concurrency(
+            unsigned min,
+            unsigned max,
+            reporter_type const& report = {},
+            std::chrono::steady_clock::duration const& interval = std::chrono::milliseconds(500));
+
+        /** Return the current limit, possibly after taking a new sample
+         * if the sampling interval has elapsed.
+         */
+        unsigned
+        limit();
+
+        /** Enable the process-wide controller. Calling this function more
+         * than once replaces the previous controller, but it must not be
+         * called while any \ref nursery is running.
+         */
+        static void
+        enable(unsigned max, reporter_type const& report = {});
+
+        /** Return \c requested, or the limit of the process-wide
+         * controller if it's enabled and lower than that.
+         */
+        static unsigned
+        clamp(unsigned requested);
+
+    private:
+        load_sample
+        sample();
+
+        using mutex_t = std::mutex;
+        using lock_t  = std::lock_guard<mutex_t>;
+
+        mutable mutex_t _mtx;
+        unsigned const _min;
+        unsigned const _max;
+        unsigned const _ncpu;
+        reporter_type const _report;
+        std::chrono::steady_clock::duration const _interval;
+
+        unsigned _limit;
+        std::chrono::steady_clock::time_point _last_sampled;
+
+        // The CPU time counters seen in the previous sample, used for
+        // computing the I/O wait fraction.
+        std::optional<unsigned long long> _prev_total;
+        std::optional<unsigned long long> _prev_iowait;
+    };
+}
@@ -1,46 +1,418 @@
 #include "config.h"
 
+#include <algorithm>
+#include <array>
+#include <set>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "build_version.hxx"
+#include "bzip2stream.hxx"
+#include "gzipstream.hxx"
 #include "harness.hxx"
+#include "line_reader.hxx"
+#include "mutex_guard.hxx"
+#include "nursery.hxx"
+#include "pkgdb.hxx"
+#include "string_algo.hxx"
+#include "tar_reader.hxx"
 #include "tempfile.hxx"
+#include "wwwstream.hxx"
+#include "xargs_fold.hxx"
+#include "xzstream.hxx"
+#include "zstdstream.hxx"
 
+using namespace std::literals;
 namespace fs = std::filesystem;
 
 namespace {
     using namespace pkgxx;
 
     build_version
-    read_build_version(std::istream& in) {
+    read_build_version(line_reader& reader) {
         build_version bv;
-        for (std::string line; std::getline(in, line); ) {
-            if (line.empty()) {
+        while (auto const line = reader.next_line()) {
+            if (line->empty()) {
                 break;
             }
-            else if (auto const sep = line.find(": "); sep != std::string::npos) {
-                fs::path const file = line.substr(0, sep);
+            else {
+                bv.add_line(*line);
+            }
+        }
+        return bv;
+    }
 
-                auto const tag_begin = line.find_first_not_of(' ', sep + 2);
-                std::string const tag = tag_begin == std::string::npos ? "" : line.substr(tag_begin);
+    build_version
+    read_build_version(std::istream& in) {
+        line_reader reader(in);
+        return read_build_version(reader);
+    }
 
-                bv.insert_or_assign(std::move(file), std::move(tag));
+    // Parse the output of "pkg_info -b pkg1 pkg2 ...", which looks like:
+    //
+    //   Information for foo-1.0:
+    //
+    //   Build version:
+    //   devel/foo/Makefile: $NetBSD: ...$
+    //   ...
+    //
+    //   Information for bar-2.0:
+    //   ...
+    build_version_map
+    read_build_versions(std::istream& in) {
+        std::string_view const header_prefix = "Information for ";
+        build_version_map bvs;
+        std::optional<pkgname> current;
+        line_reader reader(in);
+        while (auto const line = reader.next_line()) {
+            if (starts_with(*line, header_prefix) && ends_with(*line, ":")) {
+                current = pkgname(
+                    line->substr(header_prefix.size(),
+                                 line->size() - header_prefix.size() - 1));
+            }
+            else if (*line == "Build version:" && current) {
+                bvs.insert_or_assign(*current, read_build_version(reader));
+                current.reset();
             }
         }
-        return bv;
+        return bvs;
+    }
+
+    // A streambuf that yields some bytes already read from a base
+    // streambuf, and then the rest of the base. This lets us sniff the
+    // magic of streams that can't seek, such as remote files.
+    struct replay_streambuf: public std::streambuf {
+        replay_streambuf(std::streambuf* base, std::string&& prefix)
+            : _base(base)
+            , _prefix(std::move(prefix))
+            , _buf(64 * 1024) {
+
+            setg(_prefix.data(), _prefix.data(), _prefix.data() + _prefix.size());
+        }
+
+    protected:
+        virtual int_type
+        underflow() override {
+            // Block until the base has something, and then take whatever
+            // it has buffered in one go.
+            if (traits_type::eq_int_type(_base->sgetc(), traits_type::eof())) {
+                return traits_type::eof();
+            }
+            auto const n_read = _base->sgetn(
+                _buf.data(),
+                std::clamp(_base->in_avail(),
+                           static_cast<std::streamsize>(1),
+                           static_cast<std::streamsize>(_buf.size())));
+            setg(_buf.data(), _buf.data(), _buf.data() + n_read);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        std::streambuf* _base;
+        std::string _prefix;
+        std::vector<char> _buf;
+    };
+
+    // Call a function with a stream that decompresses a binary package
+    // file, or return std::nullopt if its compression format is unknown
+    // to us.
+    template <typename Function>
+    std::optional<build_version>
+    with_decompressed(std::istream& raw, Function const& f) {
+        std::array<char, 6> magic = {0, 0, 0, 0, 0, 0};
+        auto const n_read = raw.rdbuf()->sgetn(magic.data(), magic.size());
+        replay_streambuf replay(raw.rdbuf(), std::string(magic.data(), std::max<std::streamsize>(n_read, 0)));
+        std::istream replayed(&replay);
+
+        if (n_read >= 2 && magic[0] == '\x1f' && magic[1] == '\x8b') {
+            gunzipistream in(replayed);
+            return f(in);
+        }
+        else if (n_read >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h') {
+            bunzip2istream in(replayed);
+            return f(in);
+        }
+#if defined(HAVE_LZMA)
+        else if (n_read >= 6 && std::string_view(magic.data(), 6) == "\xFD" "7zXZ\0"sv) {
+            unxzistream in(replayed);
+            return f(in);
+        }
+#endif
+#if defined(HAVE_ZSTD)
+        else if (n_read >= 4 && std::string_view(magic.data(), 4) == "\x28\xB5\x2F\xFD"sv) {
+            unzstdistream in(replayed);
+            return f(in);
+        }
+#endif
+        else {
+            // Possibly a signed package (an ar(1) archive containing a
+            // tarball), or a compression format we don't support.
+            return {};
+        }
+    }
+
+    // Read +BUILD_VERSION out of a binary package, or return
+    // std::nullopt if it can't be read in-process.
+    std::optional<build_version>
+    read_build_version_from_package(std::istream& raw) {
+        return with_decompressed(
+            raw,
+            [](std::istream& in) -> std::optional<build_version> {
+                // pkg_create(1) puts metadata files, whose names all
+                // begin with '+', before anything else. We can stop
+                // reading as soon as we see something else.
+                tar_reader tar(in);
+                while (auto const e = tar.next()) {
+                    if (e->path == "+BUILD_VERSION") {
+                        std::istringstream contents(tar.read_contents());
+                        return read_build_version(contents);
+                    }
+                    else if (e->path.empty() || e->path[0] != '+') {
+                        break;
+                    }
+                }
+                // Not found. Let pkg_info(1) decide what to do about
+                // it.
+                return {};
+            });
+    }
+
+    bool
+    is_url(fs::path const& path) {
+        return path.string().find("://") != std::string::npos;
+    }
+
+    // Variables that relocate the files pkgsrc collects for
+    // +BUILD_VERSION. We can't evaluate them without bmake.
+    std::array<std::string_view, 4> const relocating_vars = {
+        "DISTINFO_FILE",
+        "FILESDIR",
+        "PATCHDIR",
+        "PKGDIR"
+    };
+
+    bool
+    is_relocating_assignment(std::string_view line) {
+        line = trim(line);
+        for (auto const& var: relocating_vars) {
+            if (starts_with(line, var)) {
+                auto const rest = trim(line.substr(var.size()));
+                if (starts_with(rest, "=")  || starts_with(rest, "+=") ||
+                    starts_with(rest, "?=") || starts_with(rest, ":=") ||
+                    starts_with(rest, "!=")) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Return true if the given Makefile, or any Makefile fragment it
+    // includes from the package or its siblings, assigns one of
+    // relocating_vars. Fragments from mk/ and buildlink3.mk files are not
+    // followed because they don't touch these variables. Unresolvable
+    // includes are conservatively treated as relocating, and ones
+    // naming files that don't exist are skipped.
+    bool
+    relocates_files(
+        fs::path const& PKGSRCDIR,
+        fs::path const& pkgdir,
+        fs::path const& makefile,
+        std::set<fs::path>& visited) {
+
+        if (!visited.insert(makefile.lexically_normal()).second) {
+            return false;
+        }
+
+        std::ifstream in(makefile);
+        if (!in) {
+            return false;
+        }
+        in.exceptions(std::ios_base::badbit);
+
+        for (auto const line: line_reader(in)) {
+            if (is_relocating_assignment(line)) {
+                return true;
+            }
+
+            auto const directive = trim(line);
+            if (!starts_with(directive, ".")) {
+                continue;
+            }
+            // bmake also has .sinclude, .-include, and .dinclude, which
+            // don't complain about missing files. Neither do we.
+            auto const keyword = trim(directive.substr(1));
+            auto const kw_end  = std::min(keyword.find_first_of(" \t\"<"), keyword.size());
+            if (auto const kw = keyword.substr(0, kw_end);
+                kw != "include" && kw != "sinclude" && kw != "-include" && kw != "dinclude") {
+                continue;
+            }
+
+            auto const open  = directive.find('"');
+            auto const close = directive.rfind('"');
+            if (open == std::string_view::npos || close <= open) {
+                return true;
+            }
+            std::string file(directive.substr(open + 1, close - open - 1));
+            if (starts_with(file, "${.CURDIR}/")) {
+                file = (pkgdir / file.substr(11)).string();
+            }
+            else if (starts_with(file, "${PKGSRCDIR}/")) {
+                file = (PKGSRCDIR / file.substr(13)).string();
+            }
+            if (file.find('$') != std::string::npos) {
+                return true;
+            }
+
+            fs::path const path = fs::path(file).is_absolute() ? fs::path(file) : makefile.parent_path() / file;
+            auto const name = path.filename().string();
+            if (name == "buildlink3.mk" ||
+                path.lexically_normal().parent_path() == (PKGSRCDIR / "mk").lexically_normal()) {
+                continue;
+            }
+            else if (relocates_files(PKGSRCDIR, pkgdir, path, visited)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Regular files in a directory, or nothing if the directory doesn't
+    // exist. Symlinks are followed just like test -f does, and dotfiles
+    // are skipped just like the glob "dir/*" does.
+    std::vector<fs::path>
+    regular_files_in(fs::path const& dir) {
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->path().filename().native().front() == '.') {
+                continue;
+            }
+            else if (fs::is_regular_file(it->path())) {
+                files.push_back(it->path());
+            }
+        }
+        return files;
     }
 }
 
 namespace pkgxx {
+    void
+    build_version::add_line(std::string_view const& line) {
+        if (auto const sep = line.find(": "); sep != std::string_view::npos) {
+            fs::path const file = line.substr(0, sep);
+
+            auto const tag_begin = line.find_first_not_of(' ', sep + 2);
+            std::string const tag(
+                tag_begin == std::string_view::npos ? std::string_view() : line.substr(tag_begin));
+
+            insert_or_assign(std::move(file), std::move(tag));
+        }
+    }
+
     std::optional<build_version>
     build_version::from_binary(
         std::string const& PKG_INFO,
         std::filesystem::path const& bin_pkg_file) {
 
-        if (!fs::exists(bin_pkg_file)) {
+        if (is_url(bin_pkg_file)) {
+            try {
+                if (auto bv = from_remote_binary(bin_pkg_file); bv) {
+                    return bv;
+                }
+            }
+            catch (remote_file_unavailable const&) {
+                return {};
+            }
+            catch (remote_file_error const&) {
+                // pkg_info(1) may have better luck.
+            }
+            return from_binary_pkg_info(PKG_INFO, bin_pkg_file);
+        }
+        else if (!fs::exists(bin_pkg_file)) {
+            return {};
+        }
+        else if (auto bv = from_binary_native(bin_pkg_file); bv) {
+            return bv;
+        }
+        else {
+            return from_binary_pkg_info(PKG_INFO, bin_pkg_file);
+        }
+    }
+
+    std::optional<build_version>
+    build_version::from_binary_native(
+        std::filesystem::path const& bin_pkg_file) {
+
+        std::ifstream raw(bin_pkg_file, std::ios_base::in | std::ios_base::binary);
+        if (!raw) {
+            return {};
+        }
+
+        try {
+            return read_build_version_from_package(raw);
+        }
+        catch (std::runtime_error const&) {
+            // Corrupted archives. pkg_info(1) will report errors.
+            return {};
+        }
+    }
+
+    std::optional<build_version>
+    build_version::from_remote_binary(std::string const& url) {
+        // Throws remote_file_unavailable if it doesn't exist.
+        wwwistream raw(url);
+        try {
+            // Metadata is at the beginning of the package, and dropping
+            // the stream closes the connection. We only transfer a
+            // prefix of the file this way.
+            return read_build_version_from_package(raw);
+        }
+        catch (std::runtime_error const&) {
+            // Corrupted archives, or the transfer failed.
+            return {};
+        }
+    }
+
+    std::map<std::string, build_version>
+    build_version::from_remote_binaries(
+        std::vector<std::string> const& urls,
+        unsigned concurrency) {
+
+        guarded<std::map<std::string, build_version>> bvs;
+        {
+            nursery n(concurrency);
+            for (auto const& url: urls) {
+                n.start_soon(
+                    [&]() {
+                        // libfetch can't be interrupted in the middle of
+                        // a request, but at least don't start new ones.
+                        cancellation_token::throw_if_cancelled();
+                        try {
+                            if (auto bv = from_remote_binary(url); bv) {
+                                bvs.lock()->insert_or_assign(url, std::move(*bv));
+                            }
+                        }
+                        catch (remote_file_error const&) {
+                            // Omit it from the result.
+                        }
+                    });
+            }
+        }
+        return std::move(*bvs.lock());
+    }
+
+    std::optional<build_version>
+    build_version::from_binary_pkg_info(
+        std::string const& PKG_INFO,
+        std::filesystem::path const& bin_pkg_file) {
+
+        if (!is_url(bin_pkg_file) && !fs::exists(bin_pkg_file)) {
             return {};
         }
 
@@ -82,11 +454,153 @@ namespace pkgxx {
         }
     }
 
+    build_version_map
+    build_version::from_installed(
+        std::string const& PKG_INFO,
+        std::set<pkgname> const& names,
+        unsigned concurrency) {
+
+        auto cmd = command_argv(PKG_INFO);
+        cmd.push_back("-b");
+        auto const run =
+            [&](std::set<pkgname> const& subset) {
+                return xargs_fold(
+                    cmd,
+                    [&](auto&& args) {
+                        for (auto const& name: subset) {
+                            args.push_back(name.string());
+                        }
+                    },
+                    read_build_versions,
+                    concurrency);
+            };
+
+        try {
+            return run(names);
+        }
+        catch (process_exited_for_failure const&) {
+            // pkg_info(1) exits with non-zero status if any of the
+            // packages isn't installed, which happens when someone
+            // deletes one in the meantime. That's not an error for us,
+            // and the package is simply absent from the result. Retry
+            // with the ones still installed so that any other failure
+            // surfaces.
+            auto const installed = installed_pkgnames(PKG_INFO);
+            std::set<pkgname> subset;
+            std::set_intersection(
+                names.begin(), names.end(),
+                installed.begin(), installed.end(),
+                std::inserter(subset, subset.end()));
+            return run(subset);
+        }
+    }
+
     std::optional<build_version>
     build_version::from_source(
         std::filesystem::path const& PKGSRCDIR,
         pkgpath const& path) {
 
+        if (!fs::exists(PKGSRCDIR / path)) {
+            return {};
+        }
+        else if (auto bv = from_source_native(PKGSRCDIR, path); bv) {
+            return bv;
+        }
+        else {
+            return from_source_bmake(PKGSRCDIR, path);
+        }
+    }
+
+    std::optional<build_version>
+    build_version::from_source_native(
+        std::filesystem::path const& PKGSRCDIR,
+        pkgpath const& path) {
+
+        // This mimics the recipe for ${_BUILD_VERSION_FILE} in
+        // mk/pkgformat/pkg/metadata.mk, which greps for RCS Ids in the
+        // following files:
+        //
+        //   * ${.CURDIR}/Makefile, ${FILESDIR}/*, and ${PKGDIR}/*
+        //   * patches listed in ${DISTINFO_FILE} that exist in ${PATCHDIR}
+        //   * ${PATCHDIR}/patch-local-*
+        //
+        // and strips ${PKGSRCDIR}/ from the resulting "file:line".
+        fs::path const pkgdir = PKGSRCDIR / path;
+        if (std::set<fs::path> visited;
+            relocates_files(PKGSRCDIR, pkgdir, pkgdir / "Makefile", visited)) {
+            return {};
+        }
+
+        fs::path const filesdir = pkgdir / "files";
+        fs::path const patchdir = pkgdir / "patches";
+        std::vector<fs::path> files;
+
+        files.push_back(pkgdir / "Makefile");
+        for (auto&& file: regular_files_in(filesdir)) {
+            files.push_back(std::move(file));
+        }
+        for (auto&& file: regular_files_in(pkgdir)) {
+            files.push_back(std::move(file));
+        }
+
+        if (std::ifstream distinfo(pkgdir / "distinfo"); distinfo) {
+            distinfo.exceptions(std::ios_base::badbit);
+            for (auto const line: line_reader(distinfo)) {
+                // SHA1 (patch-aa) = 0123...
+                std::vector<std::string_view> fields;
+                for (auto const field: words(line)) {
+                    fields.push_back(field);
+                }
+                if (fields.size() == 4 && fields[2] == "=") {
+                    std::string name(fields[1]);
+                    name.erase(std::remove_if(name.begin(), name.end(),
+                                              [](char c) { return c == '(' || c == ')'; }),
+                               name.end());
+                    if (fs::is_regular_file(patchdir / name)) {
+                        files.push_back(patchdir / name);
+                    }
+                }
+            }
+        }
+
+        for (auto&& file: regular_files_in(patchdir)) {
+            auto const name = file.filename().string();
+            if (ends_with(name, ".orig") || ends_with(name, ".rej") || ends_with(name, "~")) {
+                continue;
+            }
+            else if (starts_with(name, "patch-local-")) {
+                files.push_back(std::move(file));
+            }
+        }
+
+        build_version bv;
+        for (auto const& file: files) {
+            std::ifstream in(file, std::ios_base::in | std::ios_base::binary);
+            if (!in) {
+                continue;
+            }
+            in.exceptions(std::ios_base::badbit);
+
+            auto const rel = (fs::path(path) / file.lexically_relative(pkgdir)).string();
+            for (auto const line: line_reader(in)) {
+                if (line.find('\0') != std::string_view::npos) {
+                    // grep(1) would say "Binary file ... matches" for
+                    // this. Leave it to bmake.
+                    return {};
+                }
+                else if (line.find("$NetBSD") != std::string_view::npos) {
+                    bv.add_line(std::string(rel).append(1, ':').append(line));
+                }
+            }
+        }
+        return bv;
+    }
+
+    std::optional<build_version>
+    build_version::from_source_bmake(
+        std::filesystem::path const& PKGSRCDIR,
+        pkgpath const& path) {
+
         if (!fs::exists(PKGSRCDIR / path)) {
             return {};
         }
@@ -4,7 +4,11 @@
 #include <map>
 #include <optional>
 #include <ostream>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include <pkgxx/pkgname.hxx>
 #include <pkgxx/pkgpath.hxx>
@@ -13,17 +17,75 @@ namespace pkgxx {
     /** Class that represents a build version of a package. It is a map
      * from a file path to its RCS Id string.
      */
+    struct build_version_map;
+
     struct build_version: std::map<std::filesystem::path, std::string> {
         using std::map<std::filesystem::path, std::string>::map;
 
+        /** Parse a line of \c +BUILD_VERSION, i.e. \c "file: tag", and
+         * add it to the map. Lines not in that form are ignored.
+         */
+        void
+        add_line(std::string_view const& line);
+
         /** Retrieve a build version from a binary package file, or \c
-         * std::nullopt if the file does not exist.
+         * std::nullopt if the file does not exist. This tries \ref
+         * from_binary_native() first, or \ref from_remote_binary() if the
+         * file is a URL, and falls back on \ref from_binary_pkg_info().
          */
         static std::optional<build_version>
         from_binary(
             std::string const& PKG_INFO,
             std::filesystem::path const& bin_pkg_file);
 
+        /** Read a build version from a binary package file in-process by
+         * decompressing it only until \c +BUILD_VERSION is found. Return
+         * \c std::nullopt if the file cannot be read this way, e.g. when
+         * it's compressed in a format we don't support, it's signed, or
+         * it's corrupted.
+         *
+         * This function is thread-safe and spawns no processes.
+         */
+        static std::optional<build_version>
+        from_binary_native(
+            std::filesystem::path const& bin_pkg_file);
+
+        /** Read a build version from a remote binary package by
+         * transferring it only until \c +BUILD_VERSION is found, which
+         * is usually a tiny prefix of the file. Return \c std::nullopt
+         * if the file cannot be read this way, just like \ref
+         * from_binary_native(). Throws \ref remote_file_unavailable if
+         * the file doesn't exist, or \ref remote_file_error if it
+         * can't be fetched.
+         *
+         * This function is thread-safe and spawns no processes.
+         */
+        static std::optional<build_version>
+        from_remote_binary(std::string const& url);
+
+        /** Read build versions of many remote binary packages with \ref
+         * from_remote_binary(), running up to \c concurrency requests at
+         * the same time in a \ref nursery, and thus within the limit of
+         * \ref concurrency_budget. The result is a map from URLs to build
+         * versions, and packages that can't be read this way are
+         * silently omitted from it. No more requests are made once the
+         * current \ref cancellation_token is cancelled. The default
+         * concurrency is higher than the number of CPUs because requests
+         * are mostly waiting for the network.
+         */
+        static std::map<std::string, build_version>
+        from_remote_binaries(
+            std::vector<std::string> const& urls,
+            unsigned concurrency = 16);
+
+        /** Retrieve a build version from a binary package file by running
+         * \c pkg_info -b, or \c std::nullopt if the file does not exist.
+         */
+        static std::optional<build_version>
+        from_binary_pkg_info(
+            std::string const& PKG_INFO,
+            std::filesystem::path const& bin_pkg_file);
+
         /** Retrieve a build version from an installed package, or \c
          * std::nullopt if the package isn't installed.
          */
@@ -32,16 +94,62 @@ namespace pkgxx {
             std::string const& PKG_INFO,
             pkgname const& name);
 
+        /** Retrieve build versions of many installed packages at once
+         * with a handful of \c pkg_info -b invocations, run with a given
+         * concurrency. Packages that aren't installed are omitted from
+         * the result. Other failures of \c pkg_info are thrown.
+         */
+        static build_version_map
+        from_installed(
+            std::string const& PKG_INFO,
+            std::set<pkgname> const& names,
+            unsigned concurrency = std::max(1u, std::thread::hardware_concurrency()));
+
         /** Retrieve a build version from source, or \c std::nullopt if the
-         * package path doesn't exist.
+         * package path doesn't exist. This tries \ref from_source_native()
+         * first and falls back on \ref from_source_bmake().
          */
         static std::optional<build_version>
         from_source(
             std::filesystem::path const& PKGSRCDIR,
             pkgpath const& path);
 
+        /** Compute a build version from source by reading the package
+         * Makefile, distinfo, and patches directly, without invoking
+         * bmake. Return \c std::nullopt if the package relocates any of
+         * these files in a way that can only be resolved by bmake.
+         *
+         * This function is thread-safe.
+         */
+        static std::optional<build_version>
+        from_source_native(
+            std::filesystem::path const& PKGSRCDIR,
+            pkgpath const& path);
+
+        /** Retrieve a build version from source by asking bmake to
+         * generate \c +BUILD_VERSION, or \c std::nullopt if the package
+         * path doesn't exist. This is slow but authoritative.
+         */
+        static std::optional<build_version>
+        from_source_bmake(
+            std::filesystem::path const& PKGSRCDIR,
+            pkgpath const& path);
+
         /** Print a build version to an output stream. */
         friend std::ostream&
         operator<< (std::ostream& out, build_version const& bv);
     };
+
+    /** A map from package names to their build versions.
+     */
+    struct build_version_map: std::map<pkgname, build_version> {
+        using std::map<pkgname, build_version>::map;
+
+        /** Merge another map into this one. */
+        build_version_map&
+        operator+= (build_version_map&& other) {
+            merge(other);
+            return *this;
+        }
+    };
 }
@@ -0,0 +1,195 @@
+#include "config.h"
+
+#include <atomic>
+#include <fstream>
+#include <string_view>
+#include <sys/stat.h>
+#include <utility>
+
+#include "build_version_index.hxx"
+#include "gzipstream.hxx"
+#include "line_reader.hxx"
+#include "mutex_guard.hxx"
+#include "nursery.hxx"
+#include "pipelined_stream.hxx"
+#include "string_algo.hxx"
+#include "tempfile.hxx"
+
+using namespace std::literals;
+namespace fs = std::filesystem;
+
+namespace pkgxx {
+    build_version_index::build_version_index(std::filesystem::path const& PACKAGES)
+        : _dir(PACKAGES) {
+
+        std::ifstream raw(_dir / file_name, std::ios_base::in | std::ios_base::binary);
+        if (!raw) {
+            // No index, or PACKAGES is a URL.
+            return;
+        }
+        raw.exceptions(std::ios_base::badbit);
+        try {
+            load(raw);
+        }
+        catch (std::exception const&) {
+            // The index is only a cache. A corrupt one is as good as
+            // none, and packages will be examined one by one.
+            _entries.clear();
+        }
+    }
+
+    void
+    build_version_index::load(std::istream& raw) {
+        gunzipistream gz(raw);
+        pipelined_istream in(gz);
+        in.exceptions(std::ios_base::badbit);
+
+        // Empty strings mean the variable hasn't appeared in the current
+        // record.
+        std::string FILE_NAME;
+        std::string FILE_SIZE;
+        std::string FILE_MTIME;
+        build_version BUILD_VERSION;
+        auto const flush =
+            [&]() {
+                auto const size  = parse_integer<std::uintmax_t>(FILE_SIZE);
+                auto const mtime = parse_integer<std::int64_t>(FILE_MTIME);
+                // Drop incomplete or malformed records.
+                if (!FILE_NAME.empty() && size && mtime) {
+                    _entries.insert_or_assign(
+                        std::move(FILE_NAME),
+                        entry {
+                            file_stat {*size, *mtime},
+                            std::move(BUILD_VERSION)
+                        });
+                }
+                FILE_NAME.clear();
+                FILE_SIZE.clear();
+                FILE_MTIME.clear();
+                BUILD_VERSION.clear();
+            };
+        for (auto const line: line_reader(in)) {
+            if (line.empty()) {
+                flush();
+            }
+            else if (auto const equal = line.find('='); equal != std::string_view::npos) {
+                auto const variable = line.substr(0, equal);
+                auto const value    = line.substr(equal + 1);
+
+                if (variable == "BUILD_VERSION") {
+                    BUILD_VERSION.add_line(value);
+                }
+                else if (variable == "FILE_NAME") {
+                    FILE_NAME = value;
+                }
+                else if (variable == "FILE_SIZE") {
+                    FILE_SIZE = value;
+                }
+                else if (variable == "FILE_MTIME") {
+                    FILE_MTIME = value;
+                }
+            }
+        }
+        flush();
+    }
+
+    std::optional<build_version_index::file_stat>
+    build_version_index::stat_of(std::filesystem::path const& file) {
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0) {
+            return file_stat {
+                static_cast<std::uintmax_t>(st.st_size),
+                static_cast<std::int64_t>(st.st_mtime)
+            };
+        }
+        else {
+            return {};
+        }
+    }
+
+    std::optional<build_version>
+    build_version_index::find(std::filesystem::path const& bin_pkg_file) const {
+        if (_entries.empty()) {
+            return {};
+        }
+
+        auto const it = _entries.find(bin_pkg_file.lexically_relative(_dir).string());
+        if (it != _entries.end()) {
+            if (auto const st = stat_of(bin_pkg_file); st && *st == it->second.stat) {
+                return it->second.bv;
+            }
+        }
+        return {};
+    }
+
+    build_version_index::update_stats
+    build_version_index::update(
+        std::vector<std::filesystem::path> const& bin_pkg_files,
+        std::string const& PKG_INFO,
+        unsigned concurrency) {
+
+        update_stats stats = {0, 0, 0};
+        std::atomic<std::size_t> extracted = 0;
+        guarded<std::map<std::string, entry>> fresh;
+        {
+            nursery n(concurrency);
+            for (auto const& file: bin_pkg_files) {
+                auto const st = stat_of(file);
+                if (!st) {
+                    // The summary mentions a file that doesn't exist.
+                    continue;
+                }
+
+                auto key = file.lexically_relative(_dir).string();
+                if (auto it = _entries.find(key);
+                    it != _entries.end() && it->second.stat == *st) {
+
+                    fresh.lock()->insert_or_assign(std::move(key), std::move(it->second));
+                    stats.reused++;
+                }
+                else {
+                    n.start_soon(
+                        [&fresh, &extracted, &PKG_INFO, file, key = std::move(key), st = *st]() {
+                            // A package that fails to be read is dropped
+                            // from the index, and is counted as removed
+                            // below.
+                            if (auto bv = build_version::from_binary(PKG_INFO, file); bv) {
+                                fresh.lock()->insert_or_assign(
+                                    std::move(key), entry { st, std::move(*bv) });
+                                extracted.fetch_add(1, std::memory_order_relaxed);
+                            }
+                        });
+                }
+            }
+        }
+        stats.extracted = extracted.load();
+
+        for (auto const& [key, _e]: _entries) {
+            if (fresh.lock()->count(key) == 0) {
+                stats.removed++;
+            }
+        }
+        _entries = std::move(*fresh.lock());
+        return stats;
+    }
+
+    void
+    build_version_index::save() const {
+        replace_file(
+            _dir / file_name,
+            [&](std::ostream& raw) {
+                gzipostream out(raw);
+                out.exceptions(std::ios_base::badbit);
+                for (auto const& [key, e]: _entries) {
+                    out << "FILE_NAME="  << key          << '\n'
+                        << "FILE_SIZE="  << e.stat.size  << '\n'
+                        << "FILE_MTIME=" << e.stat.mtime << '\n';
+                    for (auto const& [file, tag]: e.bv) {
+                        out << "BUILD_VERSION=" << file.string() << ": " << tag << '\n';
+                    }
+                    out << '\n';
+                }
+                out.close();
+            });
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <pkgxx/build_version.hxx>
+
+namespace pkgxx {
+    /** An index of build versions of binary packages in a repository. It
+     * is stored in the repository as a sidecar file \c
+     * pkg_build_version.gz, which is a gzipped sequence of records
+     * resembling \c pkg_summary(5):
+     *
+     * \verbatim
+     * FILE_NAME=All/foo-1.0.tgz
+     * FILE_SIZE=12345
+     * FILE_MTIME=1700000000
+     * BUILD_VERSION=devel/foo/Makefile: $NetBSD: Makefile,v 1.1 ... $
+     * BUILD_VERSION=devel/foo/distinfo: $NetBSD: distinfo,v 1.1 ... $
+     *
+     * \endverbatim
+     *
+     * An entry is only trusted as long as the size and the mtime of the
+     * package file match the recorded ones, so a stale index never yields
+     * a wrong build version.
+     *
+     * The index is only consulted for local repositories. Checking the
+     * freshness of an entry in a remote one would take a \c HEAD request
+     * per package, which costs about as much as fetching the beginning of
+     * the package to read its build version in the first place.
+     */
+    struct build_version_index {
+        /// The name of the index file in a repository.
+        static constexpr char const* file_name = "pkg_build_version.gz";
+
+        /// The result of \ref update().
+        struct update_stats {
+            std::size_t reused;    ///< Entries that were still fresh.
+            std::size_t extracted; ///< Entries that were (re)computed.
+            std::size_t removed;   ///< Entries whose package files are gone or unreadable.
+        };
+
+        /** Load the index in a given repository directory. The index is
+         * empty if the directory has no index file, the file is corrupt,
+         * or it isn't a local directory. Malformed records are dropped.
+         */
+        build_version_index(std::filesystem::path const& PACKAGES);
+
+        /** Look up the build version of a binary package file, or return
+         * \c std::nullopt if the index has no fresh entry for it. This
+         * function is thread-safe.
+         */
+        std::optional<build_version>
+        find(std::filesystem::path const& bin_pkg_file) const;
+
+        /** Make the index cover exactly the given binary package
+         * files. Only files that are new or have changed since the last
+         * update are read, using \c pkg_info -b with a given
+         * concurrency.
+         */
+        update_stats
+        update(std::vector<std::filesystem::path> const& bin_pkg_files,
+               std::string const& PKG_INFO,
+               unsigned concurrency);
+
+        /** Write the index back to the repository directory. The file is
+         * replaced atomically.
+         */
+        void
+        save() const;
+
+    private:
+        struct file_stat {
+            std::uintmax_t size;
+            std::int64_t   mtime;
+
+            bool
+            operator== (file_stat const& other) const {
+                return size == other.size && mtime == other.mtime;
+            }
+        };
+
+        struct entry {
+            file_stat stat;
+            build_version bv;
+        };
+
+        static std::optional<file_stat>
+        stat_of(std::filesystem::path const& file);
+
+        void
+        load(std::istream& raw);
+
+        std::filesystem::path _dir;
+
+        // Keyed by paths relative to _dir.
+        std::map<std::string, entry> _entries;
+    };
+}
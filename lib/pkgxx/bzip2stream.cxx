@@ -1,7 +1,10 @@
+#include <algorithm>
+#include <array>
 #include <exception>
 #include <sstream>
 
 #include "bzip2stream.hxx"
+#include "nursery.hxx"
 
 namespace {
     std::runtime_error
@@ -31,11 +34,127 @@ namespace {
             return std::runtime_error(s.str());
         }
     }
+
+    // 48-bit magic numbers of bzip2 blocks and the end of a stream. They
+    // aren't byte-aligned.
+    constexpr std::uint64_t const block_magic = 0x314159265359;
+    constexpr std::uint64_t const eos_magic   = 0x177245385090;
+    constexpr std::uint64_t const magic_mask  = 0xFFFFFFFFFFFF;
+    constexpr std::uint64_t const magic_bits  = 48;
+
+    std::uint32_t
+    get_bits(std::string const& data, std::uint64_t pos, unsigned n) {
+        std::uint32_t v = 0;
+        for (unsigned i = 0; i < n; i++, pos++) {
+            auto const byte = static_cast<unsigned char>(data[pos / 8]);
+            v = (v << 1) | ((byte >> (7 - pos % 8)) & 1);
+        }
+        return v;
+    }
+
+    struct bit_writer {
+        bit_writer(std::string& out)
+            : _out(out)
+            , _acc(0)
+            , _n_acc(0) {}
+
+        void
+        put(std::uint64_t v, unsigned n) {
+            for (unsigned i = n; i > 0; i--) {
+                _acc = static_cast<unsigned char>((_acc << 1) | ((v >> (i - 1)) & 1));
+                if (++_n_acc == 8) {
+                    _out.push_back(static_cast<char>(_acc));
+                    _acc = 0;
+                    _n_acc = 0;
+                }
+            }
+        }
+
+        // Copy n bits from data starting at a bit offset pos. The writer
+        // must be at a byte boundary.
+        void
+        copy(std::string const& data, std::uint64_t pos, std::uint64_t n) {
+            auto const shift = static_cast<unsigned>(pos % 8);
+            std::size_t const first = pos / 8;
+            std::size_t const n_bytes = n / 8;
+            _out.reserve(_out.size() + n_bytes + 16);
+            for (std::size_t i = 0; i < n_bytes; i++) {
+                auto const hi = static_cast<unsigned char>(data[first + i]);
+                if (shift == 0) {
+                    _out.push_back(static_cast<char>(hi));
+                }
+                else {
+                    auto const lo = static_cast<unsigned char>(data[first + i + 1]);
+                    _out.push_back(static_cast<char>((hi << shift) | (lo >> (8 - shift))));
+                }
+            }
+            auto const rest = static_cast<unsigned>(n % 8);
+            put(get_bits(data, pos + n_bytes * 8, rest), rest);
+        }
+
+        void
+        pad() {
+            if (_n_acc > 0) {
+                put(0, 8 - _n_acc);
+            }
+        }
+
+    private:
+        std::string& _out;
+        unsigned char _acc;
+        unsigned _n_acc;
+    };
+
+    // Decode a single block as a standalone bzip2 stream. The combined
+    // CRC of a stream with just one block equals the CRC of the block.
+    std::optional<std::string>
+    decode_block(std::string const& data, char level,
+                 std::uint64_t begin, std::uint64_t end) {
+
+        std::string stream = {'B', 'Z', 'h', level};
+        bit_writer w(stream);
+        w.copy(data, begin, end - begin);
+        w.put(eos_magic, magic_bits);
+        w.put(get_bits(data, begin + magic_bits, 32), 32);
+        w.pad();
+
+        bz_stream bz;
+        bz.bzalloc = nullptr;
+        bz.bzfree  = nullptr;
+        bz.opaque  = nullptr;
+        if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+            return {};
+        }
+        bz.next_in  = stream.data();
+        bz.avail_in = static_cast<unsigned>(stream.size());
+
+        std::string out;
+        std::size_t n_out = 0;
+        int res;
+        do {
+            out.resize(std::max<std::size_t>(out.size() * 2, 1024 * 1024));
+            bz.next_out  = out.data() + n_out;
+            bz.avail_out = static_cast<unsigned>(out.size() - n_out);
+            res = BZ2_bzDecompress(&bz);
+            n_out = out.size() - bz.avail_out;
+        } while (res == BZ_OK && bz.avail_out == 0);
+        BZ2_bzDecompressEnd(&bz);
+
+        if (res == BZ_STREAM_END) {
+            out.resize(n_out);
+            return out;
+        }
+        else {
+            // Possibly a false match of the magic number.
+            return {};
+        }
+    }
 }
 
 namespace pkgxx {
-    bunzip2streambuf::bunzip2streambuf(std::streambuf* base)
+    bunzip2streambuf::bunzip2streambuf(std::streambuf* base, std::size_t buf_size)
         : _base(base)
+        , _buf_size(buf_size)
         , _bunzip2_eof(false)
         , _bunzip2_done(false) {
 
@@ -58,8 +177,8 @@ namespace pkgxx {
         if (eback() == nullptr) {
             // An underflow has happened because we haven't allocated
             // buffers yet.
-            _bunzip2_in  = buffer_t();
-            _bunzip2_out = buffer_t();
+            _bunzip2_in  = buffer_t(_buf_size);
+            _bunzip2_out = buffer_t(_buf_size);
         }
 
         while (!_bunzip2_done) {
@@ -69,25 +188,19 @@ namespace pkgxx {
                 _bunzip2.next_in  = _bunzip2_in->data();
                 _bunzip2.avail_in = 0;
 
-                if (auto avail = _base->in_avail(); avail > 0) {
+                // Block until the base streambuf has something, and then
+                // take whatever it has buffered in one go.
+                if (traits_type::eq_int_type(_base->sgetc(), traits_type::eof())) {
+                    _bunzip2_eof = true;
+                }
+                else {
                     std::streamsize const n_read = _base->sgetn(
                         _bunzip2_in->data(),
-                        static_cast<std::streamsize>(_bunzip2_in->size()));
+                        std::min(
+                            _base->in_avail(),
+                            static_cast<std::streamsize>(_bunzip2_in->size())));
                     _bunzip2.avail_in = static_cast<unsigned>(n_read);
                 }
-                else {
-                    // The base streambuf can't provide us any data without
-                    // blocking. Allow it to block.
-                    int_type const ch = _base->sbumpc();
-                    if (traits_type::eq_int_type(ch, traits_type::eof())) {
-                        // But it got EOF.
-                        _bunzip2_eof = true;
-                    }
-                    else {
-                        (*_bunzip2_in)[0] = traits_type::to_char_type(ch);
-                        _bunzip2.avail_in = 1;
-                    }
-                }
             }
 
             _bunzip2.next_out  = _bunzip2_out->data();
@@ -103,6 +216,11 @@ namespace pkgxx {
                          _bunzip2_out->data() + n_read);
                     return traits_type::to_int_type(*gptr());
                 }
+                else if (_bunzip2_eof && _bunzip2.avail_in == 0) {
+                    // bzip2 needs more input but there is no more. The
+                    // stream is truncated.
+                    throw bz2_exception(BZ_UNEXPECTED_EOF);
+                }
                 else {
                     // bzip2 needs more input to produce a single output
                     // byte.
@@ -154,4 +272,184 @@ namespace pkgxx {
         }
     }
 #endif
+
+    parallel_bunzip2streambuf::parallel_bunzip2streambuf(
+        std::streambuf* base, unsigned concurrency)
+        : _base(base)
+        , _concurrency(std::max(1u, concurrency))
+        , _base_eof(false)
+        , _scanned_bits(0)
+        , _shift_reg(0)
+        , _next_block(0)
+        , _combined_crc(0)
+        , _done(false)
+        , _next_decoded(0)
+        , _emitted(0) {
+
+        if (_concurrency == 1) {
+            // Nothing to parallelise. Don't bother buffering the input.
+            _serial = std::make_unique<bunzip2streambuf>(base);
+        }
+    }
+
+#if !defined(DOXYGEN)
+    parallel_bunzip2streambuf::int_type
+    parallel_bunzip2streambuf::underflow() {
+        if (_serial) {
+            if (_current.size() < bunzip2streambuf::default_buf_size) {
+                _current.resize(bunzip2streambuf::default_buf_size);
+            }
+            auto const n_read = _serial->sgetn(
+                _current.data(), static_cast<std::streamsize>(_current.size()));
+            if (n_read <= 0) {
+                return traits_type::eof();
+            }
+            setg(_current.data(), _current.data(), _current.data() + n_read);
+            return traits_type::to_int_type(*gptr());
+        }
+
+        while (_next_decoded >= _decoded.size()) {
+            if (_done) {
+                return traits_type::eof();
+            }
+            else if (!decode_window()) {
+                if (!_done) {
+                    fall_back();
+                    return underflow();
+                }
+            }
+        }
+
+        _current = std::move(_decoded[_next_decoded++]);
+        _emitted += _current.size();
+        setg(_current.data(), _current.data(), _current.data() + _current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+#endif
+
+    bool
+    parallel_bunzip2streambuf::read_more() {
+        if (_base_eof) {
+            return false;
+        }
+
+        std::array<char, 64 * 1024> buf;
+        auto const n_read = _base->sgetn(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (n_read <= 0) {
+            _base_eof = true;
+            return false;
+        }
+        _in.append(buf.data(), static_cast<std::size_t>(n_read));
+
+        // Scan the new bits for magic numbers. Stop at the end of the
+        // stream, as we decode only the first one.
+        for (auto const total = static_cast<std::uint64_t>(_in.size()) * 8;
+             !_eos && _scanned_bits < total; ) {
+
+            auto const byte = static_cast<unsigned char>(_in[_scanned_bits / 8]);
+            _shift_reg = (_shift_reg << 1) | ((byte >> (7 - _scanned_bits % 8)) & 1);
+            _scanned_bits++;
+
+            if (_scanned_bits >= magic_bits) {
+                auto const tail = _shift_reg & magic_mask;
+                if (tail == block_magic) {
+                    _blocks.push_back(_scanned_bits - magic_bits);
+                }
+                else if (tail == eos_magic) {
+                    _eos = _scanned_bits - magic_bits;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool
+    parallel_bunzip2streambuf::decode_window() {
+        // Wait until we have enough blocks whose end is known, i.e. the
+        // next block or the end of the stream has been found. We also
+        // need the combined CRC that follows the end-of-stream marker.
+        std::size_t const window = _concurrency * 2;
+        auto const n_complete =
+            [&]() -> std::size_t {
+                auto const n = _blocks.size() - _next_block;
+                return _eos ? n : (n > 0 ? n - 1 : 0);
+            };
+        while (n_complete() < window &&
+               !(_eos && _in.size() * 8 >= *_eos + magic_bits + 32)) {
+            if (!read_more()) {
+                break;
+            }
+        }
+
+        // The stream must begin with "BZh1" to "BZh9", immediately
+        // followed by the first block.
+        if (_in.size() < 4 ||
+            _in.compare(0, 3, "BZh") != 0 || _in[3] < '1' || _in[3] > '9' ||
+            _blocks.empty() || _blocks.front() != 32) {
+            return false;
+        }
+
+        auto const n = std::min(window, n_complete());
+        if (n == 0) {
+            if (_eos && _next_block == _blocks.size() &&
+                _in.size() * 8 >= *_eos + magic_bits + 32 &&
+                get_bits(_in, *_eos + magic_bits, 32) == _combined_crc) {
+                _done = true;
+            }
+            // Otherwise the stream is truncated or something is wrong
+            // with it.
+            return false;
+        }
+
+        std::vector<std::optional<std::string>> results(n);
+        {
+            nursery nurs(_concurrency);
+            for (std::size_t i = 0; i < n; i++) {
+                auto const b     = _next_block + i;
+                auto const begin = _blocks[b];
+                auto const end   = b + 1 < _blocks.size() ? _blocks[b + 1] : *_eos;
+                nurs.start_soon(
+                    [this, &results, i, begin, end]() {
+                        results[i] = decode_block(_in, _in[3], begin, end);
+                    });
+            }
+        }
+
+        _decoded.clear();
+        _next_decoded = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            if (!results[i]) {
+                _decoded.clear();
+                return false;
+            }
+            auto const crc = get_bits(_in, _blocks[_next_block + i] + magic_bits, 32);
+            _combined_crc = ((_combined_crc << 1) | (_combined_crc >> 31)) ^ crc;
+            _decoded.push_back(std::move(*results[i]));
+        }
+        _next_block += n;
+        return true;
+    }
+
+    void
+    parallel_bunzip2streambuf::fall_back() {
+        while (read_more()) {}
+
+        _decoded.clear();
+        _next_decoded = 0;
+        _serial_in = std::make_unique<membuf>(_in.data(), _in.data() + _in.size());
+        _serial = std::make_unique<bunzip2streambuf>(_serial_in.get());
+
+        // Skip what we have already handed out.
+        std::array<char, 64 * 1024> buf;
+        for (auto n_skip = _emitted; n_skip > 0; ) {
+            auto const n_read = _serial->sgetn(
+                buf.data(),
+                static_cast<std::streamsize>(
+                    std::min<std::uint64_t>(n_skip, buf.size())));
+            if (n_read <= 0) {
+                break;
+            }
+            n_skip -= static_cast<std::uint64_t>(n_read);
+        }
+    }
 }
@@ -1,10 +1,15 @@
 #pragma once
 
-#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <istream>
 #include <memory>
 #include <optional>
 #include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
 #include <bzlib.h>
 
 namespace pkgxx {
@@ -12,10 +17,14 @@ namespace pkgxx {
      * only supports reading operations.
      */
     struct bunzip2streambuf: public std::streambuf {
+        /// The default size of the compressed and decompressed buffers.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
         /** Construct a stream buffer that reads bzip2-compressed data from
          * another stream buffer.
          */
-        bunzip2streambuf(std::streambuf* base);
+        bunzip2streambuf(std::streambuf* base,
+                         std::size_t buf_size = default_buf_size);
         virtual ~bunzip2streambuf();
 
     protected:
@@ -28,10 +37,10 @@ namespace pkgxx {
 #endif
 
     private:
-        static constexpr int const buf_size = 1024;
-        using buffer_t = std::array<char_type, buf_size>;
+        using buffer_t = std::vector<char_type>;
 
         std::streambuf* _base;
+        std::size_t _buf_size;
 
         bz_stream _bunzip2;
         bool _bunzip2_eof;  // Got EOF from _base.
@@ -46,11 +55,12 @@ namespace pkgxx {
         /** Construct an input stream that reads bzip2-compressed data from
          * another input stream.
          */
-        bunzip2istream(std::istream& base)
+        bunzip2istream(std::istream& base,
+                       std::size_t buf_size = bunzip2streambuf::default_buf_size)
             : std::istream(nullptr) {
 
             if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
-                _buf = std::make_unique<bunzip2streambuf>(base_buf);
+                _buf = std::make_unique<bunzip2streambuf>(base_buf, buf_size);
                 rdbuf(_buf.get());
             }
         }
@@ -68,4 +78,111 @@ namespace pkgxx {
     private:
         std::unique_ptr<bunzip2streambuf> _buf;
     };
+
+    /** A stream buffer that reads bzip2-compressed data like \ref
+     * bunzip2streambuf, but decodes blocks in parallel.
+     *
+     * A bzip2 stream consists of blocks that can be decoded
+     * independently. This stream buffer locates blocks by scanning the
+     * compressed data for their bit-aligned magic numbers, decodes up to
+     * twice as many blocks as \c concurrency at once on a \ref nursery,
+     * and hands out the results in order. Each block is verified with its
+     * own CRC, and the combined CRC of the stream is verified at the end.
+     *
+     * The compressed data is kept in memory until the stream buffer is
+     * destroyed. If the stream doesn't look like what this decoder
+     * expects, or anything fails to decode, it silently falls back to
+     * decoding the entire stream sequentially, which reports errors as
+     * \ref bunzip2streambuf does. Like \ref bunzip2streambuf only the
+     * first stream in the input is decoded.
+     */
+    struct parallel_bunzip2streambuf: public std::streambuf {
+        /** Construct a stream buffer that reads bzip2-compressed data from
+         * another stream buffer.
+         */
+        parallel_bunzip2streambuf(
+            std::streambuf* base,
+            unsigned concurrency = std::max(1u, std::thread::hardware_concurrency()));
+
+    protected:
+#if !defined(DOXYGEN)
+        virtual int_type
+        underflow() override;
+#endif
+
+    private:
+        struct membuf: public std::streambuf {
+            membuf(char* begin, char* end) {
+                setg(begin, begin, end);
+            }
+        };
+
+        // Read more compressed data from _base and look for magic
+        // numbers in it. Return false at EOF.
+        bool
+        read_more();
+
+        // Decode the next window of blocks. Return false if there are no
+        // more blocks or the parallel decoder gave up.
+        bool
+        decode_window();
+
+        // Switch to the sequential decoder, skipping what we have already
+        // handed out.
+        void
+        fall_back();
+
+        std::streambuf* _base;
+        unsigned _concurrency;
+        bool _base_eof;
+
+        std::string _in;             // Compressed data read so far.
+        std::uint64_t _scanned_bits; // The number of bits scanned for magic numbers.
+        std::uint64_t _shift_reg;    // The last 64 bits scanned.
+        std::vector<std::uint64_t> _blocks; // Bit offsets of block magic numbers.
+        std::optional<std::uint64_t> _eos;  // The bit offset of the end-of-stream magic number.
+        std::size_t _next_block;     // The index of the first block not decoded yet.
+        std::uint32_t _combined_crc;
+        bool _done;
+
+        std::vector<std::string> _decoded; // Decoded blocks ready to be handed out.
+        std::size_t _next_decoded;
+        std::string _current;              // The block being handed out.
+        std::uint64_t _emitted;            // The number of bytes handed out so far.
+
+        std::unique_ptr<membuf> _serial_in;
+        std::unique_ptr<bunzip2streambuf> _serial;
+    };
+
+    /** An input stream that reads bzip2-compressed data using \ref
+     * parallel_bunzip2streambuf.
+     */
+    struct parallel_bunzip2istream: public std::istream {
+        /** Construct an input stream that reads bzip2-compressed data from
+         * another input stream.
+         */
+        parallel_bunzip2istream(
+            std::istream& base,
+            unsigned concurrency = std::max(1u, std::thread::hardware_concurrency()))
+            : std::istream(nullptr) {
+
+            if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
+                _buf = std::make_unique<parallel_bunzip2streambuf>(base_buf, concurrency);
+                rdbuf(_buf.get());
+            }
+        }
+
+        /** Construct an instance of \ref parallel_bunzip2istream by moving
+         * a buffer out of another instance. */
+        parallel_bunzip2istream(parallel_bunzip2istream&& other)
+            : std::istream(std::move(other))
+            , _buf(std::move(other._buf)) {
+
+            other.set_rdbuf(nullptr);
+            rdbuf(_buf.get());
+        }
+
+    private:
+        std::unique_ptr<parallel_bunzip2streambuf> _buf;
+    };
 }
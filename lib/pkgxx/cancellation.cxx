@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <signal.h>
+
+#include "cancellation.hxx"
+
+namespace {
+    // The token of the nursery task running on the current thread. We
+    // store it type-erased to keep the state private to the token.
+    thread_local std::shared_ptr<void> current_state;
+}
+
+namespace pkgxx {
+    cancellation_token::cancellation_token()
+        : _st(std::make_shared<state>()) {
+
+        if (current_state) {
+            auto parent = std::static_pointer_cast<state>(current_state);
+            {
+                std::lock_guard<std::mutex> lk(parent->mtx);
+                // Forget children that have gone, so that a long-lived
+                // token doesn't accumulate dead entries.
+                parent->children.erase(
+                    std::remove_if(
+                        parent->children.begin(), parent->children.end(),
+                        [](auto const& child) { return child.expired(); }),
+                    parent->children.end());
+                parent->children.push_back(_st);
+            }
+            if (parent->cancelled.load(std::memory_order_acquire)) {
+                _st->cancelled.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    cancellation_token
+    cancellation_token::current() {
+        return cancellation_token(std::static_pointer_cast<state>(current_state));
+    }
+
+    void
+    cancellation_token::throw_if_cancelled() {
+        if (current().is_cancelled()) {
+            throw operation_cancelled();
+        }
+    }
+
+    void
+    cancellation_token::cancel() {
+        if (_st) {
+            cancel(_st);
+        }
+    }
+
+    void
+    cancellation_token::cancel(std::shared_ptr<state> const& st) {
+        std::vector<std::shared_ptr<state>> children;
+        {
+            std::lock_guard<std::mutex> lk(st->mtx);
+            if (st->cancelled.exchange(true, std::memory_order_acq_rel)) {
+                // Already cancelled. Its descendants have been cancelled
+                // too, or they were created after that and are born
+                // cancelled.
+                return;
+            }
+            for (auto const pid: st->processes) {
+                // The process may have exited without being reaped
+                // yet. Signalling a zombie is harmless, and so is
+                // signalling a group it leads.
+                ::kill(pid, SIGTERM);
+            }
+            for (auto const& child: st->children) {
+                if (auto c = child.lock(); c) {
+                    children.push_back(std::move(c));
+                }
+            }
+        }
+        for (auto const& c: children) {
+            cancel(c);
+        }
+    }
+
+    void
+    cancellation_token::register_process(pid_t pid, bool group) {
+        if (_st) {
+            // kill(2) takes a negated pid for a process group.
+            pid_t const target = group ? -pid : pid;
+
+            std::lock_guard<std::mutex> lk(_st->mtx);
+            if (_st->cancelled.load(std::memory_order_acquire)) {
+                ::kill(target, SIGTERM);
+                throw operation_cancelled();
+            }
+            _st->processes.insert(target);
+        }
+    }
+
+    void
+    cancellation_token::unregister_process(pid_t pid, bool group) {
+        if (_st) {
+            std::lock_guard<std::mutex> lk(_st->mtx);
+            _st->processes.erase(group ? -pid : pid);
+        }
+    }
+
+    cancellation_token::scope::scope(cancellation_token const& token)
+        : _saved(std::move(current_state)) {
+
+        current_state = token._st;
+    }
+
+    cancellation_token::scope::~scope() {
+        current_state = std::move(_saved);
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <sys/types.h>
+#include <vector>
+
+namespace pkgxx {
+    /** An exception thrown when an operation is abandoned because its
+     * \ref cancellation_token has been cancelled.
+     */
+    struct operation_cancelled: virtual std::runtime_error {
+        operation_cancelled()
+            : std::runtime_error("The operation has been cancelled") {}
+    };
+
+    /** A token for cooperative cancellation of nursery tasks. Every \ref
+     * nursery owns a token and installs it as the current token of the
+     * thread while running its tasks. A token created while another one is
+     * current becomes its child, and cancelling a token also cancels all
+     * of its descendants.
+     *
+     * Child processes spawned with \ref harness are registered to the
+     * current token, and cancelling the token sends \c SIGTERM to
+     * them, or to their process groups if they have their own. Long-running tasks that don't spawn processes can poll \ref
+     * throw_if_cancelled() instead.
+     *
+     * Tokens are cheap to copy, and copies share the same state. All the
+     * functions are thread-safe.
+     */
+    struct cancellation_token {
+        /** Create a new token. It's a child of the current token of the
+         * calling thread, if any.
+         */
+        cancellation_token();
+
+        /** Return the current token of the calling thread, or a null
+         * token if the thread isn't running any nursery tasks.
+         */
+        static cancellation_token
+        current();
+
+        /** Throw \ref operation_cancelled if the current token of the
+         * calling thread has been cancelled. Do nothing if there is no
+         * current token.
+         */
+        static void
+        throw_if_cancelled();
+
+        /** Return true if this is a null token, i.e. one returned by \ref
+         * current() outside of nursery tasks.
+         */
+        bool
+        is_null() const noexcept {
+            return !_st;
+        }
+
+        /** Return true if the token, or any of its ancestors, has been
+         * cancelled.
+         */
+        bool
+        is_cancelled() const noexcept {
+            return _st && _st->cancelled.load(std::memory_order_acquire);
+        }
+
+        /** Cancel the token and all of its descendants, and send \c
+         * SIGTERM to every process registered to them. Cancelling a token
+         * twice has no effect.
+         */
+        void
+        cancel();
+
+        /** Register a child process so that it's signalled upon
+         * cancellation. If \c group is true, the process leads its own
+         * process group and the whole group is signalled, so that its
+         * descendants don't outlive it. Throw \ref operation_cancelled if
+         * the token has already been cancelled, in which case the process
+         * is signalled right away. This is a no-op for a null token.
+         */
+        void
+        register_process(pid_t pid, bool group = false);
+
+        /** Unregister a child process. This must be called before the
+         * process is reaped, or otherwise its pid may be reused by an
+         * unrelated process which we would then kill.
+         */
+        void
+        unregister_process(pid_t pid, bool group = false);
+
+        /** An RAII guard to install a token as the current token of the
+         * calling thread.
+         */
+        struct scope {
+            scope(cancellation_token const& token);
+            ~scope();
+
+            scope(scope const&) = delete;
+            scope& operator= (scope const&) = delete;
+
+        private:
+            std::shared_ptr<void> _saved;
+        };
+
+    private:
+        struct state {
+            std::atomic<bool> cancelled = false;
+            std::mutex mtx;
+            std::set<pid_t> processes;                     // Guarded by mtx. Negated for groups.
+            std::vector<std::weak_ptr<state>> children;    // Guarded by mtx.
+        };
+
+        cancellation_token(std::shared_ptr<state> const& st)
+            : _st(st) {}
+
+        static void
+        cancel(std::shared_ptr<state> const& st);
+
+        std::shared_ptr<state> _st;
+    };
+}
@@ -0,0 +1,214 @@
+#include "config.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+#if defined(HAVE_FCNTL_H)
+#  include <fcntl.h>
+#endif
+#if defined(HAVE_UNISTD_H)
+#  include <unistd.h>
+#endif
+
+#include "concurrency_budget.hxx"
+#include "string_algo.hxx"
+
+using namespace std::literals;
+
+namespace {
+    // A client of the GNU make jobserver. Tokens are single bytes read
+    // from a pipe or a FIFO, and they must be written back when released.
+    struct jobserver {
+        jobserver(int read_fd, int write_fd, std::string const& description)
+            : _read_fd(read_fd)
+            , _write_fd(write_fd)
+            , _description(description) {}
+
+        ~jobserver() {
+            if (_read_fd != _write_fd) {
+                close(_read_fd);
+            }
+            close(_write_fd);
+        }
+
+        // Find the jobserver in MAKEFLAGS and open our own non-blocking
+        // descriptor for it.
+        static std::unique_ptr<jobserver>
+        from_makeflags() {
+            char const* const makeflags = std::getenv("MAKEFLAGS");
+            if (!makeflags) {
+                return nullptr;
+            }
+
+            std::unique_ptr<jobserver> js;
+            for (auto const word: pkgxx::words(makeflags)) {
+                // The last occurrence wins, just like make does.
+                for (auto const prefix: {"--jobserver-auth="sv, "--jobserver-fds="sv}) {
+                    if (pkgxx::starts_with(word, prefix)) {
+                        if (auto found = open(word.substr(prefix.size())); found) {
+                            js = std::move(found);
+                        }
+                    }
+                }
+            }
+            return js;
+        }
+
+        bool
+        try_acquire() {
+            char token;
+            if (read(_read_fd, &token, 1) == 1) {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _tokens.push_back(token);
+                return true;
+            }
+            else {
+                return false;
+            }
+        }
+
+        void
+        release() {
+            char token;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_tokens.empty()) {
+                    // The token was acquired before we joined the
+                    // jobserver.
+                    return;
+                }
+                token = _tokens.back();
+                _tokens.pop_back();
+            }
+            while (write(_write_fd, &token, 1) == -1 && errno == EINTR);
+        }
+
+        std::string const&
+        description() const {
+            return _description;
+        }
+
+    private:
+        static std::unique_ptr<jobserver>
+        open(std::string_view const& auth) {
+            if (pkgxx::starts_with(auth, "fifo:")) {
+                // GNU make >= 4.4
+                std::string const path(auth.substr(5));
+                int const fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+                if (fd == -1) {
+                    return nullptr;
+                }
+                return std::make_unique<jobserver>(fd, fd, "fifo " + path);
+            }
+
+            // "R,W": file descriptors of an anonymous pipe inherited from
+            // make. We can't put the shared descriptor into non-blocking
+            // mode without affecting make and its other children, so we
+            // open a new file description of the same pipe. This only
+            // works on platforms where opening /dev/fd/N does not merely
+            // dup(2) the descriptor, so we stick to Linux /proc.
+            auto const comma = auth.find(',');
+            if (comma == std::string_view::npos) {
+                return nullptr;
+            }
+            int const r = std::atoi(std::string(auth.substr(0, comma)).c_str());
+            int const w = std::atoi(std::string(auth.substr(comma + 1)).c_str());
+            if (r < 0 || w < 0 || fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1) {
+                // make didn't pass the descriptors to us, e.g. because
+                // the command wasn't marked as recursive.
+                return nullptr;
+            }
+#if defined(__linux__)
+            auto const proc = "/proc/self/fd/" + std::to_string(r);
+            int const fd = ::open(proc.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd == -1) {
+                return nullptr;
+            }
+            int const wfd = fcntl(w, F_DUPFD_CLOEXEC, 0);
+            if (wfd == -1) {
+                close(fd);
+                return nullptr;
+            }
+            return std::make_unique<jobserver>(
+                fd, wfd, "pipe " + std::to_string(r) + "," + std::to_string(w));
+#else
+            return nullptr;
+#endif
+        }
+
+        int const _read_fd;
+        int const _write_fd;
+        std::string const _description;
+        std::mutex _mtx;
+        std::vector<char> _tokens; // Guarded by _mtx.
+    };
+
+    struct budget {
+        std::mutex mtx;
+        std::optional<unsigned> available; // Guarded by mtx. Unlimited if nullopt.
+        std::unique_ptr<jobserver> js;     // Immutable once set.
+    };
+
+    budget&
+    the_budget() {
+        // Intentionally leaked, as tasks may still be running at exit.
+        static budget* const b = new budget();
+        return *b;
+    }
+}
+
+namespace pkgxx {
+    std::string
+    concurrency_budget::enable(unsigned concurrency, bool join_jobserver) {
+        auto& b = the_budget();
+        std::lock_guard<std::mutex> lk(b.mtx);
+
+        b.available = concurrency > 0 ? concurrency - 1 : 0;
+        if (join_jobserver && !b.js) {
+            b.js = jobserver::from_makeflags();
+        }
+        return b.js ? b.js->description() : "";
+    }
+
+    bool
+    concurrency_budget::try_acquire() {
+        auto& b = the_budget();
+        {
+            std::lock_guard<std::mutex> lk(b.mtx);
+            if (!b.available) {
+                return true;
+            }
+            else if (*b.available == 0) {
+                return false;
+            }
+            else {
+                (*b.available)--;
+            }
+        }
+
+        if (b.js && !b.js->try_acquire()) {
+            // make has no job slots left for us.
+            std::lock_guard<std::mutex> lk(b.mtx);
+            (*b.available)++;
+            return false;
+        }
+        return true;
+    }
+
+    void
+    concurrency_budget::release() {
+        auto& b = the_budget();
+        if (b.js) {
+            b.js->release();
+        }
+
+        std::lock_guard<std::mutex> lk(b.mtx);
+        if (b.available) {
+            (*b.available)++;
+        }
+    }
+}
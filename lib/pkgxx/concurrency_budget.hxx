@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+namespace pkgxx {
+    /** A process-wide budget of concurrently running tasks, shared by
+     * every \ref nursery including the ones behind \ref xargs_fold(). It
+     * is a counting semaphore of tokens: every thread that runs code holds
+     * one implicit token (the main thread included), and starting another
+     * task in parallel requires acquiring an extra token from the
+     * budget. Since
+     * processes spawned with \ref harness are waited for by the task that
+     * spawned them, they are covered by the token of that task.
+     *
+     * A thread that can't get a token for a task doesn't wait for one;
+     * it runs the task inline with its own token instead. This is what
+     * keeps nested nurseries from oversubscribing the host while never
+     * deadlocking.
+     *
+     * The budget can optionally join the jobserver of GNU make found in
+     * \c MAKEFLAGS, in which case every extra token also takes a job slot
+     * from make.
+     *
+     * Until \ref enable() is called the budget is unlimited. All the
+     * functions are thread-safe.
+     */
+    struct concurrency_budget {
+        /** Limit the total number of concurrently running tasks to \c
+         * concurrency, i.e. <tt>concurrency - 1</tt> extra tokens. If \c
+         * join_jobserver is true and \c MAKEFLAGS names a usable jobserver,
+         * extra tokens are also drawn from it. Return a human-readable
+         * description of the jobserver being used, or an empty string if
+         * none.
+         */
+        static std::string
+        enable(unsigned concurrency, bool join_jobserver = true);
+
+        /** Try to acquire an extra token without blocking. Return true on
+         * success, in which case the caller must eventually call \ref
+         * release().
+         */
+        static bool
+        try_acquire();
+
+        /// Return a token acquired with \ref try_acquire().
+        static void
+        release();
+    };
+}
@@ -0,0 +1,108 @@
+#include <fstream>
+#include <sys/stat.h>
+
+#include "depends_cache.hxx"
+#include "line_reader.hxx"
+#include "pkgdb.hxx"
+#include "string_algo.hxx"
+#include "tempfile.hxx"
+
+namespace fs = std::filesystem;
+
+namespace pkgxx {
+    depends_cache::depends_cache(
+        std::filesystem::path const& file,
+        std::filesystem::path const& PKG_DBDIR)
+        : _file(file)
+        , _PKG_DBDIR(PKG_DBDIR) {
+
+        std::ifstream in(file);
+        if (!in) {
+            return;
+        }
+
+        line_reader lr(in);
+        if (auto const header = lr.next_line();
+            !header || *header != "pkgdb " + PKG_DBDIR.string()) {
+            // It's for another package database.
+            return;
+        }
+
+        auto es = _entries.lock();
+        for (auto const line: lr) {
+            words const ws(line);
+            auto w = ws.begin();
+            if (w == ws.end()) {
+                continue;
+            }
+            auto const mtime = parse_integer<mtime_type>(*w);
+            if (!mtime || ++w == ws.end()) {
+                continue;
+            }
+            try {
+                pkgname const name(*w);
+
+                entry e = {*mtime, {}};
+                for (w++; w != ws.end(); w++) {
+                    e.depends.emplace(*w);
+                }
+                es->insert_or_assign(name, std::move(e));
+            }
+            catch (std::exception const&) {
+                // Ignore malformed lines, as the cache is only a hint.
+                continue;
+            }
+        }
+    }
+
+    std::set<pkgname>
+    depends_cache::build_depends(std::string const& PKG_INFO, pkgname const& name) {
+        auto const mtime = mtime_of(name);
+        if (mtime) {
+            auto es = _entries.lock();
+            if (auto it = es->find(name); it != es->end() && it->second.mtime == *mtime) {
+                return it->second.depends;
+            }
+        }
+
+        // This is expensive so we shouldn't lock entries while doing it.
+        auto depends = pkgxx::build_depends(PKG_INFO, name);
+        if (mtime) {
+            _entries.lock()->insert_or_assign(name, entry {*mtime, depends});
+        }
+        return depends;
+    }
+
+    std::optional<depends_cache::mtime_type>
+    depends_cache::mtime_of(pkgname const& name) const {
+        auto const contents = _PKG_DBDIR / name.string() / "+CONTENTS";
+        struct stat st;
+        if (stat(contents.c_str(), &st) == 0) {
+            return static_cast<mtime_type>(st.st_mtime);
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
+    void
+    depends_cache::save() const {
+        replace_file(
+            _file,
+            [&](std::ostream& out) {
+                out << "pkgdb " << _PKG_DBDIR.string() << '\n';
+                auto es = _entries.lock();
+                for (auto const& [name, e]: *es) {
+                    if (mtime_of(name) != e.mtime) {
+                        // Deinstalled or replaced. Don't keep it.
+                        continue;
+                    }
+                    out << e.mtime << ' ' << name;
+                    for (auto const& dep: e.depends) {
+                        out << ' ' << dep;
+                    }
+                    out << '\n';
+                }
+            });
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+
+#include <pkgxx/mutex_guard.hxx>
+#include <pkgxx/pkgname.hxx>
+
+namespace pkgxx {
+    /** \c \@blddep entries of installed packages, persisted across runs
+     * in a small text file so that packages that haven't changed since
+     * the last run don't need to be queried again. An installed package
+     * is identified by its PKGNAME and the modification time of its \c
+     * +CONTENTS file. The first line of the file is the package database
+     * the entries came from, and each of the remaining lines is the
+     * modification time in seconds since the epoch, the PKGNAME, and the
+     * \c \@blddep entries of a package:
+     *
+     * \verbatim
+     * pkgdb /usr/pkg/pkgdb
+     * 1700000000 foo-1.0 bar-2.1 baz-0.3
+     * 1699990000 bar-2.1
+     * \endverbatim
+     *
+     * This is the only place where we look into \c PKG_DBDIR by
+     * ourselves. See \c HACKING.md.
+     *
+     * All the member functions are thread-safe.
+     */
+    struct depends_cache {
+        /** Load entries from a given file. A missing or malformed file,
+         * or one for a different package database, results in no
+         * entries.
+         */
+        depends_cache(std::filesystem::path const& file,
+                      std::filesystem::path const& PKG_DBDIR);
+
+        /** Obtain the set of \c \@blddep entries of an installed package
+         * just like \ref pkgxx::build_depends() does, but without running
+         * \c pkg_info if the package hasn't changed since it was cached.
+         */
+        std::set<pkgname>
+        build_depends(std::string const& PKG_INFO, pkgname const& name);
+
+        /** Write the entries back to the file it was loaded from,
+         * creating its parent directory if needed. Entries for packages
+         * that are no longer installed are dropped. The file is replaced
+         * atomically.
+         */
+        void
+        save() const;
+
+    private:
+        using mtime_type = std::int64_t;
+
+        struct entry {
+            mtime_type mtime;
+            std::set<pkgname> depends;
+        };
+
+        std::optional<mtime_type>
+        mtime_of(pkgname const& name) const;
+
+        std::filesystem::path const _file;
+        std::filesystem::path const _PKG_DBDIR;
+        mutable guarded<std::map<pkgname, entry>> _entries;
+    };
+}
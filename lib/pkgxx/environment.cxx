@@ -18,6 +18,22 @@ namespace pkgxx {
         }
     }
 
+    std::optional<fs::path>
+    cache_dir() {
+        if (auto dir = cgetenv("PKGCHKXX_CACHE_DIR"); dir && !dir->empty()) {
+            return fs::path(*dir);
+        }
+        else if (auto xdg = cgetenv("XDG_CACHE_HOME"); xdg && !xdg->empty()) {
+            return fs::path(*xdg) / "pkgchkxx";
+        }
+        else if (auto home = cgetenv("HOME"); home && !home->empty()) {
+            return fs::path(*home) / ".cache" / "pkgchkxx";
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
     environment::environment() {
         // Hide PKG_PATH to avoid breakage in 'make' calls.
         {
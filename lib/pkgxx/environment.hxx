@@ -10,6 +10,15 @@ namespace pkgxx {
     std::optional<std::string>
     cgetenv(std::string const& name);
 
+    /** Return the directory to store persistent caches in. It is \c
+     * $PKGCHKXX_CACHE_DIR if set, or \c pkgchkxx under \c
+     * $XDG_CACHE_HOME or \c $HOME/.cache otherwise. Return \c
+     * std::nullopt if none of these variables are set. The directory
+     * isn't created by this function.
+     */
+    std::optional<std::filesystem::path>
+    cache_dir();
+
     /** Values from the environment such as various Makefiles. Most of such
      * values are very expensive to retrieve so they are lazily
      * evaluated.
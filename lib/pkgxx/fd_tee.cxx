@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+#include "fd_tee.hxx"
+
+namespace {
+    constexpr std::size_t const chunk_size = 64 * 1024;
+
+    void
+    write_fully(int fd, char const* buf, std::size_t len) {
+        while (len > 0) {
+            ssize_t const n_written = write(fd, buf, len);
+            if (n_written > 0) {
+                buf += n_written;
+                len -= static_cast<std::size_t>(n_written);
+            }
+            else if (n_written == -1 && errno == EINTR) {
+                continue;
+            }
+            else {
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+        }
+    }
+
+    void
+    tee_fallback(int in, int out1, int out2) {
+        std::vector<char> buf(chunk_size);
+        while (true) {
+            ssize_t const n_read = read(in, buf.data(), buf.size());
+            if (n_read > 0) {
+                write_fully(out1, buf.data(), static_cast<std::size_t>(n_read));
+                write_fully(out2, buf.data(), static_cast<std::size_t>(n_read));
+            }
+            else if (n_read == 0) {
+                return;
+            }
+            else if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "read");
+            }
+        }
+    }
+
+#if defined(__linux__)
+    // Return true if splice(2) can write to a file descriptor. It refuses
+    // files opened with O_APPEND, and terminals don't support it at all.
+    bool
+    splice_writable(int fd) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            return false;
+        }
+        else if (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) {
+            return true;
+        }
+        else if (S_ISREG(st.st_mode)) {
+            int const flags = fcntl(fd, F_GETFL);
+            return flags != -1 && (flags & O_APPEND) == 0;
+        }
+        else {
+            return false;
+        }
+    }
+
+    struct pipe_pair {
+        pipe_pair() {
+            if (pipe2(fds, O_CLOEXEC) == -1) {
+                throw std::system_error(errno, std::generic_category(), "pipe2");
+            }
+        }
+
+        ~pipe_pair() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        int fds[2];
+    };
+
+    // Move exactly len bytes, which must be readily available, from a
+    // pipe to out. Use splice(2) as long as it keeps working, and read(2)
+    // and write(2) once it doesn't.
+    void
+    drain(int pipe_in, int out, std::size_t len, bool& splice_ok,
+          std::vector<char>& buf) {
+
+        while (len > 0 && splice_ok) {
+            ssize_t const n_moved = splice(pipe_in, nullptr, out, nullptr, len, SPLICE_F_MOVE);
+            if (n_moved > 0) {
+                len -= static_cast<std::size_t>(n_moved);
+            }
+            else if (n_moved == -1 && errno == EINTR) {
+                continue;
+            }
+            else if (n_moved == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                // The destination doesn't support splicing after all,
+                // e.g. a file system lacking support for it.
+                splice_ok = false;
+            }
+            else {
+                throw std::system_error(errno, std::generic_category(), "splice");
+            }
+        }
+
+        while (len > 0) {
+            ssize_t const n_read = read(pipe_in, buf.data(), std::min(len, buf.size()));
+            if (n_read > 0) {
+                write_fully(out, buf.data(), static_cast<std::size_t>(n_read));
+                len -= static_cast<std::size_t>(n_read);
+            }
+            else if (n_read == -1 && errno == EINTR) {
+                continue;
+            }
+            else {
+                throw std::system_error(
+                    n_read == 0 ? EIO : errno, std::generic_category(), "read");
+            }
+        }
+    }
+#endif
+}
+
+namespace pkgxx {
+    void
+    tee_fd(int in, int out1, int out2) {
+#if defined(__linux__)
+        if (!splice_writable(out1) || !splice_writable(out2)) {
+            // Splicing into one of them while copying into the other
+            // would take an extra syscall per chunk.
+            tee_fallback(in, out1, out2);
+            return;
+        }
+
+        // Duplicate the content of "in" into a private pipe with tee(2),
+        // which doesn't consume it. Then consume "in" by moving it to
+        // out1, and drain the private pipe into out2.
+        pipe_pair dup;
+        std::vector<char> buf(chunk_size);
+        bool splice1_ok = true;
+        bool splice2_ok = true;
+        while (true) {
+            ssize_t const n_dup = tee(in, dup.fds[1], chunk_size, 0);
+            if (n_dup > 0) {
+                auto const len = static_cast<std::size_t>(n_dup);
+                drain(in, out1, len, splice1_ok, buf);
+                drain(dup.fds[0], out2, len, splice2_ok, buf);
+            }
+            else if (n_dup == 0) {
+                return;
+            }
+            else if (errno == EINTR) {
+                continue;
+            }
+            else if (errno == EINVAL || errno == ENOSYS) {
+                // "in" isn't a pipe.
+                break;
+            }
+            else {
+                throw std::system_error(errno, std::generic_category(), "tee");
+            }
+        }
+#endif
+        tee_fallback(in, out1, out2);
+    }
+}
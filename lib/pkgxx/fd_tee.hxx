@@ -0,0 +1,17 @@
+#pragma once
+
+namespace pkgxx {
+    /** Copy everything readable from a file descriptor \c in to two file
+     * descriptors \c out1 and \c out2 until \c in reaches EOF, just like
+     * tee(1) does. On Linux the data is moved with tee(2) and splice(2)
+     * if both outputs are pipes, sockets, or regular files not opened
+     * with \c O_APPEND, so that it never goes through userspace. That
+     * takes three syscalls per chunk, just like read(2) followed by two
+     * write(2), and splicing into only one of them would take four. So
+     * when either of them is something else, e.g. a terminal, it uses
+     * read(2) and write(2) with a large buffer. Throws \c
+     * std::system_error on failure.
+     */
+    void
+    tee_fd(int in, int out1, int out2);
+}
@@ -4,9 +4,10 @@
 #include "fdstream.hxx"
 
 namespace pkgxx {
-    fdstreambuf::fdstreambuf(int fd, bool owned)
+    fdstreambuf::fdstreambuf(int fd, bool owned, std::size_t buf_size)
         : _fd(fd)
-        , _owned(owned) {}
+        , _owned(owned)
+        , _buf_size(buf_size) {}
 
     fdstreambuf::~fdstreambuf() {
         close();
@@ -28,22 +29,9 @@ namespace pkgxx {
     int
     fdstreambuf::sync() {
         if (pbase() != nullptr && pptr() > pbase()) {
-            std::size_t const n_write = static_cast<std::size_t>(pptr() - pbase());
-            for (std::size_t n_remaining = n_write; n_remaining > 0; ) {
-                ssize_t const n_written = write(_fd, _write_buf->data(), n_write);
-                if (n_written > 0) {
-                    n_remaining -= static_cast<std::size_t>(n_written);
-                    continue;
-                }
-                else if (n_written == -1 && errno == EINTR) {
-                    continue;
-                }
-                else {
-                    return -1;
-                }
+            if (!flush_put_area()) {
+                return -1;
             }
-            setp(_write_buf->data(),
-                 _write_buf->data() + _write_buf->size());
         }
         return 0;
     }
@@ -55,24 +43,13 @@ namespace pkgxx {
         if (pbase() == nullptr) {
             // An overflow has happened because we haven't allocated a
             // buffer yet.
-            _write_buf = buffer_t();
+            _write_buf = buffer_t(_buf_size);
         }
         else if (pptr() > pbase()) {
             // An overflow has happened either because the buffer became
             // full, or because it's being closed. Flush it now.
-            std::size_t const n_write = static_cast<std::size_t>(pptr() - pbase());
-            for (std::size_t n_remaining = n_write; n_remaining > 0; ) {
-                ssize_t const n_written = write(_fd, _write_buf->data(), n_write);
-                if (n_written > 0) {
-                    n_remaining -= static_cast<std::size_t>(n_written);
-                    continue;
-                }
-                else if (n_written == -1 && errno == EINTR) {
-                    continue;
-                }
-                else {
-                    return traits_type::eof();
-                }
+            if (!flush_put_area()) {
+                return traits_type::eof();
             }
         }
         setp(_write_buf->data(),
@@ -88,13 +65,35 @@ namespace pkgxx {
     }
 #endif
 
+    bool
+    fdstreambuf::flush_put_area() {
+        std::size_t const n_write = static_cast<std::size_t>(pptr() - pbase());
+        for (std::size_t n_remaining = n_write; n_remaining > 0; ) {
+            ssize_t const n_written =
+                write(_fd, pbase() + (n_write - n_remaining), n_remaining);
+            if (n_written > 0) {
+                n_remaining -= static_cast<std::size_t>(n_written);
+                continue;
+            }
+            else if (n_written == -1 && errno == EINTR) {
+                continue;
+            }
+            else {
+                return false;
+            }
+        }
+        setp(_write_buf->data(),
+             _write_buf->data() + _write_buf->size());
+        return true;
+    }
+
 #if !defined(DOXYGEN)
     fdstreambuf::int_type
     fdstreambuf::underflow() {
         if (eback() == nullptr) {
             // An underflow has happened because we haven't allocated a
             // buffer yet.
-            _read_buf = buffer_t();
+            _read_buf = buffer_t(_buf_size);
         }
 
         while (true) {
@@ -3,23 +3,32 @@
 /* Streaming I/O based on POSIX file descriptors.
  */
 
-#include <array>
+#include <cstddef>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <istream>
 #include <streambuf>
 #include <utility>
+#include <vector>
 
 namespace pkgxx {
     /** A stream buffer that works with a POSIX file descriptor.
      */
     struct fdstreambuf: public std::streambuf {
+        /** The default size of the read and write buffers. Pipes and
+         * files are read in chunks of this size.
+         */
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
         /** Construct a stream buffer reading data from / writing data to a
          * file descriptor. By default the fd will be owned by the buffer,
-         * i.e. when it's destructed the fd will also be closed.
+         * i.e. when it's destructed the fd will also be closed. Buffers
+         * of \c buf_size bytes are allocated on the first read and the
+         * first write respectively.
          */
-        fdstreambuf(int fd, bool owned = true);
+        fdstreambuf(int fd, bool owned = true,
+                    std::size_t buf_size = default_buf_size);
 
         virtual
         ~fdstreambuf();
@@ -55,11 +64,15 @@ namespace pkgxx {
 #endif
 
     private:
-        static constexpr int const buf_size = 1024;
-        using buffer_t = std::array<char_type, buf_size>;
+        // Write out the put area, retrying on partial writes.
+        bool
+        flush_put_area();
+
+        using buffer_t = std::vector<char_type>;
 
         int _fd;
         bool _owned;
+        std::size_t _buf_size;
         std::optional<buffer_t> _read_buf;
         std::optional<buffer_t> _write_buf;
     };
@@ -70,9 +83,10 @@ namespace pkgxx {
         /** Construct an output stream writing data to a file
          * descriptor. By default the fd will be owned by the stream,
          * i.e. when it's destructed the fd will also be closed. */
-        fdostream(int fd, bool owned = true)
+        fdostream(int fd, bool owned = true,
+                  std::size_t buf_size = fdstreambuf::default_buf_size)
             : std::ostream(nullptr)
-            , _buf(std::make_unique<fdstreambuf>(fd, owned)) {
+            , _buf(std::make_unique<fdstreambuf>(fd, owned, buf_size)) {
 
             rdbuf(_buf.get());
         }
@@ -120,9 +134,10 @@ namespace pkgxx {
         /** Construct an input stream reading data from a file
          * descriptor. By default the fd will be owned by the stream,
          * i.e. when it's destructed the fd will also be closed. */
-        fdistream(int fd, bool owned = true)
+        fdistream(int fd, bool owned = true,
+                  std::size_t buf_size = fdstreambuf::default_buf_size)
             : std::istream(nullptr)
-            , _buf(std::make_unique<fdstreambuf>(fd, owned)) {
+            , _buf(std::make_unique<fdstreambuf>(fd, owned, buf_size)) {
 
             rdbuf(_buf.get());
         }
@@ -172,10 +187,11 @@ namespace pkgxx {
         /** Construct a stream reading data from / writing data to a file
          * descriptor. By default the fd will be owned by the stream,
          * i.e. when it's destructed the fd will also be closed. */
-        fdstream(int fd, bool owned = true)
+        fdstream(int fd, bool owned = true,
+                 std::size_t buf_size = fdstreambuf::default_buf_size)
             : std::istream(nullptr)
             , std::ostream(nullptr)
-            , _buf(std::make_unique<fdstreambuf>(fd, owned)) {
+            , _buf(std::make_unique<fdstreambuf>(fd, owned, buf_size)) {
 
             rdbuf(_buf.get());
         }
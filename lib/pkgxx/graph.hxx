@@ -1,9 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <deque>
 #include <exception>
 #include <functional>
 #include <cassert>
+#include <limits>
 #include <map>
 #include <set>
 #include <optional>
@@ -65,7 +67,9 @@ namespace pkgxx {
      * the type of edges and need to be either \c void or some
      * copy-constructible, assignable, and outputtable type. Instances with
      * \c IsBidirectional being \c true have slightly more overhead but
-     * supports additional operations.
+     * supports additional operations. They also maintain the result of
+     * tsort() incrementally once it's computed, so that adding an edge
+     * only reorders the vertices in between its endpoints.
      */
     template <typename VertexT,
               typename EdgeT = void,
@@ -92,6 +96,23 @@ namespace pkgxx {
                     > const
             >;
 
+#if !defined(DOXYGEN)
+        graph() = default;
+        graph(graph const& other);
+        graph(graph&&) = default;
+
+        graph&
+        operator= (graph const& other) {
+            if (this != &other) {
+                *this = graph(other);
+            }
+            return *this;
+        }
+
+        graph&
+        operator= (graph&&) = default;
+#endif
+
         /** Add a vertex to the graph if it doesn't already exist. */
         void
         add_vertex(VertexT const& value) {
@@ -194,27 +215,85 @@ namespace pkgxx {
         std::vector<vertex_reference_type>
         tsort(bool cache = true) const;
 
+        /** Return the position of a vertex in the topological order
+         * tsort() returns when \c cache is \c true, or \c std::nullopt
+         * if no such vertex exists. Vertices appearing earlier have
+         * smaller positions, but positions aren't necessarily
+         * contiguous. This is cheap unless the order has to be
+         * recomputed, which only happens for the first call or after a
+         * cycle has been introduced. If the graph has a cycle \ref
+         * not_a_dag will be thrown. Only available for bidirectional
+         * graphs.
+         */
+        template <bool IsBidi = IsBidirectional>
+        std::enable_if_t<IsBidi, std::optional<std::size_t>>
+        tsort_position(VertexT const& value) const;
+
+        /** Return a number that changes whenever the topological order
+         * does, i.e. whenever tsort_position() may return something
+         * different for any vertex. Callers can use this to tell whether
+         * what they have derived from positions is still valid. Only
+         * available for bidirectional graphs.
+         */
+        template <bool IsBidi = IsBidirectional>
+        std::enable_if_t<IsBidi, std::size_t>
+        tsort_generation() const {
+            static_assert(IsBidi == IsBidirectional, "can't explicitly specialise");
+            return _order_generation;
+        }
+
+        /** Partition the graph into levels. Vertices that have no
+         * out-edges form the first level, and vertices in each
+         * subsequent level only have out-edges to vertices in earlier
+         * levels. Vertices in the same level don't depend on each other,
+         * and concatenating levels yields a valid result of tsort(). Each
+         * level is sorted by vertices. If the graph has a cycle \ref
+         * not_a_dag will be thrown.
+         */
+        std::vector<std::vector<vertex_reference_type>>
+        tsort_levels() const;
+
+        /** Return the number of vertices on the longest path in the
+         * graph, which is also the number of levels tsort_levels()
+         * returns. If the graph has a cycle \ref not_a_dag will be
+         * thrown.
+         */
+        std::size_t
+        critical_path_length() const {
+            return tsort_levels_impl().size();
+        }
+
     private:
         using vertex_id = unsigned long;
 
-        struct empty {};
-        struct bidi_vertex {
+        // Vertex IDs are dense, i.e. they are indices into _vertices, and
+        // IDs of removed vertices are reused. Adjacency lists are vectors
+        // sorted by IDs. Package graphs have few edges per vertex, so
+        // this is both smaller and faster to traverse than node-based
+        // containers.
+        using out_edge_type =
             std::conditional_t<
                 std::is_same_v<EdgeT, void>,
-                std::set<vertex_id>,
-                std::map<vertex_id, edge_reference_type>
-                > ins;
+                vertex_id,
+                std::pair<vertex_id, EdgeT>
+                >;
+
+        struct empty {};
+        struct bidi_vertex {
+            // Edge values, if any, are only stored in out-edges of the
+            // source vertices.
+            std::vector<vertex_id> ins;
+            // The index in _order. Meaningless if _order is empty.
+            std::size_t mutable position = 0;
+            // Used only while reordering vertices in add_edge().
+            bool marked = false;
         };
         struct vertex: public std::conditional_t<IsBidirectional, bidi_vertex, empty> {
             vertex(VertexT const& value_)
                 : value(&value_) {}
 
-            std::conditional_t<
-                std::is_same_v<EdgeT, void>,
-                std::set<vertex_id>,
-                std::map<vertex_id, EdgeT>
-                > outs;
-            VertexT const* value;
+            std::vector<out_edge_type> outs;
+            VertexT const* value; // nullptr if the vertex has been removed.
         };
 
         enum class colour {
@@ -223,9 +302,82 @@ namespace pkgxx {
             black  // visited and has no unvisited edges
         };
 
+        // The vertex an edge in an adjacency list points to. Lists of
+        // in-edges only have IDs even if EdgeT isn't void.
+        static vertex_id
+        target_of(vertex_id id) {
+            return id;
+        }
+
+        template <typename E = EdgeT>
+        static std::enable_if_t<!std::is_same_v<E, void>, vertex_id>
+        target_of(std::pair<vertex_id, E> const& out) {
+            return out.first;
+        }
+
+        // Find the position in a sorted adjacency list where an edge to
+        // a given vertex is or would be.
+        template <typename Edges>
+        static auto
+        position_of(Edges& edges, vertex_id id) {
+            return std::lower_bound(
+                edges.begin(), edges.end(), id,
+                [](auto const& edge, vertex_id id_) {
+                    return target_of(edge) < id_;
+                });
+        }
+
+        // Insert an ID to a sorted list unless it's already there. Return
+        // true if it's inserted.
+        static bool
+        insert_id(std::vector<vertex_id>& ids, vertex_id id) {
+            auto const it = position_of(ids, id);
+            if (it != ids.end() && *it == id) {
+                return false;
+            }
+            else {
+                ids.insert(it, id);
+                return true;
+            }
+        }
+
+        // Remove an edge to a given vertex from a sorted adjacency
+        // list. Return true if it existed.
+        template <typename Edges>
+        static bool
+        erase_edge_to(Edges& edges, vertex_id id) {
+            auto const it = position_of(edges, id);
+            if (it != edges.end() && target_of(*it) == id) {
+                edges.erase(it);
+                return true;
+            }
+            else {
+                return false;
+            }
+        }
+
         vertex_id
         add_vertex_impl(VertexT const& value);
 
+        // Restore the topological order after adding an edge, or
+        // discard it if the edge introduced a cycle.
+        void
+        reorder(vertex_id src, vertex_id dest);
+
+        // Compute the topological order from scratch unless it's being
+        // maintained.
+        void
+        establish_order() const;
+
+        std::vector<vertex_id>
+        tsort_impl() const;
+
+        std::vector<std::vector<vertex_id>>
+        tsort_levels_impl() const;
+
+        [[noreturn]] void
+        throw_cycle(vertex_id id, out_edge_type const& out) const;
+
         std::optional<
             std::conditional_t<
                 std::is_same_v<EdgeT, void>,
@@ -239,8 +391,20 @@ namespace pkgxx {
         shortest_path_impl(vertex_id const& src, vertex_id const& dest) const;
 
         std::map<VertexT, vertex_id> _vertex_id_of;
-        std::map<vertex_id, vertex> _vertices;
-
+        std::vector<vertex> _vertices;
+        std::vector<vertex_id> _free_ids;
+
+        // The topological order of bidirectional graphs, updated as
+        // edges are added. Removing edges never breaks the order. Slots
+        // of removed vertices are filled with no_vertex. std::nullopt if
+        // the order hasn't been computed yet or the graph has got a
+        // cycle.
+        static constexpr vertex_id const no_vertex = std::numeric_limits<vertex_id>::max();
+        std::optional<std::vector<vertex_id>> mutable _order;
+        // Incremented every time _order or any of the positions changes.
+        std::size_t mutable _order_generation = 0;
+
+        // Only used by unidirectional graphs.
         std::optional<std::vector<vertex_reference_type>> mutable _tsort_cache;
     };
 
@@ -301,12 +465,43 @@ namespace pkgxx {
     }
 #endif
 
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    graph<VertexT, EdgeT, IsBidirectional>::graph(graph const& other)
+        : _vertex_id_of(other._vertex_id_of)
+        , _vertices(other._vertices)
+        , _free_ids(other._free_ids)
+        , _order(other._order) {
+
+        // Vertices point to keys of _vertex_id_of, which are now
+        // different objects. The tsort cache also refers to them, so
+        // don't copy it.
+        for (auto const& [value, id]: _vertex_id_of) {
+            _vertices[id].value = &value;
+        }
+    }
+
     template <typename VertexT, typename EdgeT, bool IsBidirectional>
     typename graph<VertexT, EdgeT, IsBidirectional>::vertex_id
     graph<VertexT, EdgeT, IsBidirectional>::add_vertex_impl(VertexT const& value) {
-        auto&& [it, emplaced] = _vertex_id_of.try_emplace(value, _vertex_id_of.size());
+        auto&& [it, emplaced] = _vertex_id_of.try_emplace(value, 0);
         if (emplaced) {
-            _vertices.try_emplace(it->second, it->first);
+            if (_free_ids.empty()) {
+                it->second = _vertices.size();
+                _vertices.emplace_back(it->first);
+            }
+            else {
+                it->second = _free_ids.back();
+                _free_ids.pop_back();
+                _vertices[it->second].value = &(it->first);
+            }
+            if constexpr (IsBidirectional) {
+                // A vertex without edges can be anywhere in the order.
+                if (_order) {
+                    _vertices[it->second].position = _order->size();
+                    _order->push_back(it->second);
+                    _order_generation++;
+                }
+            }
             _tsort_cache.reset();
         }
         return it->second;
@@ -319,24 +514,39 @@ namespace pkgxx {
         static_assert(IsBidi == IsBidirectional, "can't explicitly specialise");
 
         if (auto id = _vertex_id_of.find(value); id != _vertex_id_of.end()) {
-            auto v = _vertices.find(id->second);
-            assert(v != _vertices.end());
+            vertex_id const vid = id->second;
+            auto& v = _vertices[vid];
 
-            for (vertex_id out_id: v->second.outs) {
-                auto out_v = _vertices.find(out_id);
-                assert(out_v != _vertices.end());
-                out_v->second.ins.erase(id->second);
+            for (auto const& out: v.outs) {
+                erase_edge_to(_vertices[target_of(out)].ins, vid);
             }
-
-            for (vertex_id in_id: v->second.ins) {
-                auto in_v = _vertices.find(in_id);
-                assert(in_v != _vertices.end());
-                in_v->second.outs.erase(id->second);
+            for (vertex_id in_id: v.ins) {
+                erase_edge_to(_vertices[in_id].outs, vid);
             }
 
-            _vertices.erase(id->second);
-            _vertex_id_of.erase(v);
+            // Release the memory too, as the slot may stay unused for a
+            // long time.
+            v.outs  = {};
+            v.ins   = {};
+            v.value = nullptr;
+            _free_ids.push_back(vid);
+
+            _vertex_id_of.erase(id);
             _tsort_cache.reset();
+
+            if (_order) {
+                (*_order)[v.position] = no_vertex;
+                _order_generation++;
+                // Compact the order once half of it is empty slots.
+                if (_order->size() > 2 * _vertex_id_of.size()) {
+                    _order->erase(
+                        std::remove(_order->begin(), _order->end(), no_vertex),
+                        _order->end());
+                    for (std::size_t i = 0; i < _order->size(); i++) {
+                        _vertices[(*_order)[i]].position = i;
+                    }
+                }
+            }
         }
     }
 
@@ -349,16 +559,13 @@ namespace pkgxx {
         vertex_id const src_id  = add_vertex_impl(src);
         vertex_id const dest_id = add_vertex_impl(dest);
 
-        auto sv = _vertices.find(src_id);
-        assert(sv != _vertices.end());
-        if (auto&& [_out, inserted] = sv->second.outs.insert(dest_id); inserted) {
+        if (insert_id(_vertices[src_id].outs, dest_id)) {
             _tsort_cache.reset();
-        }
 
-        if constexpr (IsBidirectional) {
-            auto dv = _vertices.find(dest_id);
-            assert(dv != _vertices.end());
-            dv->second.ins.insert(src_id);
+            if constexpr (IsBidirectional) {
+                insert_id(_vertices[dest_id].ins, src_id);
+                reorder(src_id, dest_id);
+            }
         }
     }
 
@@ -371,32 +578,29 @@ namespace pkgxx {
         vertex_id const src_id  = add_vertex_impl(src);
         vertex_id const dest_id = add_vertex_impl(dest);
 
-        auto sv = _vertices.find(src_id);
-        assert(sv != _vertices.end());
-        auto [out, _inserted] = sv->second.outs.insert_or_assign(dest_id, edge);
-        _tsort_cache.reset();
+        auto& outs = _vertices[src_id].outs;
+        if (auto out = position_of(outs, dest_id); out != outs.end() && out->first == dest_id) {
+            out->second = edge;
+        }
+        else {
+            outs.emplace(out, dest_id, edge);
 
-        if constexpr (IsBidirectional) {
-            auto dv = _vertices.find(dest_id);
-            assert(dv != _vertices.end());
-            dv->second.ins.insert_or_assign(src_id, std::cref(out->second));
+            if constexpr (IsBidirectional) {
+                insert_id(_vertices[dest_id].ins, src_id);
+                reorder(src_id, dest_id);
+            }
         }
+        _tsort_cache.reset();
     }
 
     template <typename VertexT, typename EdgeT, bool IsBidirectional>
     void
     graph<VertexT, EdgeT, IsBidirectional>::remove_edge(VertexT const& src, VertexT const& dest) {
         if (auto src_id = _vertex_id_of.find(src); src_id != _vertex_id_of.end()) {
-            auto src_v = _vertices.find(src_id->second);
-            assert(src_v != _vertices.end());
-
             if (auto dest_id = _vertex_id_of.find(dest); dest_id != _vertex_id_of.end()) {
-                if (src_v->second.outs.erase(dest_id->second)) {
+                if (erase_edge_to(_vertices[src_id->second].outs, dest_id->second)) {
                     if constexpr (IsBidirectional) {
-                        auto dest_v = _vertices.find(dest_id->second);
-                        assert(dest_v != _vertices.end());
-
-                        dest_v->second.ins.erase(src_id->second);
+                        erase_edge_to(_vertices[dest_id->second].ins, src_id->second);
                     }
                     _tsort_cache.reset();
                 }
@@ -411,25 +615,13 @@ namespace pkgxx {
         static_assert(IsBidi == IsBidirectional, "can't explicitly specialise");
 
         if (auto dest_id = _vertex_id_of.find(value); dest_id != _vertex_id_of.end()) {
-            auto dest_v = _vertices.find(dest_id->second);
-            assert(dest_v != _vertices.end());
-
-            if (!dest_v->second.ins.empty()) {
-                for (auto src: dest_v->second.ins) {
-                    vertex_id src_id;
-                    if constexpr (std::is_same_v<EdgeT, void>) {
-                        src_id = src;
-                    }
-                    else {
-                        src_id = src.first;
-                    }
-
-                    auto src_v = _vertices.find(src_id);
-                    assert(src_v != _vertices.end());
+            auto& dest_v = _vertices[dest_id->second];
 
-                    src_v->second.outs.erase(dest_id->second);
+            if (!dest_v.ins.empty()) {
+                for (vertex_id src_id: dest_v.ins) {
+                    erase_edge_to(_vertices[src_id].outs, dest_id->second);
                 }
-                dest_v->second.ins.clear();
+                dest_v.ins.clear();
                 _tsort_cache.reset();
             }
         }
@@ -439,27 +631,15 @@ namespace pkgxx {
     void
     graph<VertexT, EdgeT, IsBidirectional>::remove_out_edges(VertexT const& value) {
         if (auto src_id = _vertex_id_of.find(value); src_id != _vertex_id_of.end()) {
-            auto src_v = _vertices.find(src_id->second);
-            assert(src_v != _vertices.end());
+            auto& src_v = _vertices[src_id->second];
 
-            if (!src_v->second.outs.empty()) {
+            if (!src_v.outs.empty()) {
                 if constexpr (IsBidirectional) {
-                    for (auto dest: src_v->second.outs) {
-                        vertex_id dest_id;
-                        if constexpr (std::is_same_v<EdgeT, void>) {
-                            dest_id = dest;
-                        }
-                        else {
-                            dest_id = dest.first;
-                        }
-
-                        auto dest_v = _vertices.find(dest_id);
-                        assert(dest_v != _vertices.end());
-
-                        dest_v->second.ins.erase(src_id->second);
+                    for (auto const& out: src_v.outs) {
+                        erase_edge_to(_vertices[target_of(out)].ins, src_id->second);
                     }
                 }
-                src_v->second.outs.clear();
+                src_v.outs.clear();
                 _tsort_cache.reset();
             }
         }
@@ -482,24 +662,17 @@ namespace pkgxx {
         >
     graph<VertexT, EdgeT, IsBidirectional>::out_edges(VertexT const& value) const {
         if (auto id = _vertex_id_of.find(value); id != _vertex_id_of.end()) {
-            auto v = _vertices.find(id->second);
-            assert(v != _vertices.end());
+            auto const& v = _vertices[id->second];
 
             typename decltype(out_edges(value))::value_type ret;
             if constexpr (std::is_same_v<EdgeT, void>) {
-                for (auto out_id: v->second.outs) {
-                    auto out_v = _vertices.find(out_id);
-                    assert(out_v != _vertices.end());
-
-                    ret.insert(std::cref(*(out_v->second.value)));
+                for (auto out_id: v.outs) {
+                    ret.insert(std::cref(*(_vertices[out_id].value)));
                 }
             }
             else {
-                for (auto const& [out_id, out_edge]: v->second.outs) {
-                    auto out_v = _vertices.find(out_id);
-                    assert(out_v != _vertices.end());
-
-                    ret.emplace(std::cref(*(out_v->second.value)), std::cref(out_edge));
+                for (auto const& [out_id, out_edge]: v.outs) {
+                    ret.emplace(std::cref(*(_vertices[out_id].value)), std::cref(out_edge));
                 }
             }
             return ret;
@@ -532,27 +705,158 @@ namespace pkgxx {
         static_assert(IsBidi == IsBidirectional, "can't explicitly specialise");
 
         if (auto id = _vertex_id_of.find(value); id != _vertex_id_of.end()) {
-            auto v = _vertices.find(id->second);
-            assert(v != _vertices.end());
+            auto const& v = _vertices[id->second];
 
             typename decltype(in_edges(value))::value_type ret;
-            if constexpr (std::is_same_v<EdgeT, void>) {
-                for (auto in_id: v->second.ins) {
-                    auto in_v = _vertices.find(in_id);
-                    assert(in_v != _vertices.end());
+            for (vertex_id in_id: v.ins) {
+                auto const& in_v = _vertices[in_id];
+                if constexpr (std::is_same_v<EdgeT, void>) {
+                    ret.insert(std::cref(*(in_v.value)));
+                }
+                else {
+                    // The edge is stored in the source vertex.
+                    auto const out = position_of(in_v.outs, id->second);
+                    assert(out != in_v.outs.end() && out->first == id->second);
+                    ret.emplace(std::cref(*(in_v.value)), std::cref(out->second));
+                }
+            }
+            return ret;
+        }
+        else {
+            return std::nullopt;
+        }
+    }
 
-                    ret.insert(std::cref(*(in_v->second.value)));
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    void
+    graph<VertexT, EdgeT, IsBidirectional>::reorder(vertex_id src, vertex_id dest) {
+        // This is the algorithm by Pearce and Kelly (2006), with edges
+        // reversed because "dest" must come before "src" in our
+        // order. Only vertices whose positions are between the two are
+        // ever visited.
+        if (!_order) {
+            return;
+        }
+        std::size_t const lower = _vertices[src].position;
+        std::size_t const upper = _vertices[dest].position;
+        if (upper < lower) {
+            return; // The order is still valid.
+        }
+
+        // Collect vertices that depend on "src" and are placed before
+        // "dest". Reaching "dest" itself means we have a cycle.
+        std::vector<vertex_id> forward, backward, stack;
+        bool has_cycle = src == dest;
+        _vertices[src].marked = true;
+        forward.push_back(src);
+        stack.push_back(src);
+        while (!stack.empty() && !has_cycle) {
+            vertex_id const id = stack.back();
+            stack.pop_back();
+
+            for (vertex_id in_id: _vertices[id].ins) {
+                auto& in_v = _vertices[in_id];
+                if (in_id == dest) {
+                    has_cycle = true;
+                    break;
+                }
+                else if (!in_v.marked && in_v.position < upper) {
+                    in_v.marked = true;
+                    forward.push_back(in_id);
+                    stack.push_back(in_id);
                 }
             }
-            else {
-                for (auto const& [in_id, in_edge]: v->second.ins) {
-                    auto in_v = _vertices.find(in_id);
-                    assert(in_v != _vertices.end());
+        }
 
-                    ret.emplace(std::cref(*(in_v->second.value)), in_edge);
+        if (!has_cycle) {
+            // Collect vertices "dest" depends on that are placed after
+            // "src". They are disjoint with the forward set, or we would
+            // have found a cycle.
+            stack.clear();
+            _vertices[dest].marked = true;
+            backward.push_back(dest);
+            stack.push_back(dest);
+            while (!stack.empty()) {
+                vertex_id const id = stack.back();
+                stack.pop_back();
+
+                for (auto const& out: _vertices[id].outs) {
+                    vertex_id const out_id = target_of(out);
+                    auto& out_v = _vertices[out_id];
+                    if (!out_v.marked && out_v.position > lower) {
+                        out_v.marked = true;
+                        backward.push_back(out_id);
+                        stack.push_back(out_id);
+                    }
                 }
             }
-            return ret;
+
+            // Move the backward set before the forward set, reusing the
+            // positions they have occupied. Vertices in each set keep
+            // their relative order.
+            auto const by_position =
+                [&](vertex_id a, vertex_id b) {
+                    return _vertices[a].position < _vertices[b].position;
+                };
+            std::sort(backward.begin(), backward.end(), by_position);
+            std::sort(forward.begin(), forward.end(), by_position);
+
+            std::vector<std::size_t> positions;
+            positions.reserve(backward.size() + forward.size());
+            for (vertex_id id: backward) {
+                positions.push_back(_vertices[id].position);
+            }
+            for (vertex_id id: forward) {
+                positions.push_back(_vertices[id].position);
+            }
+            std::sort(positions.begin(), positions.end());
+
+            auto position = positions.begin();
+            for (auto const* set: {&backward, &forward}) {
+                for (vertex_id id: *set) {
+                    _vertices[id].position = *position;
+                    (*_order)[*position] = id;
+                    position++;
+                }
+            }
+            _order_generation++;
+        }
+
+        for (auto const* set: {&backward, &forward}) {
+            for (vertex_id id: *set) {
+                _vertices[id].marked = false;
+            }
+        }
+
+        if (has_cycle) {
+            // tsort() will find the cycle and report it.
+            _order.reset();
+            _order_generation++;
+        }
+    }
+
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    void
+    graph<VertexT, EdgeT, IsBidirectional>::establish_order() const {
+        if (!_order) {
+            auto order = tsort_impl();
+            for (std::size_t i = 0; i < order.size(); i++) {
+                _vertices[order[i]].position = i;
+            }
+            _order = std::move(order);
+            _order_generation++;
+        }
+    }
+
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    template <bool IsBidi>
+    std::enable_if_t<IsBidi, std::optional<std::size_t>>
+    graph<VertexT, EdgeT, IsBidirectional>::tsort_position(VertexT const& value) const {
+        static_assert(IsBidi == IsBidirectional, "can't explicitly specialise");
+
+        if (auto id = _vertex_id_of.find(value); id != _vertex_id_of.end()) {
+            establish_order();
+            return _vertices[id->second].position;
         }
         else {
             return std::nullopt;
@@ -564,86 +868,71 @@ namespace pkgxx {
         typename graph<VertexT, EdgeT, IsBidirectional>::vertex_reference_type
         >
     graph<VertexT, EdgeT, IsBidirectional>::tsort(bool cache) const {
-        if (cache && _tsort_cache) {
-            return *_tsort_cache;
-        }
-
-        std::map<vertex_id, colour> visited;
         std::vector<vertex_reference_type> tsorted;
+        tsorted.reserve(_vertex_id_of.size());
 
-        for (auto const& [id, _v]: _vertices) {
-            visited[id] = colour::white;
+        if (cache) {
+            if constexpr (IsBidirectional) {
+                establish_order();
+                for (vertex_id id: *_order) {
+                    if (id != no_vertex) {
+                        tsorted.push_back(std::cref(*(_vertices[id].value)));
+                    }
+                }
+                return tsorted;
+            }
+            else if (_tsort_cache) {
+                return *_tsort_cache;
+            }
         }
 
-        auto const go =
-            [&](auto const& self, vertex_id id, vertex const& v) -> void {
-                auto c = visited.find(id);
-                assert(c != visited.end());
+        for (vertex_id id: tsort_impl()) {
+            tsorted.push_back(std::cref(*(_vertices[id].value)));
+        }
+        if constexpr (!IsBidirectional) {
+            if (cache) {
+                _tsort_cache = tsorted;
+            }
+        }
+        return tsorted;
+    }
 
-                if (c->second == colour::white) {
-                    c->second = colour::grey;
-                }
-                else {
-                    return; // Already visited.
-                }
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    std::vector<
+        typename graph<VertexT, EdgeT, IsBidirectional>::vertex_id
+        >
+    graph<VertexT, EdgeT, IsBidirectional>::tsort_impl() const {
+        std::vector<colour> visited(_vertices.size(), colour::white);
+        std::vector<vertex_id> tsorted;
+        tsorted.reserve(_vertex_id_of.size());
+
+        // This is a DFS with an explicit stack, so that deep graphs
+        // don't exhaust the call stack. Each frame has a vertex and the
+        // index of its next out-edge to follow.
+        std::vector<std::pair<vertex_id, std::size_t>> stack;
+        for (vertex_id root = 0; root < _vertices.size(); root++) {
+            if (!_vertices[root].value || visited[root] != colour::white) {
+                continue;
+            }
 
-                for (auto const& out: v.outs) {
-                    vertex_id out_id;
-                    if constexpr (std::is_same_v<EdgeT, void>) {
-                        out_id = out;
-                    }
-                    else {
-                        out_id = out.first;
-                    }
-                    auto out_c = visited.find(out_id);
-                    assert(out_c != visited.end());
+            visited[root] = colour::grey;
+            stack.emplace_back(root, 0);
+            while (!stack.empty()) {
+                auto& [id, next] = stack.back();
+                auto const& v = _vertices[id];
 
-                    switch (out_c->second) {
+                if (next < v.outs.size()) {
+                    auto const& out = v.outs[next++];
+                    vertex_id const out_id = target_of(out);
+
+                    switch (visited[out_id]) {
                     case colour::white:
-                        {
-                            auto out_v = _vertices.find(out_id);
-                            assert(out_v != _vertices.end());
-                            // This is a recursive DFS. Maybe we should
-                            // turn this into a non-recursive one?
-                            self(self, out_id, out_v->second);
-                        }
+                        visited[out_id] = colour::grey;
+                        stack.emplace_back(out_id, 0); // This invalidates "id".
                         break;
 
                     case colour::grey:
-                        // The edge "id" -> "out_id" forms a cycle, which
-                        // means there must be a path going from "out_id"
-                        // all the way back to "id". Find it using BFS and
-                        // raise an exception.
-                        if constexpr (std::is_same_v<EdgeT, void>) {
-                            std::vector<VertexT> vertices;
-                            auto const path = shortest_path_impl(out_id, id).value();
-                            for (auto const& value: path) {
-                                vertices.push_back(value);
-                            }
-                            auto out_v = _vertices.find(out_id);
-                            assert(out_v != _vertices.end());
-                            vertices.push_back(*(out_v->second.value));
-                            throw not_a_dag<VertexT, void>(std::move(vertices));
-                        }
-                        else {
-                            std::vector<VertexT> vertices;
-                            std::vector<EdgeT> edges;
-                            auto const path = shortest_path_impl(out_id, id).value();
-                            for (auto const& value: path.first) {
-                                vertices.push_back(value);
-                            }
-                            for (auto const& edge: path.second) {
-                                edges.push_back(edge);
-                            }
-                            if (id != out_id) {
-                                auto out_v = _vertices.find(out_id);
-                                assert(out_v != _vertices.end());
-                                vertices.push_back(*(out_v->second.value));
-                                edges.push_back(out.second);
-                            }
-                            throw not_a_dag<VertexT, EdgeT>(std::move(vertices), std::move(edges));
-                        }
-                        break;
+                        throw_cycle(id, out);
 
                     case colour::black:
                         // The node has already been visited but this is
@@ -651,21 +940,156 @@ namespace pkgxx {
                         break;
                     }
                 }
-
-                if (c->second == colour::grey) {
-                    tsorted.push_back(std::cref(*(v.value)));
+                else {
+                    // All of its out-edges have been visited.
+                    tsorted.push_back(id);
                     visited[id] = colour::black;
+                    stack.pop_back();
+                }
+            }
+        }
+        return tsorted;
+    }
+
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    void
+    graph<VertexT, EdgeT, IsBidirectional>::throw_cycle(vertex_id id, out_edge_type const& out) const {
+        // The edge "id" -> "out_id" forms a cycle, which means there
+        // must be a path going from "out_id" all the way back to
+        // "id". Find it using BFS and raise an exception.
+        vertex_id const out_id = target_of(out);
+        if constexpr (std::is_same_v<EdgeT, void>) {
+            std::vector<VertexT> vertices;
+            auto const path = shortest_path_impl(out_id, id).value();
+            for (auto const& value: path) {
+                vertices.push_back(value);
+            }
+            vertices.push_back(*(_vertices[out_id].value));
+            throw not_a_dag<VertexT, void>(std::move(vertices));
+        }
+        else {
+            std::vector<VertexT> vertices;
+            std::vector<EdgeT> edges;
+            auto const path = shortest_path_impl(out_id, id).value();
+            for (auto const& value: path.first) {
+                vertices.push_back(value);
+            }
+            for (auto const& edge: path.second) {
+                edges.push_back(edge);
+            }
+            if (id != out_id) {
+                vertices.push_back(*(_vertices[out_id].value));
+                edges.push_back(out.second);
+            }
+            throw not_a_dag<VertexT, EdgeT>(std::move(vertices), std::move(edges));
+        }
+    }
+
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    std::vector<
+        std::vector<
+            typename graph<VertexT, EdgeT, IsBidirectional>::vertex_reference_type
+            >
+        >
+    graph<VertexT, EdgeT, IsBidirectional>::tsort_levels() const {
+        std::vector<std::vector<vertex_reference_type>> levels;
+        for (auto const& level_ids: tsort_levels_impl()) {
+            auto& level = levels.emplace_back();
+            level.reserve(level_ids.size());
+            for (vertex_id id: level_ids) {
+                level.push_back(std::cref(*(_vertices[id].value)));
+            }
+            // Vertex IDs depend on the order in which vertices were
+            // added. Don't let it leak.
+            std::sort(level.begin(), level.end(), std::less<VertexT>());
+        }
+        return levels;
+    }
+
+    template <typename VertexT, typename EdgeT, bool IsBidirectional>
+    std::vector<
+        std::vector<
+            typename graph<VertexT, EdgeT, IsBidirectional>::vertex_id
+            >
+        >
+    graph<VertexT, EdgeT, IsBidirectional>::tsort_levels_impl() const {
+        // This is Kahn's algorithm processing a level at a time. The
+        // number of out-edges of each vertex whose target hasn't been
+        // leveled yet:
+        std::vector<std::size_t> pending(_vertices.size(), 0);
+        std::vector<std::vector<vertex_id>> levels;
+        std::vector<vertex_id> current;
+
+        // We need in-edges. Unidirectional graphs don't have them so
+        // compute them here.
+        std::vector<std::vector<vertex_id>> reversed;
+        if constexpr (!IsBidirectional) {
+            reversed.resize(_vertices.size());
+        }
+        for (vertex_id id = 0; id < _vertices.size(); id++) {
+            auto const& v = _vertices[id];
+            if (v.value) {
+                pending[id] = v.outs.size();
+                if (v.outs.empty()) {
+                    current.push_back(id);
+                }
+                if constexpr (!IsBidirectional) {
+                    for (auto const& out: v.outs) {
+                        reversed[target_of(out)].push_back(id);
+                    }
+                }
+            }
+        }
+        auto const& ins_of =
+            [&](vertex_id id) -> std::vector<vertex_id> const& {
+                if constexpr (IsBidirectional) {
+                    return _vertices[id].ins;
+                }
+                else {
+                    return reversed[id];
                 }
             };
 
-        for (auto const& [id, v]: _vertices) {
-            go(go, id, v);
+        std::size_t num_leveled = 0;
+        while (!current.empty()) {
+            std::vector<vertex_id> next;
+            for (vertex_id id: current) {
+                for (vertex_id in_id: ins_of(id)) {
+                    if (--pending[in_id] == 0) {
+                        next.push_back(in_id);
+                    }
+                }
+            }
+            num_leveled += current.size();
+            levels.push_back(std::move(current));
+            current = std::move(next);
         }
 
-        if (cache) {
-            _tsort_cache = tsorted;
+        if (num_leveled < _vertex_id_of.size()) {
+            // Every vertex left has an out-edge to another vertex left,
+            // so walking along such edges will eventually hit a vertex
+            // we have already walked through.
+            vertex_id id = 0;
+            while (!_vertices[id].value || pending[id] == 0) {
+                id++;
+            }
+            std::vector<bool> walked(_vertices.size(), false);
+            while (true) {
+                walked[id] = true;
+                auto const& outs = _vertices[id].outs;
+                auto const out = std::find_if(
+                    outs.begin(), outs.end(),
+                    [&](auto const& out) {
+                        return pending[target_of(out)] > 0;
+                    });
+                assert(out != outs.end());
+                if (walked[target_of(*out)]) {
+                    throw_cycle(id, *out);
+                }
+                id = target_of(*out);
+            }
         }
-        return tsorted;
+        return levels;
     }
 
     template <typename VertexT, typename EdgeT, bool IsBidirectional>
@@ -703,44 +1127,37 @@ namespace pkgxx {
                 >
             >
     graph<VertexT, EdgeT, IsBidirectional>::shortest_path_impl(vertex_id const& src, vertex_id const& dest) const {
-        std::map<vertex_id, colour> visited;
-        std::map<
-            vertex_id,
-            std::conditional_t<
-                std::is_same_v<EdgeT, void>,
-                vertex_id,
-                std::pair<
+        std::vector<colour> visited(_vertices.size(), colour::white);
+        // The predecessor of each vertex we have visited, and the edge
+        // from it. The source has none.
+        std::vector<
+            std::optional<
+                std::conditional_t<
+                    std::is_same_v<EdgeT, void>,
                     vertex_id,
-                    typename graph<VertexT, EdgeT, IsBidirectional>::edge_reference_type
+                    std::pair<
+                        vertex_id,
+                        typename graph<VertexT, EdgeT, IsBidirectional>::edge_reference_type
+                        >
                     >
                 >
-            > predecessor_of;
+            > predecessor_of(_vertices.size());
         std::deque<vertex_id> queue;
 
-        for (auto const& [id, _v]: _vertices) {
-            visited[id] = (id == src) ? colour::grey : colour::white;
-        }
+        visited[src] = colour::grey;
 
         auto const& go =
             [&](vertex_id id, vertex const& v) -> bool {
                 for (auto const& out: v.outs) {
-                    vertex_id out_id;
-                    if constexpr (std::is_same_v<EdgeT, void>) {
-                        out_id = out;
-                    }
-                    else {
-                        out_id = out.first;
-                    }
+                    vertex_id const out_id = target_of(out);
 
-                    auto c = visited.find(out_id);
-                    assert(c != visited.end());
-                    if (c->second == colour::white) {
-                        c->second = colour::grey;
+                    if (visited[out_id] == colour::white) {
+                        visited[out_id] = colour::grey;
                         if constexpr (std::is_same_v<EdgeT, void>) {
                             predecessor_of[out_id] = id;
                         }
                         else {
-                            predecessor_of[out_id] = std::make_pair(id, out.second);
+                            predecessor_of[out_id] = std::make_pair(id, std::cref(out.second));
                         }
                         queue.push_back(out_id);
                     }
@@ -759,10 +1176,7 @@ namespace pkgxx {
             vertex_id id = queue.front();
             queue.pop_front();
 
-            auto it = _vertices.find(id);
-            assert(it != _vertices.end());
-
-            if (go(id, it->second)) {
+            if (go(id, _vertices[id])) {
                 // We found the final destination and we have a predecessor
                 // recorded for each vertex we have visited. Reconstruct a
                 // path starting from "src" to "dest" by visiting
@@ -770,34 +1184,31 @@ namespace pkgxx {
                 typename decltype(shortest_path_impl(src, dest))::value_type path;
                 vertex_id id = dest;
                 while (true) {
-                    auto pred = predecessor_of.find(id);
-                    if (pred == predecessor_of.end()) {
+                    auto const& pred = predecessor_of[id];
+                    if (!pred) {
                         // There is no predecessor for "src".
                         assert(id == src);
                         break;
                     }
 
-                    auto v = _vertices.find(id);
-                    assert(v != _vertices.end());
-
+                    auto const& v = _vertices[id];
                     if constexpr (std::is_same_v<EdgeT, void>) {
-                        path.push_front(std::cref(*(v->second.value)));
-                        id = pred->second;
+                        path.push_front(std::cref(*(v.value)));
+                        id = *pred;
                     }
                     else {
-                        path.first.push_front(std::cref(*(v->second.value)));
-                        path.second.push_front(pred->second.second);
-                        id = pred->second.first;
+                        path.first.push_front(std::cref(*(v.value)));
+                        path.second.push_front(pred->second);
+                        id = pred->first;
                     }
                 }
-                auto src_v = _vertices.find(src);
-                assert(src_v != _vertices.end());
+                auto const& src_v = _vertices[src];
                 if constexpr (std::is_same_v<EdgeT, void>) {
-                    path.push_front(std::cref(*(src_v->second.value)));
+                    path.push_front(std::cref(*(src_v.value)));
                 }
                 else {
-                    path.first.push_front(std::cref(*(src_v->second.value)));
-                    assert(path.second.size() == path.first.size() + 1);
+                    path.first.push_front(std::cref(*(src_v.value)));
+                    assert(path.first.size() == path.second.size() + 1);
                 }
                 return path;
             }
@@ -1,8 +1,11 @@
+#include <algorithm>
+
 #include "gzipstream.hxx"
 
 namespace pkgxx {
-    gunzipstreambuf::gunzipstreambuf(std::streambuf* base)
+    gunzipstreambuf::gunzipstreambuf(std::streambuf* base, std::size_t buf_size)
         : _base(base)
+        , _buf_size(buf_size)
         , _inflate_eof(false)
         , _inflate_done(false) {
 
@@ -26,8 +29,8 @@ namespace pkgxx {
         if (eback() == nullptr) {
             // An underflow has happened because we haven't allocated
             // buffers yet.
-            _inflate_in  = buffer_t();
-            _inflate_out = buffer_t();
+            _inflate_in  = buffer_t(_buf_size);
+            _inflate_out = buffer_t(_buf_size);
         }
 
         while (!_inflate_done) {
@@ -37,25 +40,19 @@ namespace pkgxx {
                 _inflate.next_in  = reinterpret_cast<Bytef*>(_inflate_in->data());
                 _inflate.avail_in = 0;
 
-                if (auto avail = _base->in_avail(); avail > 0) {
+                // Block until the base streambuf has something, and then
+                // take whatever it has buffered in one go.
+                if (traits_type::eq_int_type(_base->sgetc(), traits_type::eof())) {
+                    _inflate_eof = true;
+                }
+                else {
                     std::streamsize const n_read = _base->sgetn(
                         _inflate_in->data(),
-                        static_cast<std::streamsize>(_inflate_in->size()));
+                        std::min(
+                            _base->in_avail(),
+                            static_cast<std::streamsize>(_inflate_in->size())));
                     _inflate.avail_in = static_cast<uInt>(n_read);
                 }
-                else {
-                    // The base streambuf can't provide us any data without
-                    // blocking. Allow it to block.
-                    int_type const ch = _base->sbumpc();
-                    if (traits_type::eq_int_type(ch, traits_type::eof())) {
-                        // But it got EOF.
-                        _inflate_eof = true;
-                    }
-                    else {
-                        (*_inflate_in)[0] = traits_type::to_char_type(ch);
-                        _inflate.avail_in = 1;
-                    }
-                }
             }
 
             _inflate.next_out  = reinterpret_cast<Bytef*>(_inflate_out->data());
@@ -95,8 +92,16 @@ namespace pkgxx {
                     return traits_type::eof();
                 }
 
+            case Z_BUF_ERROR:
+                if (_inflate_eof) {
+                    // zlib needs more input but there is no more.
+                    throw std::runtime_error("Unexpected end of gzip stream");
+                }
+                continue;
+
             default:
-                throw std::runtime_error(_inflate.msg);
+                throw std::runtime_error(
+                    _inflate.msg ? _inflate.msg : "Failed to inflate gzip stream");
             }
         }
 
@@ -122,4 +127,101 @@ namespace pkgxx {
         }
     }
 #endif
+
+    gzipstreambuf::gzipstreambuf(std::streambuf* base, int level, std::size_t buf_size)
+        : _base(base)
+        , _deflate_done(false)
+        , _deflate_in(buf_size)
+        , _deflate_out(buf_size) {
+
+        _deflate.next_in  = nullptr;
+        _deflate.avail_in = 0;
+        _deflate.zalloc   = nullptr;
+        _deflate.zfree    = nullptr;
+        _deflate.opaque   = nullptr;
+        // 15 + 16: the maximum window size with a gzip header.
+        if (deflateInit2(&_deflate, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error(_deflate.msg);
+        }
+        setp(_deflate_in.data(), _deflate_in.data() + _deflate_in.size());
+    }
+
+    gzipstreambuf::~gzipstreambuf() {
+        try {
+            finish();
+        }
+        catch (...) {
+            // Destructors must not throw.
+        }
+        deflateEnd(&_deflate);
+    }
+
+    void
+    gzipstreambuf::finish() {
+        if (!_deflate_done) {
+            deflate_pending(Z_FINISH);
+            _deflate_done = true;
+            setp(nullptr, nullptr);
+            _base->pubsync();
+        }
+    }
+
+    void
+    gzipstreambuf::deflate_pending(int flush) {
+        _deflate.next_in  = reinterpret_cast<Bytef*>(pbase());
+        _deflate.avail_in = static_cast<uInt>(pptr() - pbase());
+
+        while (true) {
+            _deflate.next_out  = reinterpret_cast<Bytef*>(_deflate_out.data());
+            _deflate.avail_out = static_cast<uInt>(_deflate_out.size());
+
+            int const ret = deflate(&_deflate, flush);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                throw std::runtime_error(_deflate.msg);
+            }
+
+            auto const n_out = static_cast<std::streamsize>(_deflate_out.size() - _deflate.avail_out);
+            if (n_out > 0 && _base->sputn(_deflate_out.data(), n_out) != n_out) {
+                throw std::runtime_error("Failed to write compressed data");
+            }
+
+            if (flush == Z_FINISH) {
+                if (ret == Z_STREAM_END) {
+                    break;
+                }
+            }
+            else if (_deflate.avail_in == 0 && _deflate.avail_out > 0) {
+                // zlib consumed everything and has nothing more to say.
+                break;
+            }
+        }
+
+        setp(_deflate_in.data(), _deflate_in.data() + _deflate_in.size());
+    }
+
+#if !defined(DOXYGEN)
+    gzipstreambuf::int_type
+    gzipstreambuf::overflow(int_type ch) {
+        if (_deflate_done) {
+            return traits_type::eof();
+        }
+
+        deflate_pending(Z_NO_FLUSH);
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+#endif
+
+#if !defined(DOXYGEN)
+    int
+    gzipstreambuf::sync() {
+        if (!_deflate_done) {
+            deflate_pending(Z_SYNC_FLUSH);
+        }
+        return _base->pubsync();
+    }
+#endif
 }
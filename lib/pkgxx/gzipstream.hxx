@@ -1,20 +1,26 @@
 #pragma once
 
-#include <array>
+#include <cstddef>
 #include <istream>
 #include <memory>
 #include <optional>
+#include <ostream>
 #include <streambuf>
+#include <vector>
 #include <zlib.h>
 
 namespace pkgxx {
-    /** A stream buffer that works with gzipped data. Currently only
-     * supports reading operations.
+    /** A stream buffer that reads gzipped data. See \ref gzipstreambuf
+     * for writing.
      */
     struct gunzipstreambuf: public std::streambuf {
+        /// The default size of the compressed and decompressed buffers.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
         /** Construct a stream buffer reading gzipped data from another
          * stream buffer. */
-        gunzipstreambuf(std::streambuf* base);
+        gunzipstreambuf(std::streambuf* base,
+                        std::size_t buf_size = default_buf_size);
         virtual ~gunzipstreambuf();
 
     protected:
@@ -27,10 +33,10 @@ namespace pkgxx {
 #endif
 
     private:
-        static constexpr int const buf_size = 1024;
-        using buffer_t = std::array<char_type, buf_size>;
+        using buffer_t = std::vector<char_type>;
 
         std::streambuf* _base;
+        std::size_t _buf_size;
 
         z_stream_s _inflate;
         bool _inflate_eof;  // Got EOF from _base.
@@ -45,11 +51,12 @@ namespace pkgxx {
         /** Construct an input stream that reads gzip-compressed data from
          * an another istream.
          */
-        gunzipistream(std::istream& base)
+        gunzipistream(std::istream& base,
+                      std::size_t buf_size = gunzipstreambuf::default_buf_size)
             : std::istream(nullptr) {
 
             if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
-                _buf = std::make_unique<gunzipstreambuf>(base_buf);
+                _buf = std::make_unique<gunzipstreambuf>(base_buf, buf_size);
                 rdbuf(_buf.get());
             }
         }
@@ -67,4 +74,82 @@ namespace pkgxx {
     private:
         std::unique_ptr<gunzipstreambuf> _buf;
     };
+
+    /** A stream buffer that writes gzipped data to another stream
+     * buffer.
+     */
+    struct gzipstreambuf: public std::streambuf {
+        /// The default size of the uncompressed and compressed buffers.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
+        /** Construct a stream buffer writing gzipped data to another
+         * stream buffer. */
+        gzipstreambuf(std::streambuf* base,
+                      int level = Z_DEFAULT_COMPRESSION,
+                      std::size_t buf_size = default_buf_size);
+
+        /** Destroy the stream buffer. Calls \ref finish() if it hasn't
+         * been called yet, but any errors are silently ignored.
+         */
+        virtual ~gzipstreambuf();
+
+        /** Compress any buffered data and write the gzip trailer to the
+         * base stream buffer. No more data can be written after calling
+         * this.
+         */
+        void
+        finish();
+
+    protected:
+#if !defined(DOXYGEN)
+        virtual int_type
+        overflow(int_type ch = traits_type::eof()) override;
+
+        virtual int
+        sync() override;
+#endif
+
+    private:
+        // Feed the put area to zlib and write everything it produces.
+        void
+        deflate_pending(int flush);
+
+        using buffer_t = std::vector<char_type>;
+
+        std::streambuf* _base;
+
+        z_stream_s _deflate;
+        bool _deflate_done; // finish() has been called.
+        buffer_t _deflate_in;
+        buffer_t _deflate_out;
+    };
+
+    /** An output stream that writes gzipped data.
+     */
+    struct gzipostream: public std::ostream {
+        /** Construct an output stream that writes gzip-compressed data to
+         * an another ostream.
+         */
+        gzipostream(std::ostream& base, int level = Z_DEFAULT_COMPRESSION)
+            : std::ostream(nullptr) {
+
+            if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
+                _buf = std::make_unique<gzipstreambuf>(base_buf, level);
+                rdbuf(_buf.get());
+            }
+        }
+
+        /** Finish writing the gzip stream. See \ref
+         * gzipstreambuf::finish().
+         */
+        void
+        close() {
+            if (_buf) {
+                _buf->finish();
+            }
+        }
+
+    private:
+        std::unique_ptr<gzipstreambuf> _buf;
+    };
 }
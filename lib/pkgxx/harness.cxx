@@ -8,8 +8,32 @@
 
 #include "harness.hxx"
 #include "spawn.hxx"
+#include "string_algo.hxx"
 
 namespace pkgxx {
+    std::vector<std::string>
+    command_argv(std::string const& cmd) {
+        // Whitespace is fine as it only separates words. An equal sign
+        // may be a variable assignment.
+        static auto const specials = "\n~`#$&*()\\|[];'\"<>?={}!";
+
+        if (cmd.find_first_of(specials) == std::string::npos) {
+            std::vector<std::string> argv;
+            for (auto const& word: words(cmd)) {
+                argv.emplace_back(word);
+            }
+            if (!argv.empty()) {
+                return argv;
+            }
+        }
+        return {
+            shell,
+            "-c", "exec " + cmd + " \"$@\"",
+            shell // This will be $0 of the shell, and the rest of argv
+                  // will be the arguments to the command.
+        };
+    }
+
     harness::harness(
         int,
         std::filesystem::path const& cmd,
@@ -19,15 +43,25 @@ namespace pkgxx {
         dtor_action da,
         fd_action stdin_action,
         fd_action stdout_action,
-        fd_action stderr_action)
+        fd_action stderr_action,
+        std::optional<bool> own_pgroup)
         : _da(da)
+        , _token(cancellation_token::current())
         , _cmd(cmd)
         , _argv(argv)
         , _cwd(cwd)
-        , _env(cenviron()) {
+        , _env(cenviron())
+        , _own_pgroup(own_pgroup.value_or(stdin_action  != fd_action::inherit &&
+                                          stdout_action != fd_action::inherit)) {
 
         env_mod(_env);
 
+        // Don't bother spawning a process that would be killed right
+        // away.
+        if (_token.is_cancelled()) {
+            throw operation_cancelled();
+        }
+
         auto const stdin_fds  = stdin_action  == fd_action::pipe
             ? std::make_optional(cpipe(true))
             : std::nullopt;
@@ -41,6 +75,10 @@ namespace pkgxx {
         spawnp s(cmd, argv);
         s.environ(_env);
 
+        if (_own_pgroup) {
+            s.new_process_group();
+        }
+
         if (cwd) {
             s.chdir(*cwd);
         }
@@ -118,10 +156,26 @@ namespace pkgxx {
             _stderr.emplace((*stderr_fds)[0]);
             _stderr->exceptions(std::ios_base::badbit);
         }
+
+        try {
+            _token.register_process(*_pid, _own_pgroup);
+        }
+        catch (operation_cancelled&) {
+            // The token was cancelled while we were spawning the
+            // process. It has already been signalled, so reap it before
+            // giving up.
+            _stdin.reset();
+            _stdout.reset();
+            _stderr.reset();
+            wait();
+            throw;
+        }
     }
 
     harness::harness(harness&& other)
         : _da(other._da)
+        , _token(std::move(other._token))
+        , _own_pgroup(other._own_pgroup)
         , _pid(std::move(other._pid))
         , _stdin(std::move(other._stdin))
         , _stdout(std::move(other._stdout))
@@ -180,6 +234,22 @@ namespace pkgxx {
         assert(_pid);
 
         if (!_status) {
+            // Wait for the process to terminate without reaping it, and
+            // unregister it from the cancellation token. Only then can
+            // we reap it, as its pid may be reused afterwards.
+            while (true) {
+                siginfo_t info;
+                if (waitid(P_PID, *_pid, &info, WEXITED | WNOWAIT) == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::system_error(
+                        errno, std::generic_category(), "waitid");
+                }
+                break;
+            }
+            _token.unregister_process(*_pid, _own_pgroup);
+
             while (true) {
                 int cstatus;
                 if (waitpid(*_pid, &cstatus, 0) == -1) {
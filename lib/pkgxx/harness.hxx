@@ -24,6 +24,7 @@
 #include <named-parameters.hpp>
 #pragma GCC diagnostic pop
 
+#include <pkgxx/cancellation.hxx>
 #include <pkgxx/fdstream.hxx>
 
 namespace pkgxx {
@@ -65,11 +66,35 @@ namespace pkgxx {
         return ss.str();
     }
 
+    /** Turn a command given as a string, such as \c PKG_INFO, into the
+     * beginning of an argv that further arguments can be appended to. A
+     * command consisting only of plain words is split into them and run
+     * directly. Anything else is run by the shell, which costs an extra
+     * exec.
+     */
+    std::vector<std::string>
+    command_argv(std::string const& cmd);
+
     // I'm not comfortable with bringing it in this scope, but what else
     // can we do?
     using namespace na::literals;
 
     /** RAII way of spawning child processes.
+     *
+     * A spawned process is registered to the current \ref
+     * cancellation_token of the calling thread, and it receives \c
+     * SIGTERM when the token is cancelled. The constructor throws \ref
+     * operation_cancelled instead of spawning a process if the token has
+     * already been cancelled.
+     *
+     * A process whose stdin and stdout are both not inherited is put in a
+     * process group of its own, and the whole group receives \c SIGTERM
+     * so that its descendants are terminated too. Such a process doesn't
+     * receive signals from the terminal, such as \c SIGINT. It's expected
+     * to terminate via \c SIGPIPE or EOF once we are gone. Processes that
+     * may interact with the terminal stay in our process group. Commands
+     * that may open \c /dev/tty by themselves, such as \c SU_CMD asking
+     * for a password, need to say so by passing \c own_pgroup = false.
      */
     struct harness {
         /** An enum class to specify what to do upon destructing a
@@ -126,7 +151,8 @@ namespace pkgxx {
                 na::get("dtor_action"_na   = dtor_action::wait_success, std::forward<Args>(args)...),
                 na::get("stdin_action"_na  = fd_action::pipe          , std::forward<Args>(args)...),
                 na::get("stdout_action"_na = fd_action::pipe          , std::forward<Args>(args)...),
-                na::get("stderr_action"_na = fd_action::inherit       , std::forward<Args>(args)...)) {}
+                na::get("stderr_action"_na = fd_action::inherit       , std::forward<Args>(args)...),
+                na::get("own_pgroup"_na    = std::optional<bool>()    , std::forward<Args>(args)...)) {}
 
     private:
         harness(
@@ -138,7 +164,8 @@ namespace pkgxx {
             dtor_action da,
             fd_action stdin_action,
             fd_action stdout_action,
-            fd_action stderr_action);
+            fd_action stderr_action,
+            std::optional<bool> own_pgroup);
 
     public:
         harness(harness const&) = delete;
@@ -209,6 +236,7 @@ namespace pkgxx {
 
     private:
         dtor_action _da;
+        cancellation_token _token;
 
         // In
         std::filesystem::path _cmd;
@@ -217,6 +245,7 @@ namespace pkgxx {
         std::map<std::string, std::string> _env;
 
         // Out
+        bool _own_pgroup;
         std::optional<pid_t> _pid;
         std::optional<fdostream> _stdin;
         std::optional<fdistream> _stdout;
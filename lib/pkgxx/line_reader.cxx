@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+#include "line_reader.hxx"
+
+namespace pkgxx {
+    line_reader::line_reader(std::streambuf* in, std::size_t buf_size)
+        : _sb(in)
+        , _fd(-1)
+        , _buf(std::max<std::size_t>(buf_size, 1))
+        , _begin(0)
+        , _end(0)
+        , _mark(no_mark)
+        , _eof(in == nullptr) {}
+
+    line_reader::line_reader(int fd, std::size_t buf_size)
+        : _sb(nullptr)
+        , _fd(fd)
+        , _buf(std::max<std::size_t>(buf_size, 1))
+        , _begin(0)
+        , _end(0)
+        , _mark(no_mark)
+        , _eof(fd < 0) {}
+
+    std::optional<std::string_view>
+    line_reader::next_line() {
+        // Offset from _begin where we haven't searched for a newline
+        // yet. It survives fill() moving data around.
+        std::size_t scanned = 0;
+        while (true) {
+            char const* const first = _buf.data() + _begin;
+            if (auto const* nl = static_cast<char const*>(
+                    std::memchr(first + scanned, '\n', _end - _begin - scanned)); nl) {
+                std::string_view const line(first, static_cast<std::size_t>(nl - first));
+                _begin += line.size() + 1;
+                return line;
+            }
+            scanned = _end - _begin;
+
+            if (_eof || !fill()) {
+                if (_begin < _end) {
+                    // The last line lacks a newline.
+                    std::string_view const line(_buf.data() + _begin, _end - _begin);
+                    _begin = _end;
+                    return line;
+                }
+                else {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+
+    bool
+    line_reader::next_record(std::vector<std::string_view>& lines) {
+        lines.clear();
+        _record.clear();
+        _mark = _begin;
+        while (auto const line = next_line()) {
+            if (line->empty()) {
+                if (_record.empty()) {
+                    // Skip empty lines preceding a record.
+                    _mark = _begin;
+                    continue;
+                }
+                else {
+                    break;
+                }
+            }
+            _record.emplace_back(
+                static_cast<std::size_t>(line->data() - _buf.data()) - _mark,
+                line->size());
+        }
+
+        // The buffer may have moved while reading the record, which is
+        // why we didn't keep views.
+        for (auto const& [offset, size]: _record) {
+            lines.emplace_back(_buf.data() + _mark + offset, size);
+        }
+        _mark = no_mark;
+        return !lines.empty();
+    }
+
+    bool
+    line_reader::fill() {
+        // Discard consumed data unless it belongs to the current record.
+        if (std::size_t const keep = std::min(_begin, _mark); keep > 0) {
+            std::memmove(_buf.data(), _buf.data() + keep, _end - keep);
+            _begin -= keep;
+            _end   -= keep;
+            if (_mark != no_mark) {
+                _mark -= keep;
+            }
+        }
+        if (_end == _buf.size()) {
+            // A line or a record is larger than the buffer.
+            _buf.resize(_buf.size() * 2);
+        }
+
+        std::size_t const room = _buf.size() - _end;
+        if (_sb) {
+            using traits = std::streambuf::traits_type;
+            // Block until the stream buffer has something, and then take
+            // whatever it has buffered without blocking again.
+            if (traits::eq_int_type(_sb->sgetc(), traits::eof())) {
+                _eof = true;
+                return false;
+            }
+            std::streamsize const avail = std::max<std::streamsize>(_sb->in_avail(), 1);
+            std::streamsize const n_read = _sb->sgetn(
+                _buf.data() + _end,
+                std::min(avail, static_cast<std::streamsize>(room)));
+            _end += static_cast<std::size_t>(n_read);
+            return true;
+        }
+        else {
+            while (true) {
+                ssize_t const n_read = read(_fd, _buf.data() + _end, room);
+                if (n_read > 0) {
+                    _end += static_cast<std::size_t>(n_read);
+                    return true;
+                }
+                else if (n_read == 0) {
+                    _eof = true;
+                    return false;
+                }
+                else if (errno != EINTR) {
+                    throw std::system_error(errno, std::generic_category(), "read");
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <streambuf>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pkgxx {
+    /** A reader of newline-terminated lines from a stream buffer or a
+     * file descriptor. Unlike \c std::getline() it doesn't copy lines
+     * into strings. It hands out \c std::string_view pointing into its
+     * internal buffer, which only grows when a line or a record doesn't
+     * fit in it.
+     *
+     * A view returned by any member function is valid until the next
+     * call of a non-const member function.
+     */
+    struct line_reader {
+        /// The initial size of the internal buffer.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
+        /** An input iterator over lines, so that a reader can be used in
+         * range-based \c for loops.
+         */
+        struct iterator {
+            using iterator_category = std::input_iterator_tag;
+            using value_type        = std::string_view;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = std::string_view const*;
+            using reference         = std::string_view const&;
+
+            /// Construct a past-the-end iterator.
+            iterator()
+                : _reader(nullptr) {}
+
+            /// Construct an iterator pointing at the next line.
+            iterator(line_reader& reader)
+                : _reader(&reader) {
+                ++(*this);
+            }
+
+            reference
+            operator* () const {
+                return _line;
+            }
+
+            pointer
+            operator-> () const {
+                return &_line;
+            }
+
+            iterator&
+            operator++ () {
+                if (auto line = _reader->next_line(); line) {
+                    _line = *line;
+                }
+                else {
+                    _reader = nullptr;
+                }
+                return *this;
+            }
+
+            bool
+            operator== (iterator const& other) const noexcept {
+                return _reader == other._reader;
+            }
+
+            bool
+            operator!= (iterator const& other) const noexcept {
+                return !(*this == other);
+            }
+
+        private:
+            line_reader* _reader;
+            std::string_view _line;
+        };
+
+        /** Construct a line reader reading from a stream buffer. The
+         * reader may read ahead, so the stream buffer should not be used
+         * by anyone else afterwards.
+         */
+        line_reader(std::streambuf* in, std::size_t buf_size = default_buf_size);
+
+        /** Construct a line reader reading from the stream buffer of an
+         * input stream. Errors are reported as exceptions thrown by the
+         * stream buffer, regardless of the exception mask of the stream.
+         */
+        line_reader(std::istream& in, std::size_t buf_size = default_buf_size)
+            : line_reader(in.rdbuf(), buf_size) {}
+
+        /** Construct a line reader reading directly from a file
+         * descriptor with read(2). The fd is not closed by the reader.
+         */
+        line_reader(int fd, std::size_t buf_size = default_buf_size);
+
+        line_reader(line_reader const&) = delete;
+        line_reader&
+        operator= (line_reader const&) = delete;
+
+        /** Read the next line without its terminating newline, or return
+         * \c std::nullopt at EOF. The last line may lack a newline.
+         */
+        std::optional<std::string_view>
+        next_line();
+
+        /** Read the next record, that is, a sequence of non-empty lines
+         * terminated by an empty line or EOF, into \c lines. Empty lines
+         * preceding a record are skipped. Return \c false if there are no
+         * more records.
+         */
+        bool
+        next_record(std::vector<std::string_view>& lines);
+
+        /// Return an iterator to the next line.
+        iterator
+        begin() {
+            return iterator(*this);
+        }
+
+        /// Return a past-the-end iterator.
+        iterator
+        end() {
+            return iterator();
+        }
+
+    private:
+        // Read more data into the buffer, preserving everything after the
+        // mark. Return false at EOF.
+        bool
+        fill();
+
+        static constexpr std::size_t const no_mark = static_cast<std::size_t>(-1);
+
+        std::streambuf* _sb;
+        int _fd;
+        std::vector<char> _buf;
+        std::size_t _begin; // The start of unconsumed data.
+        std::size_t _end;   // The end of valid data.
+        std::size_t _mark;  // The start of the current record, if any.
+        bool _eof;
+        // Offsets of lines in the current record, relative to _mark.
+        std::vector<std::pair<std::size_t, std::size_t>> _record;
+    };
+}
@@ -1,135 +1,217 @@
-#include "nursery.hxx"
+#include <algorithm>
 
-using namespace std::placeholders;
+#include "adaptive_concurrency.hxx"
+#include "concurrency_budget.hxx"
+#include "nursery.hxx"
 
 namespace pkgxx {
     nursery::nursery(unsigned int concurrency)
-        : _concurrency(concurrency) {}
+        : _concurrency(concurrency)
+        , _in_worker(thread_pool::in_worker())
+        , _running(0)
+        , _uncaught(std::uncaught_exceptions()) {
+
+        thread_pool::instance().reserve(concurrency);
+    }
 
     nursery::~nursery() noexcept(false) {
-        std::unique_lock<mutex_t> lk(_mtx);
+        lock_t lk(_mtx);
+
+        bool const unwinding = std::uncaught_exceptions() > _uncaught;
+        if (unwinding) {
+            // The scope owning the nursery is exiting with an
+            // exception. Abandon the tasks as if one of them failed.
+            _pending_tasks.clear();
+            _token.cancel();
+        }
 
         while (true) {
             if (!_ex) {
-                start_some();
+                start_some(lk);
             }
 
-            if (!_pending_tasks.empty() && !_ex) {
-                // We still have pending tasks, which means we have reached
-                // the maximum concurrency. In this case we should wait
-                // until some tasks finish so that we can start more.
-                _finished.wait(lk);
+            if (_running == 0 && (_pending_tasks.empty() || _ex)) {
+                // No pending nor running tasks, or we have an exception
+                // and nothing is running anymore.
+                break;
             }
-            else if (!_busy_workers.empty()) {
-                // We have no pending children anymore but some tasks are
-                // still running. Wait until they all finish.
-                _finished.wait(lk);
+            else if (!_pending_tasks.empty() && !_ex &&
+                     _running < adaptive_concurrency::clamp(_concurrency)) {
+                // We are allowed to run more tasks but the global budget
+                // has no tokens left. We hold an implicit token while
+                // waiting, so run a task inline instead of blocking.
+                run_inline(lk);
+            }
+            else if (_in_worker && run_submitted(lk)) {
+                // We are a task of some other nursery, and blocking here
+                // would take a worker away from the pool while our own
+                // tasks may be sitting in its deque. We ran one of them
+                // instead. Only our own tasks are run here, because
+                // running arbitrary jobs could nest waits without bound.
             }
             else {
-                // No pending nor running tasks. Terminate all the
-                // workers. But since workers will call our
-                // task_finished(), which locks our mutex, we must unlock
-                // it to avoid deadlock.
-                lk.unlock();
-                for (auto& [_id, w]: _workers) {
-                    w->async_terminate();
-                }
-                for (auto& [_id, w]: _workers) {
-                    w->join();
-                }
-                // No need to worry about this lock() being skipped when
-                // join() throws.
-                lk.lock();
-                break;
+                // Wait until some tasks finish so that we can start more,
+                // or until they all finish.
+                _finished.wait(lk);
             }
         }
 
-        if (_ex) {
+        _pending_tasks.clear();
+        if (_ex && !unwinding) {
             std::rethrow_exception(_ex);
         }
     }
 
     void
-    nursery::start_some() {
-        lock_t lk(_mtx);
+    nursery::start_some(lock_t&) {
+        // The adaptive controller may lower the concurrency below what we
+        // were asked for, but it never raises it.
+        auto const limit = adaptive_concurrency::clamp(_concurrency);
 
-        auto const pop_task =
-            [this]() {
-                task t = std::move(_pending_tasks.front());
-                _pending_tasks.pop_front();
-                return t;
-            };
-
-        while (!_pending_tasks.empty()) {
-            if (auto it = _idle_workers.begin(); it != _idle_workers.end()) {
-                // We have an idle worker. Assign a task to it.
-                _workers.at(*it)->assign(pop_task());
-                _busy_workers.insert(*it);
-                _idle_workers.erase(it);
+        while (!_pending_tasks.empty() && _running < limit) {
+            if (!concurrency_budget::try_acquire()) {
+                // Other nurseries are using up the global budget.
+                break;
             }
-            else if (_workers.size() < _concurrency) {
-                // We have no idle workers but we have a room for spawning
-                // more.
-                auto w = std::make_unique<worker>(*this);
-                auto const worker_id = w->get_id();
-
-                w->assign(pop_task());
-                _workers.insert_or_assign(worker_id, std::move(w));
-                _busy_workers.insert(worker_id);
+
+            job t = std::move(_pending_tasks.front());
+            _pending_tasks.pop_front();
+            _running++;
+
+            if (_in_worker) {
+                // Our destructor may want to run it by itself.
+                auto st = std::make_shared<submitted_task>(std::move(t));
+                _submitted.push_back(st);
+                thread_pool::instance().submit(
+                    [this, st = std::move(st)]() {
+                        if (!st->claimed.exchange(true, std::memory_order_acq_rel)) {
+                            run_in_pool(st->t);
+                        }
+                        // Otherwise our destructor has run it, and the
+                        // nursery may be gone by now.
+                    });
             }
             else {
-                // We have reached the maximum concurrency.
-                break;
+                thread_pool::instance().submit(
+                    [this, t = std::move(t)]() mutable {
+                        run_in_pool(t);
+                    });
             }
         }
+
+        // Forget claimed tasks once in a while so that the list doesn't
+        // grow without bound.
+        if (_submitted.size() > 2 * std::max(limit, 8u)) {
+            _submitted.erase(
+                std::remove_if(
+                    _submitted.begin(), _submitted.end(),
+                    [](auto const& st) {
+                        return st->claimed.load(std::memory_order_acquire);
+                    }),
+                _submitted.end());
+        }
     }
 
     void
-    nursery::task_finished(std::thread::id worker_id, std::exception_ptr ex) {
-        {
-            lock_t lk(_mtx);
-
-            if (ex && !_ex) {
-                _ex = ex;
-            }
-            _busy_workers.erase(worker_id);
-            _idle_workers.insert(worker_id);
+    nursery::run_in_pool(job& t) {
+        std::exception_ptr ex;
+        try {
+            cancellation_token::scope const sc(_token);
+            t();
+        }
+        catch (...) {
+            ex = std::current_exception();
         }
-        _finished.notify_one();
+        // Destroy the task before reporting, because the nursery and
+        // whatever the task refers to may be gone as soon as we do.
+        t = job();
+        concurrency_budget::release();
+        task_finished(ex);
     }
 
     void
-    nursery::worker::thread_main() {
-        std::unique_lock<mutex_t> lk(_mtx);
+    nursery::run_inline(lock_t& lk) {
+        job t = std::move(_pending_tasks.front());
+        _pending_tasks.pop_front();
+        _running++;
 
-        while (true) {
-            // Sleep until we get a task or a termination request. We
-            // should not terminate as long as we have a task.
-            std::optional<task> t = std::move(_task);
-            _task.reset();
-            if (t) {
-                // fall through
-            }
-            else if (_terminate) {
-                break;
-            }
-            else {
-                _got_request.wait(lk);
+        lk.unlock();
+        std::exception_ptr ex;
+        try {
+            cancellation_token::scope const sc(_token);
+            t();
+        }
+        catch (...) {
+            ex = std::current_exception();
+        }
+        t = job();
+        lk.lock();
+
+        if (ex) {
+            fail(ex);
+        }
+        _running--;
+    }
+
+    bool
+    nursery::run_submitted(lock_t& lk) {
+        // The most recently submitted task is the one least likely to
+        // have been picked up by a worker.
+        while (!_submitted.empty()) {
+            auto st = std::move(_submitted.back());
+            _submitted.pop_back();
+            if (st->claimed.exchange(true, std::memory_order_acq_rel)) {
                 continue;
             }
 
-            // We got a task. Run it now, but don't lock the mutex while
-            // doing that. Otherwise the nursery can't even post a
-            // terminate request to us.
             lk.unlock();
+            std::exception_ptr ex;
             try {
-                t->run();
-                _nursery.task_finished(get_id());
+                cancellation_token::scope const sc(_token);
+                st->t();
             }
             catch (...) {
-                _nursery.task_finished(get_id(), std::current_exception());
+                ex = std::current_exception();
             }
+            st->t = job();
+            // The token taken when submitting it is ours now.
+            concurrency_budget::release();
             lk.lock();
+
+            if (ex) {
+                fail(ex);
+            }
+            _running--;
+            return true;
+        }
+        return false;
+    }
+
+    void
+    nursery::fail(std::exception_ptr ex) {
+        if (!_ex) {
+            // This is the first failure. Drop the pending tasks and
+            // signal the running ones so that the error surfaces without
+            // waiting for them to complete.
+            _ex = ex;
+            _pending_tasks.clear();
+            _token.cancel();
+        }
+    }
+
+    void
+    nursery::task_finished(std::exception_ptr ex) {
+        // Notify while holding the lock. Our destructor may return as soon
+        // as we unlock it, so we must not touch any members after that.
+        lock_t lk(_mtx);
+
+        if (ex) {
+            fail(ex);
+        }
+        _running--;
+        if (!_ex) {
+            start_some(lk);
         }
+        _finished.notify_all();
     }
 }
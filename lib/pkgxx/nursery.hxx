@@ -1,19 +1,21 @@
 #pragma once
 
-#include <cassert>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <deque>
 #include <exception>
 #include <functional>
-#include <map>
-#include <set>
 #include <memory>
 #include <mutex>
-#include <optional>
 #include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
+#include <pkgxx/cancellation.hxx>
+#include <pkgxx/thread_pool.hxx>
+
 namespace pkgxx {
     /** An implementation of structured concurrency:
      * https://vorpus.org/blog/notes-on-structured-concurrency-or-go-statement-considered-harmful/
@@ -26,6 +28,10 @@ namespace pkgxx {
                     = std::max(1u, std::thread::hardware_concurrency()));
 
         /** Block until all the registered child tasks finish.
+         *
+         * If the nursery is destroyed due to stack unwinding, pending
+         * tasks are discarded, running ones are cancelled, and exceptions
+         * thrown by tasks are discarded too.
          *
          * This is a memory barrier. Whatever memory values children tasks
          * could see before terminating can also be seen by the thread
@@ -37,22 +43,28 @@ namespace pkgxx {
          * will run in a separate thread. It is guaranteed to be started
          * before the destructor of nursery returns.
          *
-         * \ref nursery does not spawn a separate thread for each child
-         * task. Instead it creates a pool of threads and reuses them.
+         * \ref nursery does not spawn threads by itself. Tasks run on the
+         * process-wide \ref thread_pool, which grows to the largest
+         * concurrency ever requested. The nursery merely limits the
+         * number of its own tasks running at the same time.
          *
          * If a child task throws an exception, it will be caught by the
          * \ref nursery and rethrown from either its destructor or the next
-         * call of \ref start_soon(). No attempts will be made to kill any
-         * running children in this case, that is, the rethrowing will not
-         * happen until every ongoing task stops running by either
-         * finishing or throwing an exception. If more than one child
-         * throws an exception, only the first one will be rethrown and
-         * others will be discarded.
+         * call of \ref start_soon(). Pending tasks are discarded at that
+         * point, and the \ref cancellation_token of the nursery is
+         * cancelled so that processes spawned by running tasks are
+         * terminated. The rethrowing still doesn't happen until every
+         * ongoing task stops running by either finishing or throwing an
+         * exception. If more than one child throws an exception, only the
+         * first one will be rethrown and others will be discarded.
          *
-         * You may create a nested \ref nursery in the task, but the
-         * concurrency isn't coordinated with the parent \ref nursery. You
-         * may not call \ref start_soon() of a \ref nursery from within its
-         * own task.
+         * Every task running in parallel takes a token from the
+         * process-wide \ref concurrency_budget. You may create a nested
+         * \ref nursery in the task, and it draws from the same budget as
+         * its parent, so the total concurrency stays bounded. When the
+         * budget is exhausted, the thread waiting for a \ref nursery runs
+         * its pending tasks inline. You may not call \ref start_soon() of
+         * a \ref nursery from within its own task.
          *
          * This is a memory barrier. Whatever memory values the thread
          * calling this function can also be seen by the child task.
@@ -76,129 +88,95 @@ namespace pkgxx {
                 std::rethrow_exception(ex);
             }
             else {
+                // Arguments are stored by value and passed as lvalues,
+                // just like std::bind() does.
                 _pending_tasks.emplace_back(
-                    std::forward<Function>(f), std::forward<Args>(args)...);
-                start_some();
+                    [f = std::forward<Function>(f),
+                     args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                        std::apply(f, args);
+                    });
+                start_some(lk);
             }
         }
 
     private:
-        struct task {
-            template <typename Function, typename... Args>
-            task(Function&& f, Args&&... args)
-                : run(
-                    std::bind(
-                        std::forward<Function>(f), std::forward<Args>(args)...)) {
-
-                static_assert(std::is_invocable_v<Function&&, Args&&...>);
-            }
-
-            task() = delete;
-            task(task const&) = delete;
-            task(task&&) = default;
-
-            std::function<void ()> run;
-        };
-
-        struct worker {
-            worker(nursery& n)
-                : _nursery(n)
-                , _terminate(false)
-                , _thr(std::bind(&worker::thread_main, this)) {}
-            worker() = delete;
-            worker(worker const&) = delete;
-            worker(worker&&) = delete;
-
-            std::thread::id
-            get_id() const {
-                return _thr.get_id();
-            }
-
-            void
-            assign(task&& t) {
-                {
-                    lock_t lk(_mtx);
-
-                    assert(!_task.has_value());
-                    _task.emplace(std::move(t));
-                }
-                _got_request.notify_one();
-            }
-
-            void
-            async_terminate() {
-                {
-                    lock_t lk(_mtx);
-                    _terminate = true;
-                }
-                _got_request.notify_one();
-            }
-
-            void
-            join() {
-                _thr.join();
-            }
-
-        private:
-            void thread_main();
-
-            using mutex_t   = std::mutex;
-            using lock_t    = std::lock_guard<mutex_t>;
-            using condvar_t = std::condition_variable;
-
-            // These members aren't guarded by a mutex.
-            nursery& _nursery;
-            mutable mutex_t _mtx;
+        using mutex_t   = std::mutex;
+        using lock_t    = std::unique_lock<mutex_t>;
+        using condvar_t = std::condition_variable;
 
-            // When this has a value it means the worker is busy. Guarded
-            // by mtx.
-            std::optional<task> _task;
+        // Submit some pending tasks to the pool as long as we haven't
+        // reached the maximum concurrency. The lock must be held.
+        void
+        start_some(lock_t& lk);
 
-            // Set to true when the nursery wants the worker to
-            // die. Guarded by mtx.
-            bool _terminate;
+        // Run a task that a worker of the pool has picked up, and report
+        // its completion.
+        void
+        run_in_pool(job& t);
 
-            // Signaled when the nursery assigns a task to an idle worker
-            // or it asks the worker to die.
-            condvar_t _got_request;
+        // Run a pending task on the calling thread. The lock must be
+        // held, and it's temporarily released while running the task.
+        void
+        run_inline(lock_t& lk);
 
-            // The thread object isn't guarded by the mutex.
-            std::thread _thr;
-        };
+        // Claim one of our tasks that has been submitted to the pool but
+        // hasn't started yet, and run it on the calling thread. Return
+        // false if there is none. The lock must be held, and it's
+        // temporarily released while running the task.
+        bool
+        run_submitted(lock_t& lk);
 
-        // Start some pending tasks as long as we haven't reached the
-        // maximum concurrency.
+        // Record the exception thrown by a task and cancel others. The
+        // lock must be held.
         void
-        start_some();
+        fail(std::exception_ptr ex);
 
         // Notify the nursery that a task either finished successfully or
         // threw an exception.
         void
-        task_finished(std::thread::id worker_id, std::exception_ptr ex = {});
-
-        using mutex_t   = std::recursive_mutex;
-        using lock_t    = std::lock_guard<mutex_t>;
-        using condvar_t = std::condition_variable_any;
+        task_finished(std::exception_ptr ex);
 
         mutable mutex_t _mtx;
         unsigned _concurrency;
 
-        // The list of tasks that haven't started yet.
-        std::deque<task> _pending_tasks;
+        // The list of tasks that haven't been submitted to the pool yet.
+        std::deque<job> _pending_tasks;
 
-        // The pool of worker threads.
-        std::map<std::thread::id, std::unique_ptr<worker>> _workers;
+        // A task submitted to the pool. Whoever sets claimed first runs
+        // it: either a worker of the pool, or our destructor blocked in
+        // another worker.
+        struct submitted_task {
+            submitted_task(job&& t_)
+                : claimed(false)
+                , t(std::move(t_)) {}
+
+            std::atomic<bool> claimed;
+            job t;
+        };
 
-        // The set of busy worker threads.
-        std::set<std::thread::id> _busy_workers;
+        // True if the nursery is owned by a worker of the pool. Only
+        // then do we keep track of submitted tasks, because blocking in
+        // our destructor would take the worker away from the pool.
+        bool _in_worker;
 
-        // The set of idle worker threads.
-        std::set<std::thread::id> _idle_workers;
+        // Tasks submitted to the pool, some of which may have been
+        // claimed already.
+        std::deque<std::shared_ptr<submitted_task>> _submitted;
+
+        // The number of tasks submitted to the pool but not finished yet.
+        std::size_t _running;
 
         // An exception thrown by a task.
         std::exception_ptr _ex;
 
         // Signaled when a task finishes.
         condvar_t _finished;
+
+        // Cancelled on the first failure. Tasks run with this as the
+        // current token.
+        cancellation_token _token;
+
+        // The number of uncaught exceptions at construction.
+        int _uncaught;
     };
 }
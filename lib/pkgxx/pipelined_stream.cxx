@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "pipelined_stream.hxx"
+
+namespace pkgxx {
+    pipelined_streambuf::pipelined_streambuf(
+        std::streambuf* base, std::size_t buf_size, std::size_t n_bufs)
+        : _base(base)
+        , _done(false)
+        , _stop(false) {
+
+        n_bufs   = std::max<std::size_t>(n_bufs, 2);
+        buf_size = std::max<std::size_t>(buf_size, 1);
+        for (std::size_t i = 0; i < n_bufs; i++) {
+            _bufs.emplace_back(buf_size);
+            _free.push_back(i);
+        }
+        _producer = std::thread(&pipelined_streambuf::produce, this);
+    }
+
+    pipelined_streambuf::~pipelined_streambuf() {
+        {
+            lock_t lk(_mtx);
+            _stop = true;
+        }
+        _free_cv.notify_all();
+        _producer.join();
+    }
+
+#if !defined(DOXYGEN)
+    pipelined_streambuf::int_type
+    pipelined_streambuf::underflow() {
+        lock_t lk(_mtx);
+
+        if (_current) {
+            // We have consumed the current buffer. Give it back.
+            _free.push_back(*_current);
+            _current.reset();
+            setg(nullptr, nullptr, nullptr);
+            _free_cv.notify_one();
+        }
+
+        _filled_cv.wait(lk, [&]() { return !_filled.empty() || _done; });
+        if (!_filled.empty()) {
+            auto const [i, len] = _filled.front();
+            _filled.pop_front();
+            _current = i;
+            setg(_bufs[i].data(), _bufs[i].data(), _bufs[i].data() + len);
+            return traits_type::to_int_type(*gptr());
+        }
+        else if (_ex) {
+            std::rethrow_exception(std::exchange(_ex, nullptr));
+        }
+        else {
+            return traits_type::eof();
+        }
+    }
+#endif
+
+    void
+    pipelined_streambuf::produce() {
+        while (true) {
+            std::size_t i;
+            {
+                lock_t lk(_mtx);
+                _free_cv.wait(lk, [&]() { return !_free.empty() || _stop; });
+                if (_stop) {
+                    return;
+                }
+                i = _free.front();
+                _free.pop_front();
+            }
+
+            // sgetn() only returns short at EOF.
+            auto const size = static_cast<std::streamsize>(_bufs[i].size());
+            std::streamsize n_read = 0;
+            std::exception_ptr ex;
+            try {
+                n_read = _base->sgetn(_bufs[i].data(), size);
+            }
+            catch (...) {
+                ex = std::current_exception();
+            }
+
+            bool const last = ex || n_read < size;
+            {
+                lock_t lk(_mtx);
+                if (n_read > 0) {
+                    _filled.emplace_back(i, static_cast<std::size_t>(n_read));
+                }
+                else {
+                    _free.push_back(i);
+                }
+                if (last) {
+                    _ex   = ex;
+                    _done = true;
+                }
+            }
+            _filled_cv.notify_one();
+
+            if (last) {
+                return;
+            }
+        }
+    }
+}
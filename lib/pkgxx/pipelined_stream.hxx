@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pkgxx {
+    /** A stream buffer that reads another stream buffer on a dedicated
+     * thread. The thread fills a bounded ring of large buffers while the
+     * reader consumes them, so that producing data (e.g. decompressing or
+     * downloading it) overlaps with consuming it (e.g. parsing it).
+     *
+     * The base stream buffer must not be touched by anyone else while
+     * this stream buffer exists. Exceptions thrown by the base stream
+     * buffer are rethrown to the reader once it has consumed everything
+     * read before the failure.
+     */
+    struct pipelined_streambuf: public std::streambuf {
+        /// The default size of each buffer in the ring.
+        static constexpr std::size_t const default_buf_size = 128 * 1024;
+
+        /// The default number of buffers in the ring.
+        static constexpr std::size_t const default_n_bufs = 4;
+
+        /** Construct a stream buffer that reads data from another stream
+         * buffer on a separate thread.
+         */
+        pipelined_streambuf(std::streambuf* base,
+                            std::size_t buf_size = default_buf_size,
+                            std::size_t n_bufs = default_n_bufs);
+
+        /** Stop the producer thread and wait for it. If it's blocked on
+         * reading the base stream buffer, this waits for the read to
+         * complete.
+         */
+        virtual ~pipelined_streambuf();
+
+        pipelined_streambuf(pipelined_streambuf const&) = delete;
+        pipelined_streambuf&
+        operator= (pipelined_streambuf const&) = delete;
+
+    protected:
+#if !defined(DOXYGEN)
+        virtual int_type
+        underflow() override;
+#endif
+
+    private:
+        void
+        produce();
+
+        using lock_t = std::unique_lock<std::mutex>;
+
+        std::streambuf* _base;
+        std::vector<std::vector<char_type>> _bufs;
+
+        std::mutex _mtx;
+        std::condition_variable _filled_cv;
+        std::condition_variable _free_cv;
+        std::deque<std::pair<std::size_t, std::size_t>> _filled; // Index and length.
+        std::deque<std::size_t> _free;
+        std::optional<std::size_t> _current; // Index of the buffer being read.
+        bool _done; // The producer has reached EOF or failed.
+        bool _stop; // The consumer has gone.
+        std::exception_ptr _ex;
+
+        // This has to be initialised last, as it starts using the members
+        // above right away.
+        std::thread _producer;
+    };
+
+    /** An input stream that reads another input stream on a dedicated
+     * thread using \ref pipelined_streambuf.
+     */
+    struct pipelined_istream: public std::istream {
+        /** Construct an input stream that reads data from another input
+         * stream on a separate thread.
+         */
+        pipelined_istream(std::istream& base,
+                          std::size_t buf_size = pipelined_streambuf::default_buf_size,
+                          std::size_t n_bufs = pipelined_streambuf::default_n_bufs)
+            : std::istream(nullptr) {
+
+            if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
+                _buf = std::make_unique<pipelined_streambuf>(base_buf, buf_size, n_bufs);
+                rdbuf(_buf.get());
+            }
+        }
+
+    private:
+        std::unique_ptr<pipelined_streambuf> _buf;
+    };
+}
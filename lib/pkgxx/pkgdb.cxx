@@ -1,4 +1,5 @@
 #include "harness.hxx"
+#include "line_reader.hxx"
 #include "pkgdb.hxx"
 
 namespace pkgxx {
@@ -11,8 +12,8 @@ namespace pkgxx {
             pkg_info.cin().close();
 
             std::map<std::string, std::string> ret;
-            for (std::string line; std::getline(pkg_info.cout(), line); ) {
-                if (auto equal = line.find('='); equal != std::string::npos) {
+            for (auto const line: line_reader(pkg_info.cout())) {
+                if (auto equal = line.find('='); equal != std::string_view::npos) {
                     ret.emplace(
                         line.substr(0, equal),
                         line.substr(equal + 1));
@@ -45,7 +46,7 @@ namespace pkgxx {
             pkg_info.cin().close();
 
             std::set<pkgxx::pkgname> ret;
-            for (std::string line; std::getline(pkg_info.cout(), line); ) {
+            for (auto const line: line_reader(pkg_info.cout())) {
                 if (line.empty()) {
                     break;
                 }
@@ -63,7 +64,7 @@ namespace pkgxx {
             pkg_info.cin().close();
 
             std::set<pkgxx::pkgname> ret;
-            for (std::string line; std::getline(pkg_info.cout(), line); ) {
+            for (auto const line: line_reader(pkg_info.cout())) {
                 if (line.empty()) {
                     break;
                 }
@@ -81,7 +82,7 @@ namespace pkgxx {
         pkg_info.cin().close();
 
         std::set<pkgxx::pkgname> ret;
-        for (std::string line; std::getline(pkg_info.cout(), line); ) {
+        for (auto const line: line_reader(pkg_info.cout())) {
             ret.emplace(line);
         }
         return ret;
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <iterator>
 #include <memory>
+#include <optional>
 #if defined(HAVE_SPAWN_H)
 #  include <spawn.h>
 #endif
@@ -149,6 +150,41 @@ namespace pkgxx {
             posix_spawn_file_actions_t _fas;
         };
 
+        /** A thin wrapper of posix_spawnattr_t */
+        struct spawn_attr {
+            spawn_attr() {
+                if (int const err = posix_spawnattr_init(&_attr); err != 0) {
+                    throw std::system_error(
+                        err, std::generic_category(), "posix_spawnattr_init");
+                }
+            }
+
+            ~spawn_attr() {
+                posix_spawnattr_destroy(&_attr);
+            }
+
+            posix_spawnattr_t const*
+            c_ptr() const noexcept {
+                return &_attr;
+            }
+
+            spawn_attr&
+            new_process_group() {
+                if (int const err = posix_spawnattr_setpgroup(&_attr, 0); err != 0) {
+                    throw std::system_error(
+                        err, std::generic_category(), "posix_spawnattr_setpgroup");
+                }
+                if (int const err = posix_spawnattr_setflags(&_attr, static_cast<short>(POSIX_SPAWN_SETPGROUP)); err != 0) {
+                    throw std::system_error(
+                        err, std::generic_category(), "posix_spawnattr_setflags");
+                }
+                return *this;
+            }
+
+        private:
+            posix_spawnattr_t _attr;
+        };
+
 #else // defined(USE_POSIX_SPAWN)
         struct file_actions {
             template <typename Path>
@@ -313,13 +349,18 @@ namespace pkgxx {
             }
             cenvp.push_back(nullptr);
 
+            std::optional<spawn_attr> attr;
+            if (_new_pgroup) {
+                attr.emplace().new_process_group();
+            }
+
             pid_t pid;
             if (_is_file) {
                 if (posix_spawnp(
                         &pid,
                         _cmd.c_str(),
                         _fas ? _fas->c_ptr() : nullptr,
-                        nullptr, // attrp
+                        attr ? attr->c_ptr() : nullptr,
                         const_cast<char* const*>(cargv.data()),
                         const_cast<char* const*>(cenvp.data())) != 0) {
                     throw std::system_error(errno, std::generic_category(), "posix_spawnp");
@@ -330,7 +371,7 @@ namespace pkgxx {
                         &pid,
                         _cmd.c_str(),
                         _fas ? _fas->c_ptr() : nullptr,
-                        nullptr, // attrp
+                        attr ? attr->c_ptr() : nullptr,
                         const_cast<char* const*>(cargv.data()),
                         const_cast<char* const*>(cenvp.data())) != 0) {
                     throw std::system_error(errno, std::generic_category(), "posix_spawnp");
@@ -371,6 +412,13 @@ namespace pkgxx {
             if (pid == 0) {
                 msg_in.close();
 
+                if (_new_pgroup && setpgid(0, 0) != 0) {
+                    msg_out.write(reinterpret_cast<char const*>(&errno), sizeof(int));
+                    msg_out << "setpgid";
+                    msg_out.close();
+                    _exit(1);
+                }
+
                 if (_fas) {
                     try {
                         (*_fas)();
@@ -441,6 +489,14 @@ namespace pkgxx {
             else if (pid > 0) {
                 msg_out.close();
 
+                if (_new_pgroup) {
+                    // Do it on our side too, so that the group exists by
+                    // the time we return. The child may have already
+                    // done it, or exec'ed and made it fail, both of
+                    // which are fine.
+                    setpgid(pid, pid);
+                }
+
                 // The child will write errno and a string message to this
                 // pipe if it fails to exec.
                 int code;
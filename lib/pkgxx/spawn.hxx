@@ -26,6 +26,7 @@ namespace pkgxx {
             template <typename Cmd, typename Argv>
             spawn_base(bool is_file, Cmd&& cmd, Argv&& argv)
                 : _is_file(is_file)
+                , _new_pgroup(false)
                 , _cmd(std::forward<Cmd>(cmd))
                 , _argv(std::forward<Argv>(argv)) {}
 
@@ -52,6 +53,13 @@ namespace pkgxx {
             spawn_base&
             dup_fd(int from, int to);
 
+            // Put the child in a new process group whose id is its pid.
+            spawn_base&
+            new_process_group() {
+                _new_pgroup = true;
+                return *this;
+            }
+
             pid_t
             operator() () const;
 
@@ -61,6 +69,7 @@ namespace pkgxx {
 
         private:
             bool _is_file;
+            bool _new_pgroup;
             std::filesystem::path _cmd;
             std::vector<std::string> _argv;
             std::optional<
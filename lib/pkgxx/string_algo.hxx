@@ -1,9 +1,11 @@
 #pragma once
 
 #include <cassert>
+#include <charconv>
 #include <iterator>
 #include <optional>
 #include <string_view>
+#include <system_error>
 
 #include <pkgxx/ordered.hxx>
 
@@ -168,6 +170,23 @@ namespace pkgxx {
         return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
     }
 
+    /** Parse the whole string as a decimal integer, or return \c
+     * std::nullopt if it isn't one or it doesn't fit in \c T.
+     */
+    template <typename T>
+    std::optional<T>
+    parse_integer(std::string_view const& str) {
+        T value;
+        auto const last = str.data() + str.size();
+        if (auto const [ptr, ec] = std::from_chars(str.data(), last, value);
+            ec == std::errc() && ptr == last) {
+            return value;
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
     /// Convert an ASCII upper-case letter to the corresponding lower-case
     /// one.
     inline char
@@ -1,25 +1,62 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <future>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <system_error>
 #include <vector>
 
 #include "bzip2stream.hxx"
+#include "environment.hxx"
 #include "gzipstream.hxx"
 #include "harness.hxx"
+#include "line_reader.hxx"
+#include "mutex_guard.hxx"
+#include "nursery.hxx"
+#include "pipelined_stream.hxx"
 #include "string_algo.hxx"
 #include "summary.hxx"
+#include "www_cache.hxx"
 #include "wwwstream.hxx"
 #include "xargs_fold.hxx"
+#include "xzstream.hxx"
+#include "zstdstream.hxx"
 
 using namespace pkgxx;
 using namespace std::literals;
 namespace fs = std::filesystem;
 
 namespace {
-    std::vector<std::string> const SUMMARY_FILES = {
+    // Summary files in the order of preference when PACKAGES is a local
+    // directory. Reading is cheap, so the fastest to decode comes first.
+    // bzip2 is the slowest even though we decode it in parallel.
+    std::vector<std::string> const LOCAL_SUMMARY_FILES = {
+        "pkg_summary.txt",
+#if defined(HAVE_ZSTD)
+        "pkg_summary.zst",
+#endif
+        "pkg_summary.gz",
+#if defined(HAVE_LZMA)
+        "pkg_summary.xz",
+#endif
+        "pkg_summary.bz2"
+    };
+
+    // Summary files in the order of preference when PACKAGES is a
+    // URL. The transfer usually dominates, so smaller files come first
+    // unless they are much slower to decode.
+    std::vector<std::string> const REMOTE_SUMMARY_FILES = {
+#if defined(HAVE_ZSTD)
+        "pkg_summary.zst",
+#endif
+#if defined(HAVE_LZMA)
+        "pkg_summary.xz",
+#endif
         "pkg_summary.bz2",
         "pkg_summary.gz",
         "pkg_summary.txt"
@@ -28,46 +65,44 @@ namespace {
     summary
     read_summary(std::istream& in) {
         summary sum;
-        std::vector<pkgpattern> DEPENDS;
-        std::optional<std::filesystem::path> FILENAME;
-        std::optional<pkgname> PKGNAME;
-        std::optional<pkgpath> PKGPATH;
-        for (std::string line; std::getline(in, line); ) {
-            if (line.empty()) {
-                if (PKGNAME && PKGPATH) {
-                    DEPENDS.shrink_to_fit();
-                    sum.emplace(
-                        PKGNAME.value(),
-                        pkgvars {
-                            std::move(DEPENDS),
-                            FILENAME,
-                            PKGNAME.value(),
-                            PKGPATH.value()
-                        });
-                }
-                DEPENDS.clear();
-                FILENAME.reset();
-                PKGNAME.reset();
-                PKGPATH.reset();
-            }
-            else if (auto const equal = line.find('='); equal != std::string::npos) {
-                auto const view     = static_cast<std::string_view>(line);
-                auto const variable = view.substr(0, equal);
-                auto const value    = equal + 1 < view.size() ? view.substr(equal + 1) : ""sv;
-
-                if (variable == "DEPENDS") {
-                    DEPENDS.emplace_back(value);
-                }
-                else if (variable == "FILENAME" && !value.empty()) {
-                    FILENAME.emplace(value);
-                }
-                else if (variable == "PKGNAME") {
-                    PKGNAME.emplace(value);
-                }
-                else if (variable == "PKGPATH") {
-                    PKGPATH.emplace(value);
+        line_reader reader(in);
+        for (std::vector<std::string_view> record; reader.next_record(record); ) {
+            std::vector<pkgpattern> DEPENDS;
+            std::optional<std::filesystem::path> FILENAME;
+            std::optional<pkgname> PKGNAME;
+            std::optional<pkgpath> PKGPATH;
+            for (auto const line: record) {
+                if (auto const equal = line.find('='); equal != std::string_view::npos) {
+                    auto const variable = line.substr(0, equal);
+                    auto const value    = line.substr(equal + 1);
+
+                    if (variable == "DEPENDS") {
+                        DEPENDS.emplace_back(value);
+                    }
+                    else if (variable == "FILENAME" && !value.empty()) {
+                        FILENAME.emplace(value);
+                    }
+                    else if (variable == "PKGNAME") {
+                        PKGNAME.emplace(value);
+                    }
+                    else if (variable == "PKGPATH") {
+                        PKGPATH.emplace(value);
+                    }
                 }
             }
+
+            if (PKGNAME && PKGPATH) {
+                DEPENDS.shrink_to_fit();
+                sum.emplace(
+                    PKGNAME.value(),
+                    pkgvars {
+                        std::move(DEPENDS),
+                        std::move(FILENAME),
+                        PKGNAME.value(),
+                        PKGPATH.value(),
+                        {}
+                    });
+            }
         }
         return sum;
     }
@@ -77,19 +112,41 @@ namespace {
     with_uncompress_filter(
         std::filesystem::path const& summary_file,
         std::istream&& maybe_compressed,
+        unsigned concurrency,
         Function&& f) {
 
+        // Decompression runs on its own thread so that it overlaps with
+        // whatever f does.
         auto const&& ext = summary_file.extension();
         if (ext == ".bz2") {
-            bunzip2istream in(maybe_compressed);
+            // bzip2 is slow to decode. Use all the CPUs we are allowed to.
+            parallel_bunzip2istream bz(maybe_compressed, concurrency);
+            pipelined_istream in(bz);
             in.exceptions(std::ios_base::badbit);
             return f(in);
         }
         else if (ext == ".gz") {
-            gunzipistream in(maybe_compressed);
+            gunzipistream gz(maybe_compressed);
+            pipelined_istream in(gz);
+            in.exceptions(std::ios_base::badbit);
+            return f(in);
+        }
+#if defined(HAVE_LZMA)
+        else if (ext == ".xz") {
+            unxzistream xz(maybe_compressed);
+            pipelined_istream in(xz);
             in.exceptions(std::ios_base::badbit);
             return f(in);
         }
+#endif
+#if defined(HAVE_ZSTD)
+        else if (ext == ".zst") {
+            unzstdistream zst(maybe_compressed);
+            pipelined_istream in(zst);
+            in.exceptions(std::ios_base::badbit);
+            return f(in);
+        }
+#endif
         else {
             return f(maybe_compressed);
         }
@@ -105,23 +162,29 @@ namespace {
         std::string const& PKG_SUFX) {
 
         // Lazily find the latest binary package, lazily because if no
-        // summary files exist this information won't be used.
+        // summary files exist this information won't be used. Only look
+        // at packages, as summary files and the build version index
+        // live in the same directory and are written after them.
         auto const latest_bin_pkg = std::async(
             std::launch::deferred,
-            [&PACKAGES]() {
-                fs::file_time_type t;
+            [&PACKAGES, &PKG_SUFX]() {
+                // A default-constructed file_time_type is not the
+                // earliest possible time on every implementation.
+                fs::file_time_type t = fs::file_time_type::min();
                 for (auto const& ent:
                          fs::directory_iterator(
                              PACKAGES,
                              fs::directory_options::follow_directory_symlink)) {
-                    if (ent.last_write_time() > t) {
+                    if (ent.is_regular_file() &&
+                        ends_with(ent.path().filename().string(), PKG_SUFX) &&
+                        ent.last_write_time() > t) {
                         t = ent.last_write_time();
                     }
                 }
                 return t;
             }).share();
 
-        for (auto const& summary_file: SUMMARY_FILES) {
+        for (auto const& summary_file: LOCAL_SUMMARY_FILES) {
             auto const path = PACKAGES / summary_file;
             std::error_code ec;
             auto const summary_last_mod = fs::last_write_time(path, ec);
@@ -144,7 +207,7 @@ namespace {
                 }
 
                 return with_uncompress_filter(
-                    path, std::move(local_file),
+                    path, std::move(local_file), concurrency,
                     [](auto&& in) {
                         return read_summary(in);
                     });
@@ -153,12 +216,10 @@ namespace {
 
         verbose << "No valid summaries exist. Scanning "
                 << PACKAGES << " ..." << std::endl;
-        return xargs_fold({
-                shell,
-                "-c", "exec " + PKG_INFO + " -X \"$@\"",
-                shell // This will be $0 of the shell, and the rest of argv
-                      // will be constructed by xargs.
-            },
+        auto cmd = command_argv(PKG_INFO);
+        cmd.push_back("-X");
+        return xargs_fold(
+            cmd,
             [&](auto&& args) {
                 for (auto const& ent:
                          fs::directory_iterator(
@@ -173,29 +234,245 @@ namespace {
             concurrency);
     }
 
-    summary
-    read_remote_summary(std::ostream& msg, std::filesystem::path const& PACKAGES) {
-        for (auto const& summary_file: SUMMARY_FILES) {
-            try {
-                auto const path = PACKAGES / summary_file;
-                wwwistream remote_file(path);
-                remote_file.exceptions(std::ios_base::badbit);
+    // The result of probing a summary file on a mirror.
+    struct summary_probe {
+        enum class state {
+            pending,
+            found,
+            failed
+        };
 
-                return with_uncompress_filter(
-                    path,
-                    std::move(remote_file),
-                    [](auto&& in) {
-                        return read_summary(in);
+        std::size_t mirror;  // Index into the list of mirrors.
+        std::size_t variant; // Index into REMOTE_SUMMARY_FILES.
+        std::filesystem::path url;
+        state st = state::pending;
+        std::optional<std::time_t> mtime;
+    };
+
+    // Probes that haven't started by then are skipped. Running ones
+    // can't be interrupted, so they are waited for.
+    constexpr auto const probe_deadline = 5s;
+
+    // Return probes in the order they should be tried, or std::nullopt if
+    // we can't decide yet. The freshest mirror wins, where the freshness
+    // of a mirror is the newest modification time of its summaries, and
+    // ties are broken by the order of mirrors. Within a mirror files are
+    // preferred in the order of REMOTE_SUMMARY_FILES. The decision is
+    // made as soon as no pending probe can change the winner, or when
+    // "settle" is true, with whatever we know so far.
+    std::optional<std::vector<summary_probe>>
+    rank_summary_probes(std::vector<summary_probe> const& probes,
+                        std::size_t n_mirrors,
+                        bool settle) {
+        std::vector<std::optional<std::optional<std::time_t>>> freshness(n_mirrors);
+        for (auto const& p: probes) {
+            if (p.st == summary_probe::state::found &&
+                (!freshness[p.mirror] || p.mtime > *freshness[p.mirror])) {
+                freshness[p.mirror] = p.mtime;
+            }
+        }
+
+        auto const better = [&](summary_probe const* a, summary_probe const* b) {
+            // Is the probe a preferred over b?
+            if (freshness[a->mirror] != freshness[b->mirror]) {
+                return freshness[a->mirror] > freshness[b->mirror];
+            }
+            else if (a->mirror != b->mirror) {
+                return a->mirror < b->mirror;
+            }
+            else {
+                return a->variant < b->variant;
+            }
+        };
+
+        summary_probe const* best = nullptr;
+        for (auto const& p: probes) {
+            if (p.st == summary_probe::state::found && (!best || better(&p, best))) {
+                best = &p;
+            }
+        }
+
+        for (auto const& p: probes) {
+            if (!settle &&
+                p.st == summary_probe::state::pending &&
+                (!best || p.mirror != best->mirror || p.variant < best->variant)) {
+                // It may turn out to be fresher, or more preferred.
+                return std::nullopt;
+            }
+        }
+
+        // Found ones come first. Pending ones may still be there, so
+        // they follow in the default order in case all the others fail
+        // to download.
+        std::vector<summary_probe const*> ranked;
+        for (auto const& p: probes) {
+            if (p.st == summary_probe::state::found) {
+                ranked.push_back(&p);
+            }
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), better);
+        for (auto const& p: probes) {
+            if (p.st == summary_probe::state::pending) {
+                ranked.push_back(&p);
+            }
+        }
+
+        std::vector<summary_probe> result;
+        for (auto const p: ranked) {
+            result.push_back(*p);
+        }
+        return result;
+    }
+
+    // Probe every summary file on every mirror concurrently, and return
+    // the ones that exist in the order they should be tried. Probes run
+    // on a nursery, and the ones that haven't started yet are skipped as
+    // soon as they can no longer change the outcome, or once the
+    // deadline has passed. Skipped ones are ranked as if they were still
+    // pending. If every probe fails, which happens e.g. when the server
+    // rejects HEAD requests, return all of them in the default order.
+    std::vector<summary_probe>
+    probe_remote_summaries(std::vector<std::filesystem::path> const& mirrors,
+                           unsigned concurrency) {
+        guarded<std::vector<summary_probe>> probes;
+        for (std::size_t m = 0; m < mirrors.size(); m++) {
+            for (std::size_t v = 0; v < REMOTE_SUMMARY_FILES.size(); v++) {
+                probes.lock()->push_back(
+                    summary_probe {
+                        m, v, mirrors[m] / REMOTE_SUMMARY_FILES[v],
+                        summary_probe::state::pending, std::nullopt});
+            }
+        }
+
+        auto const deadline = std::chrono::steady_clock::now() + probe_deadline;
+        {
+            nursery n(concurrency);
+            for (std::size_t i = 0; i < probes.lock()->size(); i++) {
+                n.start_soon(
+                    [&, i]() {
+                        cancellation_token::throw_if_cancelled();
+
+                        std::string url;
+                        {
+                            auto ps = probes.lock();
+                            if (std::chrono::steady_clock::now() > deadline ||
+                                rank_summary_probes(*ps, mirrors.size(), false)) {
+                                return;
+                            }
+                            url = (*ps)[i].url.string();
+                        }
+
+                        auto const st = stat_remote_file(url);
+                        auto ps = probes.lock();
+                        (*ps)[i].st    = st ? summary_probe::state::found : summary_probe::state::failed;
+                        (*ps)[i].mtime = st ? st->mtime : std::nullopt;
                     });
             }
+        }
+
+        auto ps = probes.lock();
+        auto ranked = rank_summary_probes(*ps, mirrors.size(), true);
+        if (ranked->empty()) {
+            return *ps;
+        }
+        else {
+            return std::move(*ranked);
+        }
+    }
+
+    summary
+    read_remote_summary(
+        std::ostream& msg,
+        unsigned concurrency,
+        std::filesystem::path const& PACKAGES) {
+
+        // Keep downloaded summaries so that we can make conditional
+        // requests next time. Go without the cache if we can't have one.
+        std::optional<fs::path> cache;
+        if (auto const dir = cache_dir(); dir) {
+            std::error_code ec;
+            fs::create_directories(*dir / "summaries", ec);
+            if (!ec) {
+                cache = *dir / "summaries";
+            }
+        }
+
+        std::vector<fs::path> mirrors = {PACKAGES};
+        if (auto const extra = cgetenv("PKGCHKXX_MIRRORS"); extra) {
+            for (auto const& mirror: words(*extra)) {
+                mirrors.emplace_back(mirror);
+            }
+        }
+
+        auto const fetch = [&](fs::path const& url) {
+            if (cache) {
+                std::ifstream cached_file(
+                    fetch_cached(url, *cache),
+                    std::ios_base::in | std::ios_base::binary);
+                if (cached_file) {
+                    return with_uncompress_filter(
+                        url, std::move(cached_file), concurrency,
+                        [](auto&& in) {
+                            return read_summary(in);
+                        });
+                }
+                // Someone removed it. Fetch it directly.
+            }
+
+            wwwistream remote_file(url);
+            remote_file.exceptions(std::ios_base::badbit);
+
+            // Download on another thread while decompressing.
+            return with_uncompress_filter(
+                url,
+                pipelined_istream(remote_file),
+                concurrency,
+                [](auto&& in) {
+                    return read_summary(in);
+                });
+        };
+
+        if (mirrors.size() == 1 && cache) {
+            // With a single mirror there is nothing to compare, and the
+            // summary we downloaded last time is most likely still
+            // there. Revalidate it right away instead of probing. This
+            // means we don't notice a more preferred variant appearing
+            // on the mirror until the one we use goes away.
+            for (auto const& file: REMOTE_SUMMARY_FILES) {
+                auto const url = PACKAGES / file;
+                if (fs::exists(cache_path(url, *cache))) {
+                    try {
+                        return fetch(url);
+                    }
+                    catch (remote_file_unavailable const&) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (auto const& probe: probe_remote_summaries(mirrors, concurrency)) {
+            try {
+                return fetch(probe.url);
+            }
             catch (remote_file_unavailable const&) {
                 continue;
             }
+            catch (remote_file_error const& e) {
+                if (mirrors.size() > 1) {
+                    // Another mirror may still work.
+                    msg << "** Failed to fetch " << probe.url.string()
+                        << ": " << e.what() << std::endl;
+                    continue;
+                }
+                throw;
+            }
         }
 
-        msg << "** No summary files are available: "
-            << PACKAGES.string() << std::endl;
-        std::exit(1);
+        // Don't exit(3) here, as we may be one of the repositories being
+        // loaded concurrently.
+        throw remote_file_unavailable(
+            "No summary files are available: " + PACKAGES.string());
     }
 }
 
@@ -218,11 +495,74 @@ namespace pkgxx {
         std::string const& PKG_SUFX) {
 
         if (PACKAGES.string().find("://") != std::string::npos) {
-            *this = read_remote_summary(msg, PACKAGES);
+            *this = read_remote_summary(msg, concurrency, PACKAGES);
         }
         else {
             *this = read_local_summary(msg, verbose, concurrency, PACKAGES, PKG_INFO, PKG_SUFX);
         }
+        for (auto& [_name, vars]: *this) {
+            vars.PACKAGES = PACKAGES;
+        }
+    }
+
+    summary::summary(
+        std::ostream& msg,
+        std::ostream& verbose,
+        unsigned concurrency,
+        std::vector<std::filesystem::path> const& repositories,
+        std::string const& PKG_INFO,
+        std::string const& PKG_SUFX) {
+
+        if (repositories.size() == 1) {
+            // The common case. Don't buffer messages.
+            *this = summary(msg, verbose, concurrency, repositories.front(), PKG_INFO, PKG_SUFX);
+            return;
+        }
+
+        // Each repository is mostly a download or a pkg_info(1) scan,
+        // so load them all at once. Results are merged in the order of
+        // repositories so that the precedence doesn't depend on which
+        // one finishes first. Messages are buffered for the same reason,
+        // and also because output streams can't be shared by threads.
+        struct slot {
+            summary sum;
+            std::ostringstream msg;
+            std::ostringstream verbose;
+        };
+        std::vector<slot> slots(repositories.size());
+        {
+            nursery n(concurrency);
+            for (std::size_t i = 0; i < repositories.size(); i++) {
+                n.start_soon(
+                    [&, i]() {
+                        auto& s = slots[i];
+                        s.sum = summary(
+                            s.msg, s.verbose, concurrency, repositories[i], PKG_INFO, PKG_SUFX);
+                    });
+            }
+        }
+        // Precedence is decided per PKGBASE, not per PKGNAME. Otherwise a
+        // later repository having a newer version of a package would
+        // shadow the earlier one, even though that version isn't the one
+        // the user asked for.
+        std::set<pkgbase> provided;
+        for (auto& s: slots) {
+            msg     << s.msg.str();
+            verbose << s.verbose.str();
+
+            std::set<pkgbase> bases;
+            for (auto it = s.sum.begin(); it != s.sum.end(); ) {
+                if (provided.count(it->first.base) > 0) {
+                    it = s.sum.erase(it);
+                }
+                else {
+                    bases.insert(it->first.base);
+                    it++;
+                }
+            }
+            provided.merge(bases);
+            *this += std::move(s.sum);
+        }
     }
 
     pkgmap::pkgmap(summary const& all_packages) {
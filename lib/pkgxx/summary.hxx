@@ -6,6 +6,8 @@
 #include <optional>
 #include <ostream>
 #include <set>
+#include <string>
+#include <vector>
 
 #include <pkgxx/pkgpath.hxx>
 #include <pkgxx/pkgpattern.hxx>
@@ -32,6 +34,27 @@ namespace pkgxx {
 
         /** The path of the package directory within pkgsrc. */
         pkgpath PKGPATH;
+
+        /** The repository the binary package is in, or an empty path if
+         * the package doesn't come from a repository. This isn't a
+         * pkg_summary(5) variable.
+         */
+        std::filesystem::path PACKAGES;
+
+        /** Return the path to the binary package file, i.e. \c FILE_NAME
+         * or \c PKGNAME followed by \c PKG_SUFX under \c PACKAGES.
+         */
+        std::filesystem::path
+        binary_package_file(std::string const& PKG_SUFX) const {
+            if (FILE_NAME) {
+                return PACKAGES / *FILE_NAME;
+            }
+            else {
+                auto file = PACKAGES / PKGNAME.string();
+                file += PKG_SUFX;
+                return file;
+            }
+        }
     };
 
     /** summary is a map from PKGNAME to its variables, obtained by parsing
@@ -52,8 +75,23 @@ namespace pkgxx {
             std::string const& PKG_INFO,
             std::string const& PKG_SUFX);
 
-        /// Merge two summaries into one. The summary \c other will be
-        /// destroyed in the process.
+        /** Obtain a package summary by scanning binary packages in
+         * several repositories. Repositories are loaded concurrently and
+         * earlier ones take precedence per PKGBASE, i.e. every version of
+         * a package comes from the first repository that has any version
+         * of it.
+         */
+        summary(
+            std::ostream& msg,
+            std::ostream& verbose,
+            unsigned concurrency,
+            std::vector<std::filesystem::path> const& repositories,
+            std::string const& PKG_INFO,
+            std::string const& PKG_SUFX);
+
+        /// Merge two summaries into one. Packages already in this summary
+        /// take precedence over the ones in \c other. The summary \c
+        /// other will be destroyed in the process.
         summary&
         operator+= (summary&& other) {
             merge(std::move(other));
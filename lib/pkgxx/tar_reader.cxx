@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string_view>
+
+#include "tar_reader.hxx"
+
+using namespace std::literals;
+
+namespace {
+    constexpr std::size_t const block_size = 512;
+    using block_t = std::array<char, block_size>;
+
+    // Extract a NUL-terminated string from a fixed-size header field.
+    std::string_view
+    field(block_t const& blk, std::size_t offset, std::size_t length) {
+        std::string_view const f(blk.data() + offset, length);
+        return f.substr(0, f.find('\0'));
+    }
+
+    // Parse a numeric header field, which is either octal digits or a
+    // GNU base-256 number.
+    std::uintmax_t
+    numeric_field(block_t const& blk, std::size_t offset, std::size_t length) {
+        auto const* p = reinterpret_cast<unsigned char const*>(blk.data() + offset);
+        std::uintmax_t n = 0;
+        if (p[0] & 0x80) {
+            n = p[0] & 0x7f;
+            for (std::size_t i = 1; i < length; i++) {
+                n = (n << 8) | p[i];
+            }
+        }
+        else {
+            for (std::size_t i = 0; i < length; i++) {
+                if (p[i] >= '0' && p[i] <= '7') {
+                    n = (n << 3) | static_cast<std::uintmax_t>(p[i] - '0');
+                }
+                else if (p[i] == ' ' || p[i] == '\0') {
+                    if (n > 0) {
+                        break;
+                    }
+                }
+                else {
+                    throw pkgxx::bad_tar_archive("Invalid numeric field in a tar header");
+                }
+            }
+        }
+        return n;
+    }
+
+    bool
+    checksum_ok(block_t const& blk) {
+        // The checksum is computed with the checksum field itself filled
+        // with spaces.
+        std::uintmax_t sum = 0;
+        for (std::size_t i = 0; i < block_size; i++) {
+            sum += (i >= 148 && i < 156)
+                ? static_cast<unsigned char>(' ')
+                : static_cast<unsigned char>(blk[i]);
+        }
+        return sum == numeric_field(blk, 148, 8);
+    }
+
+    // Parse pax extended header records "LEN KEY=VALUE\n" and return the
+    // value of "path" if any.
+    std::optional<std::string>
+    pax_path(std::string_view records) {
+        std::optional<std::string> path;
+        while (!records.empty()) {
+            auto const space = records.find(' ');
+            if (space == std::string_view::npos) {
+                break;
+            }
+            std::size_t len = 0;
+            for (char c: records.substr(0, space)) {
+                if (c < '0' || c > '9') {
+                    throw pkgxx::bad_tar_archive("Invalid pax header record");
+                }
+                len = len * 10 + static_cast<std::size_t>(c - '0');
+            }
+            if (len <= space + 1 || len > records.size()) {
+                throw pkgxx::bad_tar_archive("Invalid pax header record");
+            }
+            auto const record = records.substr(space + 1, len - space - 2); // Drop '\n'.
+            if (auto const equal = record.find('='); equal != std::string_view::npos) {
+                if (record.substr(0, equal) == "path"sv) {
+                    path = std::string(record.substr(equal + 1));
+                }
+            }
+            records.remove_prefix(len);
+        }
+        return path;
+    }
+}
+
+namespace pkgxx {
+    void
+    tar_reader::skip_contents() {
+        auto const n = _remaining + _padding;
+        if (n > 0) {
+            _in.ignore(static_cast<std::streamsize>(n));
+            if (static_cast<std::uintmax_t>(_in.gcount()) != n) {
+                throw bad_tar_archive("Premature end of a tar archive");
+            }
+        }
+        _remaining = 0;
+        _padding   = 0;
+    }
+
+    std::string
+    tar_reader::read_contents() {
+        if (_remaining > max_contents_size) {
+            throw bad_tar_archive("A tar archive member is too large to read");
+        }
+        std::string contents(_remaining, '\0');
+        if (_remaining > 0) {
+            _in.read(contents.data(), static_cast<std::streamsize>(_remaining));
+            if (static_cast<std::uintmax_t>(_in.gcount()) != _remaining) {
+                throw bad_tar_archive("Premature end of a tar archive");
+            }
+        }
+        _remaining = 0;
+        return contents;
+    }
+
+    std::optional<tar_entry>
+    tar_reader::next() {
+        std::optional<std::string> long_path;
+        while (true) {
+            skip_contents();
+
+            block_t blk;
+            _in.read(blk.data(), blk.size());
+            if (_in.gcount() == 0) {
+                // Some archivers omit the end-of-archive marker.
+                return {};
+            }
+            else if (static_cast<std::size_t>(_in.gcount()) != blk.size()) {
+                throw bad_tar_archive("Premature end of a tar archive");
+            }
+            else if (std::all_of(blk.begin(), blk.end(), [](char c) { return c == '\0'; })) {
+                return {};
+            }
+            else if (!checksum_ok(blk)) {
+                throw bad_tar_archive("Checksum mismatch in a tar header");
+            }
+
+            tar_entry e;
+            e.size = numeric_field(blk, 124, 12);
+            e.type = blk[156] == '\0' ? '0' : blk[156];
+            if (field(blk, 257, 5) == "ustar"sv) {
+                auto const prefix = field(blk, 345, 155);
+                if (!prefix.empty()) {
+                    e.path  = prefix;
+                    e.path += '/';
+                }
+            }
+            e.path += field(blk, 0, 100);
+
+            _remaining = e.size;
+            _padding   = (block_size - e.size % block_size) % block_size;
+
+            switch (e.type) {
+            case 'L': // GNU long name for the next member.
+            {
+                auto name = read_contents();
+                long_path = name.substr(0, name.find('\0'));
+                continue;
+            }
+            case 'x': // pax extended header for the next member.
+                if (auto path = pax_path(read_contents()); path) {
+                    long_path = std::move(path);
+                }
+                continue;
+            case 'g': // pax global header. We don't need it.
+                continue;
+            default:
+                if (long_path) {
+                    e.path = std::move(*long_path);
+                }
+                return e;
+            }
+        }
+    }
+}
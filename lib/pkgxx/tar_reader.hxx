@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace pkgxx {
+    /** An exception thrown when a tar archive is malformed.
+     */
+    struct bad_tar_archive: virtual std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    /** A header of a member in a tar archive. */
+    struct tar_entry {
+        /// The path of the member, after applying ustar prefixes, GNU long
+        /// names, and pax \c path records.
+        std::string path;
+        /// The size of the member contents in bytes.
+        std::uintmax_t size;
+        /// The type flag, e.g. \c '0' for regular files.
+        char type;
+    };
+
+    /** A minimal sequential reader of tar archives. It understands
+     * ustar, GNU long names, and pax extended headers just enough to
+     * obtain member paths, and it never seeks. This is meant for peeking
+     * at metadata members at the beginning of binary packages without
+     * extracting the entire archive.
+     */
+    struct tar_reader {
+        /** Construct a tar reader reading an uncompressed tar archive from
+         * a given stream.
+         */
+        tar_reader(std::istream& in)
+            : _in(in)
+            , _remaining(0)
+            , _padding(0) {}
+
+        /** Skip the rest of the current member, if any, and return the
+         * header of the next member or \c std::nullopt at the end of the
+         * archive. GNU long name and pax headers are consumed internally
+         * and never returned. Throws \ref bad_tar_archive on malformed
+         * input.
+         */
+        std::optional<tar_entry>
+        next();
+
+        /** The largest member read_contents() accepts. Metadata members
+         * are tiny, so anything bigger is taken as a corrupt archive
+         * rather than something to allocate memory for.
+         */
+        static constexpr std::uintmax_t const max_contents_size = 4 * 1024 * 1024;
+
+        /** Read the entire contents of the current member. Throws \ref
+         * bad_tar_archive if it's larger than \ref max_contents_size.
+         */
+        std::string
+        read_contents();
+
+    private:
+        // Read and discard the rest of the current member.
+        void
+        skip_contents();
+
+        std::istream& _in;
+        std::uintmax_t _remaining; // Unread bytes of the current member.
+        std::uintmax_t _padding;   // Padding after the current member.
+    };
+}
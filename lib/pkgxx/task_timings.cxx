@@ -0,0 +1,83 @@
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+
+#include "line_reader.hxx"
+#include "string_algo.hxx"
+#include "task_timings.hxx"
+#include "tempfile.hxx"
+
+namespace {
+    // The weight of the latest sample in the moving average.
+    constexpr double const alpha = 0.5;
+}
+
+namespace pkgxx {
+    task_timings::task_timings(std::filesystem::path const& file)
+        : _file(file) {
+
+        std::ifstream in(file);
+        if (!in) {
+            return;
+        }
+
+        auto ts = _timings.lock();
+        for (auto const line: line_reader(in)) {
+            auto const sep = line.find(' ');
+            if (sep == std::string_view::npos || sep + 1 == line.size()) {
+                continue;
+            }
+            if (auto const ms = parse_integer<std::uint64_t>(line.substr(0, sep)); ms) {
+                (*ts)[std::string(line.substr(sep + 1))] =
+                    entry { std::chrono::milliseconds(*ms), false };
+            }
+        }
+    }
+
+    std::optional<task_timings::duration>
+    task_timings::expected(std::string const& name) const {
+        auto ts = _timings.lock();
+        if (auto it = ts->find(name); it != ts->end()) {
+            return it->second.d;
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
+    void
+    task_timings::record(std::string const& name, duration d) {
+        auto ts = _timings.lock();
+        if (auto [it, emplaced] = ts->emplace(name, entry { d, true }); !emplaced) {
+            it->second.d        = alpha * d + (1 - alpha) * it->second.d;
+            it->second.recorded = true;
+        }
+    }
+
+    task_timings::duration
+    task_timings::mean(std::map<std::string, entry> const& ts) {
+        if (ts.empty()) {
+            return duration::zero();
+        }
+        duration sum = duration::zero();
+        for (auto const& [_name, e]: ts) {
+            sum += e.d;
+        }
+        return sum / ts.size();
+    }
+
+    void
+    task_timings::save() const {
+        replace_file(
+            _file,
+            [&](std::ostream& out) {
+                auto ts = _timings.lock();
+                for (auto const& [name, e]: *ts) {
+                    if (e.recorded) {
+                        out << std::chrono::duration_cast<std::chrono::milliseconds>(e.d).count()
+                            << ' ' << name << '\n';
+                    }
+                }
+            });
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <pkgxx/mutex_guard.hxx>
+
+namespace pkgxx {
+    /** Historical durations of named tasks, persisted across runs in a
+     * small text file. Each line of the file is a duration in
+     * milliseconds followed by a space and a task name:
+     *
+     * \verbatim
+     * 12500 lang/python311
+     * 840 devel/gmake
+     * \endverbatim
+     *
+     * Recorded durations are smoothed with an exponential moving average
+     * so that a single outlier doesn't dominate. Only tasks recorded in
+     * the current run are saved, so tasks that no longer exist don't
+     * stay in the file forever. All the member functions are
+     * thread-safe.
+     */
+    struct task_timings {
+        using duration = std::chrono::duration<double>;
+
+        /** Load timings from a given file. A missing or malformed file
+         * results in no timings, as they are only a hint.
+         */
+        task_timings(std::filesystem::path const& file);
+
+        /** Return the expected duration of a task, or \c std::nullopt if
+         * it has never been recorded.
+         */
+        std::optional<duration>
+        expected(std::string const& name) const;
+
+        /// Record the duration of a task that has just finished.
+        void
+        record(std::string const& name, duration d);
+
+        /** Sort task names in descending order of their expected
+         * durations, i.e. the longest processing time first. Tasks that
+         * have never been recorded are assumed to take the mean duration
+         * of known ones. The sort is stable.
+         */
+        template <typename Container>
+        std::vector<typename Container::value_type>
+        longest_first(Container const& names) const {
+            std::vector<typename Container::value_type> ret(names.begin(), names.end());
+            std::vector<std::pair<duration, std::size_t>> keys;
+            {
+                auto ts = _timings.lock();
+                auto const fallback = mean(*ts);
+                for (std::size_t i = 0; i < ret.size(); i++) {
+                    std::ostringstream ss;
+                    ss << ret[i];
+                    auto const it = ts->find(ss.str());
+                    keys.emplace_back(it != ts->end() ? it->second.d : fallback, i);
+                }
+            }
+            std::stable_sort(
+                keys.begin(), keys.end(),
+                [](auto const& a, auto const& b) {
+                    return a.first > b.first;
+                });
+
+            std::vector<typename Container::value_type> sorted;
+            sorted.reserve(ret.size());
+            for (auto const& [_d, i]: keys) {
+                sorted.push_back(std::move(ret[i]));
+            }
+            return sorted;
+        }
+
+        /** Write the timings of tasks recorded in this run back to the
+         * file it was loaded from, creating its parent directory if
+         * needed. The file is replaced atomically.
+         */
+        void
+        save() const;
+
+    private:
+        struct entry {
+            duration d;
+            bool recorded; // True if recorded in this run.
+        };
+
+        [[gnu::pure]] static duration
+        mean(std::map<std::string, entry> const& ts);
+
+        std::filesystem::path _file;
+        mutable guarded<std::map<std::string, entry>> _timings;
+    };
+}
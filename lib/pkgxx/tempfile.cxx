@@ -1,6 +1,8 @@
 #include <cerrno>
+#include <fstream>
 #include <system_error>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "tempfile.hxx"
 
@@ -46,4 +48,31 @@ namespace pkgxx {
             fs::remove(path);
         }
     }
+
+    void
+    replace_file(std::filesystem::path const& file,
+                 std::function<void (std::ostream&)> const& write) {
+        if (file.has_parent_path()) {
+            fs::create_directories(file.parent_path());
+        }
+
+        auto tmp_path = file;
+        tmp_path += ".tmp." + std::to_string(getpid());
+        try {
+            std::ofstream out(tmp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            if (!out) {
+                throw std::system_error(
+                    errno, std::generic_category(), "Failed to open " + tmp_path.string());
+            }
+            out.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+            write(out);
+            out.close();
+        }
+        catch (...) {
+            std::error_code ec;
+            fs::remove(tmp_path, ec);
+            throw;
+        }
+        fs::rename(tmp_path, file);
+    }
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <ostream>
 #include <tuple>
 
 #include <pkgxx/fdstream.hxx>
@@ -40,4 +42,16 @@ namespace pkgxx {
             unlink_mode ul_mode_,
             std::tuple<std::filesystem::path, fdstream>&& tmp);
     };
+
+    /** Replace the contents of a file atomically with what a given
+     * function writes to a stream, creating its parent directory if
+     * needed. The contents are first written to a temporary file \c
+     * FILE.tmp.PID in the same directory and then renamed, so readers
+     * never see a partially written file. When two processes replace the
+     * same file at the same time, the last one wins. If the function
+     * throws, the file is left untouched.
+     */
+    void
+    replace_file(std::filesystem::path const& file,
+                 std::function<void (std::ostream&)> const& write);
 }
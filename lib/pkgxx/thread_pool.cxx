@@ -0,0 +1,139 @@
+#include <algorithm>
+
+#include "thread_pool.hxx"
+
+namespace {
+    // The index of the worker running on the current thread, or
+    // std::nullopt if this thread isn't a worker.
+    thread_local std::optional<std::size_t> current_worker;
+}
+
+namespace pkgxx {
+    thread_pool::thread_pool()
+        : _workers(std::make_unique<std::unique_ptr<worker>[]>(max_workers))
+        , _num_workers(0)
+        , _num_queued(0) {}
+
+    thread_pool&
+    thread_pool::instance() {
+        // Intentionally leaked. Workers never terminate, so destroying
+        // the pool at exit would only race with them.
+        static thread_pool* const pool = new thread_pool();
+        return *pool;
+    }
+
+    bool
+    thread_pool::in_worker() noexcept {
+        return current_worker.has_value();
+    }
+
+    void
+    thread_pool::reserve(std::size_t n) {
+        n = std::min(n, max_workers);
+        if (_num_workers.load(std::memory_order_acquire) >= n) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lk(_grow_mtx);
+        for (auto i = _num_workers.load(std::memory_order_relaxed); i < n; i++) {
+            _workers[i] = std::make_unique<worker>();
+            // Publish the worker before starting its thread so that
+            // others can steal from it.
+            _num_workers.store(i + 1, std::memory_order_release);
+            std::thread(&thread_pool::worker_main, this, i).detach();
+        }
+    }
+
+    void
+    thread_pool::submit(job&& j) {
+        // Count the job before making it visible, so that the counter
+        // never goes below the actual number of queued jobs.
+        _num_queued.fetch_add(1, std::memory_order_release);
+        if (current_worker) {
+            auto& w = *_workers[*current_worker];
+            std::lock_guard<std::mutex> lk(w.mtx);
+            w.jobs.push_back(std::move(j));
+        }
+        else {
+            std::lock_guard<std::mutex> lk(_inject_mtx);
+            _injected.push_back(std::move(j));
+        }
+
+        // Lock the mutex once so that a worker which has just seen
+        // _num_queued == 0 is guaranteed to be waiting on the condvar by
+        // the time we notify it.
+        { std::lock_guard<std::mutex> lk(_sleep_mtx); }
+        _wake.notify_one();
+    }
+
+    std::optional<job>
+    thread_pool::pop_from(std::mutex& mtx, std::deque<job>& jobs, bool steal) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (jobs.empty()) {
+            return {};
+        }
+        else if (steal) {
+            job j = std::move(jobs.front());
+            jobs.pop_front();
+            return j;
+        }
+        else {
+            job j = std::move(jobs.back());
+            jobs.pop_back();
+            return j;
+        }
+    }
+
+    std::optional<job>
+    thread_pool::try_pop() {
+        if (_num_queued.load(std::memory_order_acquire) == 0) {
+            return {};
+        }
+
+        auto const n = _num_workers.load(std::memory_order_acquire);
+        std::optional<job> j;
+        if (current_worker) {
+            auto& w = *_workers[*current_worker];
+            j = pop_from(w.mtx, w.jobs, false);
+        }
+        if (!j) {
+            j = pop_from(_inject_mtx, _injected, true);
+        }
+        if (!j) {
+            // Steal from others, starting from our neighbour so that
+            // thieves don't all contend for the same victim.
+            auto const start = current_worker ? *current_worker + 1 : 0;
+            for (std::size_t k = 0; k < n && !j; k++) {
+                auto const victim = (start + k) % n;
+                if (current_worker && victim == *current_worker) {
+                    continue;
+                }
+                auto& w = *_workers[victim];
+                j = pop_from(w.mtx, w.jobs, true);
+            }
+        }
+
+        if (j) {
+            _num_queued.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        return j;
+    }
+
+    void
+    thread_pool::worker_main(std::size_t idx) {
+        current_worker = idx;
+        while (true) {
+            if (auto j = try_pop(); j) {
+                (*j)();
+            }
+            else {
+                std::unique_lock<std::mutex> lk(_sleep_mtx);
+                _wake.wait(
+                    lk,
+                    [this]() {
+                        return _num_queued.load(std::memory_order_acquire) > 0;
+                    });
+            }
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace pkgxx {
+    /** A move-only type-erased nullary function. Unlike \c
+     * std::function, it can hold move-only callables, and calling it
+     * costs a single virtual call.
+     */
+    struct job {
+        job() = default;
+
+        template <typename Function,
+                  typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, job>>>
+        job(Function&& f)
+            : _impl(std::make_unique<impl<std::decay_t<Function>>>(std::forward<Function>(f))) {}
+
+        job(job&&) = default;
+        job& operator= (job&&) = default;
+
+        /// Invoke the function. This must be called at most once.
+        void
+        operator() () {
+            (*_impl)();
+        }
+
+        /// Return true if the job has a function.
+        explicit operator bool () const noexcept {
+            return static_cast<bool>(_impl);
+        }
+
+    private:
+        struct base {
+            virtual ~base() = default;
+            virtual void operator() () = 0;
+        };
+
+        template <typename Function>
+        struct impl: base {
+            impl(Function&& f): _f(std::move(f)) {}
+            impl(Function const& f): _f(f) {}
+
+            virtual void
+            operator() () override {
+                _f();
+            }
+
+        private:
+            Function _f;
+        };
+
+        std::unique_ptr<base> _impl;
+    };
+
+    /** A process-wide pool of worker threads with per-worker deques and
+     * work stealing. A job submitted from a worker goes to the back of
+     * its own deque and is popped in LIFO order by that worker, while idle
+     * workers steal from the front of other deques. Jobs submitted from
+     * other threads go to a shared injection queue.
+     *
+     * The pool starts with no threads and grows on demand via \ref
+     * reserve(). It never shrinks, and it's never destroyed.
+     */
+    struct thread_pool {
+        /// The maximum number of worker threads.
+        static constexpr std::size_t const max_workers = 256;
+
+        /// Return the process-wide instance.
+        static thread_pool&
+        instance();
+
+        /** Make sure the pool has at least \c n worker threads, capped by
+         * \ref max_workers.
+         */
+        void
+        reserve(std::size_t n);
+
+        /// Schedule a job to be run by some worker. Jobs must not throw.
+        void
+        submit(job&& j);
+
+        /// Return true if the calling thread is a worker of this pool.
+        [[gnu::pure]] static bool
+        in_worker() noexcept;
+
+        thread_pool(thread_pool const&) = delete;
+        thread_pool& operator= (thread_pool const&) = delete;
+
+    private:
+        thread_pool();
+
+        struct worker {
+            std::mutex mtx;
+            std::deque<job> jobs; // Guarded by mtx.
+        };
+
+        [[noreturn]] void
+        worker_main(std::size_t idx);
+
+        // Pop a job that is ready to run, preferring the calling worker's
+        // own deque, or return std::nullopt if there are none.
+        std::optional<job>
+        try_pop();
+
+        // Pop a job from the back of a deque, or from the front if we
+        // are stealing.
+        static std::optional<job>
+        pop_from(std::mutex& mtx, std::deque<job>& jobs, bool steal);
+
+        std::unique_ptr<std::unique_ptr<worker>[]> _workers;
+        std::atomic<std::size_t> _num_workers;
+        std::mutex _grow_mtx;
+
+        std::mutex _inject_mtx;
+        std::deque<job> _injected; // Guarded by _inject_mtx.
+
+        // The number of jobs sitting in any of the queues. Idle workers
+        // sleep while this is zero.
+        std::atomic<std::size_t> _num_queued;
+        std::mutex _sleep_mtx;
+        std::condition_variable _wake;
+    };
+}
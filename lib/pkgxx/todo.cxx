@@ -4,6 +4,7 @@
 #include <regex>
 #include <string>
 
+#include "line_reader.hxx"
 #include "todo.hxx"
 
 namespace {
@@ -23,9 +24,9 @@ namespace pkgxx {
         }
         in.exceptions(std::ios_base::badbit);
 
-        for (std::string line; std::getline(in, line); ) {
-            std::match_results<std::string::const_iterator> m;
-            if (std::regex_match(line, m, RE_PACKAGE_TODO)) {
+        std::match_results<std::string_view::const_iterator> m;
+        for (auto const line: line_reader(in)) {
+            if (std::regex_match(line.begin(), line.end(), m, RE_PACKAGE_TODO)) {
                 pkgbase     base(m[1]);
                 pkgversion  version(m[2]);
                 std::string comment(m[3]);
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "www_cache.hxx"
+
+namespace fs = std::filesystem;
+
+namespace {
+    struct url_deleter {
+        void
+        operator() (struct url* u) const {
+            fetchFreeURL(u);
+        }
+    };
+
+    struct fetchIO_deleter {
+        void
+        operator() (fetchIO* fio) const {
+            fetchIO_close(fio);
+        }
+    };
+
+    // Turn a URL into a file name by percent-encoding everything but
+    // alphanumerics, '-', and '.'. This is injective so distinct URLs
+    // never share a cached copy.
+    std::string
+    cache_name(std::string const& url) {
+        std::ostringstream ss;
+        ss << std::hex << std::uppercase << std::setfill('0');
+        for (char const c: url) {
+            if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                (c >= '0' && c <= '9') || c == '-' || c == '.') {
+                ss << c;
+            }
+            else {
+                ss << '%' << std::setw(2) << static_cast<unsigned>(static_cast<unsigned char>(c));
+            }
+        }
+        return ss.str();
+    }
+}
+
+namespace pkgxx {
+    std::filesystem::path
+    cache_path(std::string const& url, std::filesystem::path const& dir) {
+        return dir / cache_name(url);
+    }
+
+    std::filesystem::path
+    fetch_cached(std::string const& url, std::filesystem::path const& dir) {
+        std::unique_ptr<struct url, url_deleter> u(fetchParseURL(url.c_str()));
+        if (!u) {
+            throw remote_file_error("invalid URL: " + url);
+        }
+
+        auto const file = cache_path(url, dir);
+        char const* flags = "";
+        if (struct stat st; stat(file.c_str(), &st) == 0 && st.st_mtime > 0) {
+            // Send If-Modified-Since.
+            u->last_modified = st.st_mtime;
+            flags = "i";
+        }
+
+        struct url_stat us = {};
+        std::unique_ptr<fetchIO, fetchIO_deleter> fio;
+        {
+            // An unchanged file is reported as a failure, which is the
+            // common case. Classify it right away instead of retrying.
+            std::unique_lock<std::shared_mutex> lk(detail::fetch_error_mutex());
+            fio.reset(fetchXGet(u.get(), &us, flags));
+            if (!fio) {
+                switch (fetchLastErrCode) {
+                case FETCH_UNCHANGED:
+                    return file;
+
+                case FETCH_UNAVAIL: {
+                    std::error_code ec;
+                    fs::remove(file, ec);
+                    throw remote_file_unavailable("file not available: " + url);
+                }
+                default:
+                    throw remote_file_error(fetchLastErrString);
+                }
+            }
+        }
+
+        // Download to a temporary file so that an interrupted transfer
+        // never leaves a truncated copy behind.
+        auto tmp = file;
+        tmp += ".tmp." + std::to_string(getpid());
+        try {
+            {
+                std::ofstream out(tmp, std::ios_base::out | std::ios_base::binary);
+                if (!out) {
+                    throw remote_file_error("failed to create " + tmp.string());
+                }
+                out.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+                std::vector<char> buf(wwwstreambuf::default_buf_size);
+                while (true) {
+                    ssize_t const n_read = fetchIO_read(fio.get(), buf.data(), buf.size());
+                    if (n_read > 0) {
+                        out.write(buf.data(), n_read);
+                    }
+                    else if (n_read == 0) {
+                        break;
+                    }
+                    else {
+                        // The error may have been overwritten by now.
+                        throw remote_file_error("failed to download " + url);
+                    }
+                }
+            }
+
+            // Record Last-Modified, or the epoch if unknown so that the
+            // next call won't send If-Modified-Since.
+            struct timespec const times[2] = {
+                {0, UTIME_OMIT},
+                {us.mtime > 0 ? us.mtime : 0, 0}
+            };
+            utimensat(AT_FDCWD, tmp.c_str(), times, 0);
+            fs::rename(tmp, file);
+        }
+        catch (...) {
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            throw;
+        }
+        return file;
+    }
+}
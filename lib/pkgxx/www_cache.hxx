@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include <pkgxx/wwwstream.hxx>
+
+namespace pkgxx {
+    /** Download a URL into a cache directory unless the cached copy is
+     * up to date, and return the path to the cached copy.
+     *
+     * The modification time of a cached file is set to the \c
+     * Last-Modified time reported by the server, and it's sent back as \c
+     * If-Modified-Since on the next call so that an unchanged file isn't
+     * transferred again. A file the server reports no modification time
+     * for is downloaded every time. libfetch doesn't expose \c ETag so it
+     * isn't used.
+     *
+     * The directory must already exist. Throws \ref
+     * remote_file_unavailable if the resource doesn't exist, in which
+     * case its cached copy is also removed, or \ref remote_file_error on
+     * other failures.
+     */
+    std::filesystem::path
+    fetch_cached(std::string const& url, std::filesystem::path const& dir);
+
+    /** Return the path where \ref fetch_cached() keeps the cached copy
+     * of a URL. The file may not exist.
+     */
+    std::filesystem::path
+    cache_path(std::string const& url, std::filesystem::path const& dir);
+}
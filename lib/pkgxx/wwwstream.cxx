@@ -1,21 +1,59 @@
 #include <cerrno>
+#include <mutex>
 
 #include "wwwstream.hxx"
 
 namespace pkgxx {
-    wwwstreambuf::wwwstreambuf(std::string const& url) {
-        if (fetchIO* fio = fetchGetURL(url.c_str(), ""); fio != nullptr) {
-            _fio = std::unique_ptr<fetchIO, fetchIO_deleter>(fio);
+    namespace detail {
+        std::shared_mutex&
+        fetch_error_mutex() {
+            static std::shared_mutex m;
+            return m;
         }
-        else {
-            // This is obviously thread-unsafe. We may have to change the
-            // backend to libcurl.
-            switch (fetchLastErrCode) {
-                case FETCH_UNAVAIL:
-                    throw remote_file_unavailable("file not available: " + url);
+    }
+
+    std::optional<remote_file_stat>
+    stat_remote_file(std::string const& url) {
+        struct url_stat us = {};
+        us.size = -1;
+        {
+            std::shared_lock<std::shared_mutex> lk(detail::fetch_error_mutex());
+            if (fetchStatURL(url.c_str(), &us, "") != 0) {
+                return std::nullopt;
+            }
+        }
+
+        remote_file_stat st;
+        if (us.mtime > 0) {
+            st.mtime = us.mtime;
+        }
+        if (us.size >= 0) {
+            st.size = us.size;
+        }
+        return st;
+    }
+
+    wwwstreambuf::wwwstreambuf(std::string const& url, std::size_t buf_size)
+        : _buf_size(buf_size) {
+
+        {
+            std::shared_lock<std::shared_mutex> lk(detail::fetch_error_mutex());
+            _fio.reset(fetchGetURL(url.c_str(), ""));
+        }
+        if (!_fio) {
+            // Failures are rare, so retry alone rather than serialising
+            // every request. Nobody can overwrite the error until we have
+            // read it.
+            std::unique_lock<std::shared_mutex> lk(detail::fetch_error_mutex());
+            _fio.reset(fetchGetURL(url.c_str(), ""));
+            if (!_fio) {
+                switch (fetchLastErrCode) {
+                    case FETCH_UNAVAIL:
+                        throw remote_file_unavailable("file not available: " + url);
 
-                default:
-                    throw remote_file_error(fetchLastErrString);
+                    default:
+                        throw remote_file_error(fetchLastErrString);
+                }
             }
         }
     }
@@ -26,7 +64,7 @@ namespace pkgxx {
         if (eback() == nullptr) {
             // An underflow has happened because we haven't allocated a
             // buffer yet.
-            _read_buf = buffer_t();
+            _read_buf = buffer_t(_buf_size);
         }
 
         while (true) {
@@ -1,12 +1,16 @@
 #pragma once
 
-#include <array>
+#include <cstddef>
+#include <ctime>
 #include <exception>
 #include <istream>
 #include <memory>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 #include <streambuf>
+#include <sys/types.h>
+#include <vector>
 #include <fetch.h>
 
 namespace pkgxx {
@@ -18,10 +22,46 @@ namespace pkgxx {
         using remote_file_error::remote_file_error;
     };
 
+    /** Metadata of a remote file. */
+    struct remote_file_stat {
+        /// The modification time, if the server reports one.
+        std::optional<std::time_t> mtime;
+        /// The size in bytes, if the server reports one.
+        std::optional<off_t> size;
+    };
+
+    namespace detail {
+        // libfetch reports errors via global variables, so concurrent
+        // requests would overwrite each other's errors. A request whose
+        // failure is going to be classified holds this mutex exclusively
+        // until the error has been read. Requests that don't look at the
+        // error hold it shared so that they can run in parallel.
+        std::shared_mutex&
+        fetch_error_mutex();
+    }
+
+    /** Query the metadata of a remote file without transferring its
+     * content, i.e. with a \c HEAD request for HTTP. Return \c
+     * std::nullopt if the file doesn't exist or can't be queried for
+     * whatever reason. The reason isn't reported so that queries can run
+     * in parallel.
+     */
+    std::optional<remote_file_stat>
+    stat_remote_file(std::string const& url);
+
     /** Currently only supports reading operations. */
     struct wwwstreambuf: public std::streambuf {
-        /// Construct a stream buffer that reads data from a URL.
-        wwwstreambuf(std::string const& url);
+        /// The default size of the read buffer.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
+        /** Construct a stream buffer that reads data from a URL. Throws
+         * \ref remote_file_unavailable if the resource doesn't exist, or
+         * \ref remote_file_error on other failures. Requests are made in
+         * parallel, and a failed one is retried alone to find out why it
+         * failed.
+         */
+        wwwstreambuf(std::string const& url,
+                     std::size_t buf_size = default_buf_size);
 
     protected:
 #if !defined(DOXYGEN)
@@ -40,9 +80,9 @@ namespace pkgxx {
             }
         };
 
-        static constexpr int const buf_size = 1024;
-        using buffer_t = std::array<char_type, buf_size>;
+        using buffer_t = std::vector<char_type>;
 
+        std::size_t _buf_size;
         std::unique_ptr<fetchIO, fetchIO_deleter> _fio;
         std::optional<buffer_t> _read_buf;
     };
@@ -51,9 +91,10 @@ namespace pkgxx {
      */
     struct wwwistream: public std::istream {
         /// Construct an input stream that reads data from a URL.
-        wwwistream(std::string const& url)
+        wwwistream(std::string const& url,
+                   std::size_t buf_size = wwwstreambuf::default_buf_size)
             : std::istream(nullptr)
-            , _buf(std::make_unique<wwwstreambuf>(url)) {
+            , _buf(std::make_unique<wwwstreambuf>(url, buf_size)) {
 
             rdbuf(_buf.get());
         }
@@ -0,0 +1,81 @@
+#include <unistd.h>
+
+#include "xargs_fold.hxx"
+
+extern char** environ;
+
+namespace {
+    // Room left for whatever the kernel and the dynamic linker put in the
+    // argument area besides argv and envp, such as auxv and the path to
+    // the executable. POSIX recommends applications leave 2048 bytes.
+    constexpr std::size_t const headroom = 4096;
+
+    // Used when sysconf(3) doesn't know ARG_MAX. This is the minimum
+    // POSIX guarantees.
+    constexpr std::size_t const fallback_arg_max = 4096;
+}
+
+namespace pkgxx::detail {
+    std::size_t
+    xargs_arg_budget(std::vector<std::string> const& cmd) {
+        long const arg_max = sysconf(_SC_ARG_MAX);
+        std::size_t used = headroom;
+
+        for (char** env = environ; *env; env++) {
+            used += xargs_arg_size(*env);
+        }
+        for (auto const& arg: cmd) {
+            used += xargs_arg_size(arg);
+        }
+
+        auto const total = arg_max > 0 ? static_cast<std::size_t>(arg_max) : fallback_arg_max;
+        // Always leave room for at least one argument, even if the
+        // environment is insanely large. exec(2) will tell us if it
+        // doesn't fit.
+        return total > used ? total - used : 1;
+    }
+
+    std::vector<std::vector<std::string>>
+    xargs_batches(std::vector<std::string>&& args,
+                  std::size_t arg_budget,
+                  unsigned int concurrency,
+                  std::optional<unsigned int> batch_size) {
+
+        std::size_t total = 0;
+        for (auto const& arg: args) {
+            total += xargs_arg_size(arg);
+        }
+        // Each batch but the last takes at least this many bytes, so
+        // there will be at most "concurrency" batches unless ARG_MAX or
+        // batch_size says otherwise.
+        std::size_t const share = (total + concurrency - 1) / concurrency;
+
+        std::vector<std::vector<std::string>> batches;
+        std::vector<std::string> batch;
+        std::size_t bytes = 0; // The size of batch for exec(2).
+        auto const flush =
+            [&]() {
+                batches.push_back(std::move(batch));
+                batch.clear();
+                bytes = 0;
+            };
+        for (auto& arg: args) {
+            auto const size = xargs_arg_size(arg);
+            if (!batch.empty() && bytes + size > arg_budget) {
+                flush();
+            }
+            // A single argument exceeding the budget gets its own batch,
+            // and exec(2) will report E2BIG for it.
+            batch.push_back(std::move(arg));
+            bytes += size;
+
+            if (bytes >= share || (batch_size && batch.size() >= *batch_size)) {
+                flush();
+            }
+        }
+        if (!batch.empty()) {
+            flush();
+        }
+        return batches;
+    }
+}
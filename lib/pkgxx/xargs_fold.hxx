@@ -1,191 +1,158 @@
 #pragma once
 
 #include <algorithm>
-#include <exception>
 #include <cassert>
-#include <condition_variable>
-#include <deque>
+#include <cstddef>
+#include <exception>
 #include <istream>
-#include <mutex>
-#include <set>
+#include <optional>
+#include <string>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
-#include <pkgxx/config.h>
 #include <pkgxx/harness.hxx>
-#include <pkgxx/permissive_shared_ptr.hxx>
+#include <pkgxx/mutex_guard.hxx>
+#include <pkgxx/nursery.hxx>
 
 namespace pkgxx {
     namespace detail {
-        template <typename Parse>
-        struct xargs_nursery {
-        private:
-            using mutex_t   = std::recursive_mutex;
-            using lock_t    = std::lock_guard<mutex_t>;
-            using condvar_t = std::condition_variable_any;
-
-        public:
-            struct split_sink {
-                split_sink(xargs_nursery& parent)
-                    : _parent(parent)
-                    , _lk(parent._mtx)
-                    , _next_child(0) {}
-
-                ~split_sink() {
-                    _parent.split_done();
-                }
-
-                void
-                push_back(std::string const& arg) {
-                    _parent._harnesses[_next_child]->cin() << arg << '\0';
-                    _next_child = (_next_child + 1) % _parent._harnesses.size();
-                }
+        // Return the number of bytes available for additional arguments
+        // to a command, taking ARG_MAX, the environment, and the command
+        // itself into account.
+        std::size_t
+        xargs_arg_budget(std::vector<std::string> const& cmd);
+
+        // The number of bytes an argument takes in the argument area of
+        // exec(2): the string, its terminator, and a pointer in argv.
+        inline std::size_t
+        xargs_arg_size(std::string const& arg) {
+            return arg.size() + 1 + sizeof(char*);
+        }
+
+        // Divide arguments into batches. See xargs_fold() for details.
+        std::vector<std::vector<std::string>>
+        xargs_batches(std::vector<std::string>&& args,
+                      std::size_t arg_budget,
+                      unsigned int concurrency,
+                      std::optional<unsigned int> batch_size);
+
+        // Collects arguments produced by the split function of
+        // xargs_fold().
+        struct xargs_sink {
+            void
+            push_back(std::string const& arg) {
+                args.push_back(arg);
+            }
 
-            private:
-                // We can lock the parent during the entire lifetime of
-                // split_sink because readers (i.e. parser threads) only
-                // needs to lock it at their very end.
-                xargs_nursery& _parent;
-                xargs_nursery::lock_t _lk;
-                std::vector<harness>::size_type _next_child;
-            };
+            std::vector<std::string>& args;
+        };
 
+        template <typename Parse>
+        struct xargs_batcher {
             static_assert(std::is_invocable_v<Parse, std::istream&>);
-            using result_type = std::invoke_result_t<Parse, std::istream&>;
+            using result_type = std::decay_t<std::invoke_result_t<Parse, std::istream&>>;
             static_assert(std::is_default_constructible_v<result_type>);
             // result_type must also form a commutative monoid under its
             // default constructor and operator+=.
 
-            xargs_nursery(std::vector<std::string> const& cmd,
-                          Parse&& parse,
-                          unsigned int concurrency) {
-                lock_t lk(_mtx);
-
-                std::vector<std::string> argv = {CFG_XARGS, "-r", "-0"};
-                argv.insert(argv.end(), cmd.begin(), cmd.end());
-
-                for (unsigned int i = 0; i < concurrency; i++) {
-                    _harnesses.push_back(make_permissive_shared<harness>(CFG_XARGS, argv));
-
-                    std::thread parser(
-                        [this, &parse, i]() {
-                            try {
-                                // We cannot bring the harness from outside
-                                // of this lambda, because then the
-                                // destructor of the lambda itself becomes
-                                // noexcept(false), which violates the
-                                // expectation of std::thread.
-                                permissive_shared_ptr<harness> xargs;
-                                {
-                                    lock_t lk_(_mtx);
-                                    xargs = _harnesses[i];
-                                }
-
-                                // Don't lock the mutex while parsing the
-                                // stdout of the commands. That would
-                                // prevent the parallelisation which is the
-                                // whole point of this entire machinery.
-                                auto result = parse(xargs->cout());
-                                // But this is technically unsafe because
-                                // we are touching the harness from two
-                                // threads. This is fine only because we
-                                // don't actually mutate the state of
-                                // harness once it's created.
-
-                                lock_t lk_(_mtx);
-                                _running_parsers.erase(std::this_thread::get_id());
-                                _result += std::move(result);
-                            }
-                            catch (...) {
-                                lock_t lk_(_mtx);
-                                _running_parsers.erase(std::this_thread::get_id());
-                                if (!_ex) {
-                                    _ex = std::current_exception();
-                                }
-                            }
-                            _finished.notify_one();
-                        });
-                    _running_parsers.insert(parser.get_id());
-                    _parsers.push_back(std::move(parser));
-                }
-            }
+            xargs_batcher(std::vector<std::string> const& cmd,
+                          Parse const& parse)
+                : _cmd(cmd)
+                , _parse(parse) {}
 
-            ~xargs_nursery() {
-                for (auto& p: _parsers) {
-                    p.join();
+            // Run every batch on a given nursery.
+            void
+            start(nursery& n, std::vector<std::vector<std::string>>&& batches) {
+                for (auto& batch: batches) {
+                    n.start_soon(
+                        [this, batch = std::move(batch)]() {
+                            run_batch(batch);
+                        });
                 }
             }
 
-            // This method must not be called twice.
-            split_sink
-            sink() {
-                return split_sink(*this);
-            }
-
-            // This method must not be called twice.
+            // Take the result out. This must be called after the nursery
+            // is destroyed.
             result_type
-            await() {
-                std::unique_lock<mutex_t> lk(_mtx);
-
-                while (!_running_parsers.empty()) {
-                    _finished.wait(lk);
-
-                    // The parser thread might have thrown an exception at
-                    // this point, i.e. _ex might be set to non-empty
-                    // now. We can rethrow it now, but we don't, because
-                    // ~xargs_nursery() still needs to join all the
-                    // threads.
-                }
-
-                if (_ex) {
-                    std::rethrow_exception(_ex);
-                }
-                else {
-                    return std::move(_result);
-                }
+            result() {
+                return std::move(*_result.lock());
             }
 
         private:
             void
-            split_done() {
-                lock_t lk(_mtx);
-
-                for (auto& child: _harnesses) {
-                    child->cin().close();
-                }
+            run_batch(std::vector<std::string> const& args) {
+                std::vector<std::string> argv(_cmd);
+                argv.insert(argv.end(), args.begin(), args.end());
+
+                // Kill the process if parsing fails, since it may be
+                // blocked on writing output nobody reads.
+                harness cmd(
+                    _cmd.front(), argv,
+                    "dtor_action"_na = harness::dtor_action::kill);
+                cmd.cin().close();
+
+                auto result = _parse(cmd.cout());
+                // A failure is attributed to this batch alone, as the
+                // exception carries the arguments of this very command.
+                cmd.wait_success();
+
+                *_result.lock() += std::move(result);
             }
 
-            mutex_t _mtx;
-            std::vector<permissive_shared_ptr<harness>> _harnesses;
-            std::vector<std::thread> _parsers;
-            std::set<std::thread::id> _running_parsers;
-            result_type _result;
-            std::exception_ptr _ex;
-            condvar_t _finished; // Signaled when a parser finishes running.
+            std::vector<std::string> const _cmd;
+            std::decay_t<Parse> const _parse;
+            guarded<result_type> _result;
         };
     }
 
-    /** Spawn several instances of xargs(1), let a function \c split feed
-     * them arguments in a round-robin manner, and then let a function \c
-     * parse the output and produce a result. The result type of the
-     * function \c parse must form a commutative monoid under its default
-     * constructor and \c operator+=. */
+    /** Let a function \c split produce arguments, run a command \c cmd on
+     * batches of them just like xargs(1) does, and then let a function \c
+     * parse the output of each invocation and produce a result. The
+     * result type of the function \c parse must form a commutative monoid
+     * under its default constructor and \c operator+=.
+     *
+     * Arguments are spread over up to \c concurrency invocations running
+     * in parallel on a \ref nursery, like running that many xargs(1)
+     * would. A batch is also limited by \c ARG_MAX, and by \c batch_size
+     * arguments if given. More batches than \c concurrency balance the
+     * load better when some arguments take much longer than others, at
+     * the cost of spawning the command more often, so give \c batch_size
+     * only when that's the case. No command is run if \c split produces
+     * no arguments.
+     *
+     * If any invocation of the command fails, the exception thrown by
+     * \ref harness for that particular invocation is rethrown.
+     */
     template <typename Split, typename Parse>
-    typename detail::xargs_nursery<Parse>::result_type
+    typename detail::xargs_batcher<Parse>::result_type
     xargs_fold(std::vector<std::string> const& cmd,
                Split&& split,
                Parse&& parse,
-               unsigned int concurrency = std::max(1u, std::thread::hardware_concurrency())) {
+               unsigned int concurrency = std::max(1u, std::thread::hardware_concurrency()),
+               std::optional<unsigned int> batch_size = std::nullopt) {
 
-        static_assert(
-            std::is_invocable_v<
-                Split,
-                typename detail::xargs_nursery<Parse>::split_sink&&>);
+        static_assert(std::is_invocable_v<Split, detail::xargs_sink&&>);
 
+        assert(!cmd.empty());
         assert(concurrency > 0);
-        auto nursery = detail::xargs_nursery(cmd, parse, concurrency);
-        split(nursery.sink());
-        return nursery.await();
+        assert(!batch_size || *batch_size > 0);
+
+        // All the arguments have to be known to divide them evenly.
+        std::vector<std::string> args;
+        split(detail::xargs_sink {args});
+
+        detail::xargs_batcher<Parse> batcher(cmd, parse);
+        {
+            // Destroying the nursery waits for every batch and rethrows
+            // the first exception if any.
+            nursery n(concurrency);
+            batcher.start(
+                n,
+                detail::xargs_batches(
+                    std::move(args), detail::xargs_arg_budget(cmd), concurrency, batch_size));
+        }
+        return batcher.result();
     }
 }
@@ -0,0 +1,150 @@
+#include "xzstream.hxx"
+
+#if defined(HAVE_LZMA)
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    std::runtime_error
+    lzma_exception(lzma_ret code) {
+        switch (code) {
+        case LZMA_MEM_ERROR:
+            return std::runtime_error("LZMA_MEM_ERROR");
+        case LZMA_MEMLIMIT_ERROR:
+            return std::runtime_error("LZMA_MEMLIMIT_ERROR");
+        case LZMA_FORMAT_ERROR:
+            return std::runtime_error("LZMA_FORMAT_ERROR");
+        case LZMA_OPTIONS_ERROR:
+            return std::runtime_error("LZMA_OPTIONS_ERROR");
+        case LZMA_DATA_ERROR:
+            return std::runtime_error("LZMA_DATA_ERROR");
+        case LZMA_BUF_ERROR:
+            return std::runtime_error("LZMA_BUF_ERROR");
+        case LZMA_PROG_ERROR:
+            return std::runtime_error("LZMA_PROG_ERROR");
+        default:
+            std::stringstream s;
+            s << "Unknown xz error: " << code;
+            return std::runtime_error(s.str());
+        }
+    }
+}
+
+namespace pkgxx {
+    unxzstreambuf::unxzstreambuf(std::streambuf* base, std::size_t buf_size)
+        : _base(base)
+        , _buf_size(buf_size)
+        , _unxz(LZMA_STREAM_INIT)
+        , _unxz_eof(false)
+        , _unxz_done(false) {
+
+        if (auto const res = lzma_stream_decoder(&_unxz, UINT64_MAX, 0); res != LZMA_OK) {
+            throw lzma_exception(res);
+        }
+    }
+
+    unxzstreambuf::~unxzstreambuf() {
+        lzma_end(&_unxz);
+    }
+
+#if !defined(DOXYGEN)
+    unxzstreambuf::int_type
+    unxzstreambuf::underflow() {
+        if (eback() == nullptr) {
+            // An underflow has happened because we haven't allocated
+            // buffers yet.
+            _unxz_in  = buffer_t(_buf_size);
+            _unxz_out = buffer_t(_buf_size);
+        }
+
+        while (!_unxz_done) {
+            if (_unxz.avail_in == 0 && !_unxz_eof) {
+                // liblzma has no unconsumed compressed input, and the
+                // base streambuf hasn't got EOF yet. Try reading some.
+                _unxz.next_in  = reinterpret_cast<std::uint8_t const*>(_unxz_in->data());
+                _unxz.avail_in = 0;
+
+                // Block until the base streambuf has something, and then
+                // take whatever it has buffered in one go.
+                if (traits_type::eq_int_type(_base->sgetc(), traits_type::eof())) {
+                    _unxz_eof = true;
+                }
+                else {
+                    std::streamsize const n_read = _base->sgetn(
+                        _unxz_in->data(),
+                        std::min(
+                            _base->in_avail(),
+                            static_cast<std::streamsize>(_unxz_in->size())));
+                    _unxz.avail_in = static_cast<std::size_t>(n_read);
+                }
+            }
+
+            _unxz.next_out  = reinterpret_cast<std::uint8_t*>(_unxz_out->data());
+            _unxz.avail_out = _unxz_out->size();
+            auto const res = lzma_code(&_unxz, _unxz_eof ? LZMA_FINISH : LZMA_RUN);
+            switch (res) {
+            case LZMA_OK:
+                if (_unxz.avail_out < _unxz_out->size()) {
+                    // Got some uncompressed data from liblzma.
+                    auto const n_read = _unxz_out->size() - _unxz.avail_out;
+                    setg(_unxz_out->data(),
+                         _unxz_out->data(),
+                         _unxz_out->data() + n_read);
+                    return traits_type::to_int_type(*gptr());
+                }
+                else {
+                    // liblzma needs more input to produce a single output
+                    // byte.
+                    continue;
+                }
+
+            case LZMA_STREAM_END:
+                // We have reached the logical end of compressed data.
+                _unxz_done = true;
+                // But liblzma may have produced the last chunk of
+                // uncompressed data.
+                if (_unxz.avail_out < _unxz_out->size()) {
+                    auto const n_read = _unxz_out->size() - _unxz.avail_out;
+                    setg(_unxz_out->data(),
+                         _unxz_out->data(),
+                         _unxz_out->data() + n_read);
+                    return traits_type::to_int_type(*gptr());
+                }
+                else {
+                    // No it didn't.
+                    return traits_type::eof();
+                }
+
+            default:
+                // This includes LZMA_BUF_ERROR, which means the stream is
+                // truncated.
+                throw lzma_exception(res);
+            }
+        }
+
+        return traits_type::eof();
+    }
+#endif
+
+#if !defined(DOXYGEN)
+    unxzstreambuf::int_type
+    unxzstreambuf::pbackfail(int_type ch) {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()) &&
+            gptr() != nullptr &&
+            gptr() > eback()) {
+
+            // There is no problem modifying the buffer.
+            gptr()[-1] = traits_type::to_char_type(ch);
+            return ch;
+        }
+        else {
+            // We don't support putting back characters past the
+            // limit. That would complicate the implementation.
+            return traits_type::eof();
+        }
+    }
+#endif
+}
+#endif
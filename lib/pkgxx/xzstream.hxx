@@ -0,0 +1,82 @@
+#pragma once
+
+#include <pkgxx/config.h>
+
+#if defined(HAVE_LZMA)
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <streambuf>
+#include <vector>
+#include <lzma.h>
+
+namespace pkgxx {
+    /** A stream buffer that reads xz-compressed data. Currently only
+     * supports reading operations. This is only available when liblzma
+     * is found at configure time, i.e. \c HAVE_LZMA is defined.
+     */
+    struct unxzstreambuf: public std::streambuf {
+        /// The default size of the compressed and decompressed buffers.
+        static constexpr std::size_t const default_buf_size = 64 * 1024;
+
+        /** Construct a stream buffer that reads xz-compressed data from
+         * another stream buffer.
+         */
+        unxzstreambuf(std::streambuf* base,
+                      std::size_t buf_size = default_buf_size);
+        virtual ~unxzstreambuf();
+
+    protected:
+#if !defined(DOXYGEN)
+        virtual int_type
+        underflow() override;
+
+        virtual int_type
+        pbackfail(int_type ch = traits_type::eof()) override;
+#endif
+
+    private:
+        using buffer_t = std::vector<char_type>;
+
+        std::streambuf* _base;
+        std::size_t _buf_size;
+
+        lzma_stream _unxz;
+        bool _unxz_eof;  // Got EOF from _base.
+        bool _unxz_done; // Got LZMA_STREAM_END from lzma_code().
+        std::optional<buffer_t> _unxz_in;
+        std::optional<buffer_t> _unxz_out;
+    };
+
+    /** An input stream that reads xz-compressed data.
+     */
+    struct unxzistream: public std::istream {
+        /** Construct an input stream that reads xz-compressed data from
+         * another input stream.
+         */
+        unxzistream(std::istream& base,
+                    std::size_t buf_size = unxzstreambuf::default_buf_size)
+            : std::istream(nullptr) {
+
+            if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
+                _buf = std::make_unique<unxzstreambuf>(base_buf, buf_size);
+                rdbuf(_buf.get());
+            }
+        }
+
+        /** Construct an instance of \ref unxzistream by moving a buffer
+         * out of another instance. */
+        unxzistream(unxzistream&& other)
+            : std::istream(std::move(other))
+            , _buf(std::move(other._buf)) {
+
+            other.set_rdbuf(nullptr);
+            rdbuf(_buf.get());
+        }
+
+    private:
+        std::unique_ptr<unxzstreambuf> _buf;
+    };
+}
+#endif
@@ -0,0 +1,107 @@
+#include "zstdstream.hxx"
+
+#if defined(HAVE_ZSTD)
+#include <algorithm>
+#include <stdexcept>
+
+namespace pkgxx {
+    unzstdstreambuf::unzstdstreambuf(std::streambuf* base, std::size_t buf_size)
+        : _base(base)
+        , _buf_size(buf_size)
+        , _unzstd(ZSTD_createDStream())
+        , _unzstd_input {nullptr, 0, 0}
+        , _unzstd_eof(false)
+        , _unzstd_in_frame(false)
+        , _unzstd_out_full(false) {
+
+        if (_unzstd == nullptr) {
+            throw std::runtime_error("ZSTD_createDStream() failed");
+        }
+        if (auto const res = ZSTD_initDStream(_unzstd); ZSTD_isError(res)) {
+            ZSTD_freeDStream(_unzstd);
+            throw std::runtime_error(ZSTD_getErrorName(res));
+        }
+    }
+
+    unzstdstreambuf::~unzstdstreambuf() {
+        ZSTD_freeDStream(_unzstd);
+    }
+
+#if !defined(DOXYGEN)
+    unzstdstreambuf::int_type
+    unzstdstreambuf::underflow() {
+        if (eback() == nullptr) {
+            // An underflow has happened because we haven't allocated
+            // buffers yet.
+            _unzstd_in  = buffer_t(_buf_size);
+            _unzstd_out = buffer_t(_buf_size);
+        }
+
+        while (true) {
+            if (_unzstd_input.pos == _unzstd_input.size && !_unzstd_eof) {
+                // libzstd has no unconsumed compressed input, and the
+                // base streambuf hasn't got EOF yet. Try reading some.
+                _unzstd_input = {_unzstd_in->data(), 0, 0};
+
+                // Block until the base streambuf has something, and then
+                // take whatever it has buffered in one go.
+                if (traits_type::eq_int_type(_base->sgetc(), traits_type::eof())) {
+                    _unzstd_eof = true;
+                }
+                else {
+                    std::streamsize const n_read = _base->sgetn(
+                        _unzstd_in->data(),
+                        std::min(
+                            _base->in_avail(),
+                            static_cast<std::streamsize>(_unzstd_in->size())));
+                    _unzstd_input.size = static_cast<std::size_t>(n_read);
+                }
+            }
+
+            if (_unzstd_input.pos == _unzstd_input.size && _unzstd_eof && !_unzstd_out_full) {
+                // No more input, and libzstd has nothing buffered.
+                if (_unzstd_in_frame) {
+                    throw std::runtime_error("Unexpected end of zstd stream");
+                }
+                return traits_type::eof();
+            }
+
+            ZSTD_outBuffer output = {_unzstd_out->data(), _unzstd_out->size(), 0};
+            auto const res = ZSTD_decompressStream(_unzstd, &output, &_unzstd_input);
+            if (ZSTD_isError(res)) {
+                throw std::runtime_error(ZSTD_getErrorName(res));
+            }
+            // 0 means a frame has been completely decoded and flushed.
+            _unzstd_in_frame = res != 0;
+            _unzstd_out_full = output.pos == output.size;
+
+            if (output.pos > 0) {
+                setg(_unzstd_out->data(),
+                     _unzstd_out->data(),
+                     _unzstd_out->data() + output.pos);
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+    }
+#endif
+
+#if !defined(DOXYGEN)
+    unzstdstreambuf::int_type
+    unzstdstreambuf::pbackfail(int_type ch) {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()) &&
+            gptr() != nullptr &&
+            gptr() > eback()) {
+
+            // There is no problem modifying the buffer.
+            gptr()[-1] = traits_type::to_char_type(ch);
+            return ch;
+        }
+        else {
+            // We don't support putting back characters past the
+            // limit. That would complicate the implementation.
+            return traits_type::eof();
+        }
+    }
+#endif
+}
+#endif
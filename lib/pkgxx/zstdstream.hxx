@@ -0,0 +1,85 @@
+#pragma once
+
+#include <pkgxx/config.h>
+
+#if defined(HAVE_ZSTD)
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <streambuf>
+#include <vector>
+#include <zstd.h>
+
+namespace pkgxx {
+    /** A stream buffer that reads zstd-compressed data. Currently only
+     * supports reading operations. This is only available when libzstd
+     * is found at configure time, i.e. \c HAVE_ZSTD is defined.
+     */
+    struct unzstdstreambuf: public std::streambuf {
+        /// The default size of the compressed and decompressed buffers.
+        static constexpr std::size_t const default_buf_size = 128 * 1024;
+
+        /** Construct a stream buffer that reads zstd-compressed data from
+         * another stream buffer. Concatenated frames are decoded one
+         * after another.
+         */
+        unzstdstreambuf(std::streambuf* base,
+                        std::size_t buf_size = default_buf_size);
+        virtual ~unzstdstreambuf();
+
+    protected:
+#if !defined(DOXYGEN)
+        virtual int_type
+        underflow() override;
+
+        virtual int_type
+        pbackfail(int_type ch = traits_type::eof()) override;
+#endif
+
+    private:
+        using buffer_t = std::vector<char_type>;
+
+        std::streambuf* _base;
+        std::size_t _buf_size;
+
+        ZSTD_DStream* _unzstd;
+        ZSTD_inBuffer _unzstd_input; // The unconsumed part of _unzstd_in.
+        bool _unzstd_eof;        // Got EOF from _base.
+        bool _unzstd_in_frame;   // In the middle of a frame.
+        bool _unzstd_out_full;   // The last call filled the output buffer.
+        std::optional<buffer_t> _unzstd_in;
+        std::optional<buffer_t> _unzstd_out;
+    };
+
+    /** An input stream that reads zstd-compressed data.
+     */
+    struct unzstdistream: public std::istream {
+        /** Construct an input stream that reads zstd-compressed data from
+         * another input stream.
+         */
+        unzstdistream(std::istream& base,
+                      std::size_t buf_size = unzstdstreambuf::default_buf_size)
+            : std::istream(nullptr) {
+
+            if (auto* base_buf = base.rdbuf(); base_buf != nullptr) {
+                _buf = std::make_unique<unzstdstreambuf>(base_buf, buf_size);
+                rdbuf(_buf.get());
+            }
+        }
+
+        /** Construct an instance of \ref unzstdistream by moving a buffer
+         * out of another instance. */
+        unzstdistream(unzstdistream&& other)
+            : std::istream(std::move(other))
+            , _buf(std::move(other._buf)) {
+
+            other.set_rdbuf(nullptr);
+            rdbuf(_buf.get());
+        }
+
+    private:
+        std::unique_ptr<unzstdstreambuf> _buf;
+    };
+}
+#endif
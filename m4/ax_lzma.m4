@@ -0,0 +1,34 @@
+# -*- autoconf -*-
+# An optional dependency: HAVE_LZMA is defined only if liblzma is found.
+AC_DEFUN([AX_LZMA], [
+    AC_ARG_WITH(
+        [lzma-prefix],
+        [AS_HELP_STRING([--with-lzma-prefix], [path to liblzma installation directory, or "no" to disable it])])
+    AS_IF([test x"$with_lzma_prefix" != x"" -a x"$with_lzma_prefix" != x"no"],
+          [LZMA_CPPFLAGS="-I${with_lzma_prefix}/include"
+           LZMA_LIBS="-L${with_lzma_prefix}/lib"])
+
+    have_lzma=no
+    AS_IF([test x"$with_lzma_prefix" != x"no"], [
+        saved_CPPFLAGS="$CPPFLAGS"
+        saved_LIBS="$LIBS"
+        CPPFLAGS="$CPPFLAGS $LZMA_CPPFLAGS"
+        LIBS="$LIBS $LZMA_LIBS"
+        AC_CHECK_HEADER(
+            [lzma.h],
+            [AC_CHECK_LIB(
+                [lzma],
+                [lzma_stream_decoder],
+                [LZMA_LIBS="$LZMA_LIBS -llzma"
+                 have_lzma=yes])])
+        LIBS="$saved_LIBS"
+        CPPFLAGS="$saved_CPPFLAGS"
+    ])
+    AS_IF([test x"$have_lzma" = x"yes"],
+          [AC_DEFINE([HAVE_LZMA], [1], [Define to 1 if you have liblzma.])],
+          [LZMA_CPPFLAGS=""
+           LZMA_LIBS=""])
+
+    AC_SUBST([LZMA_CPPFLAGS])
+    AC_SUBST([LZMA_LIBS])
+])
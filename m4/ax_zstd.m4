@@ -0,0 +1,34 @@
+# -*- autoconf -*-
+# An optional dependency: HAVE_ZSTD is defined only if libzstd is found.
+AC_DEFUN([AX_ZSTD], [
+    AC_ARG_WITH(
+        [zstd-prefix],
+        [AS_HELP_STRING([--with-zstd-prefix], [path to libzstd installation directory, or "no" to disable it])])
+    AS_IF([test x"$with_zstd_prefix" != x"" -a x"$with_zstd_prefix" != x"no"],
+          [ZSTD_CPPFLAGS="-I${with_zstd_prefix}/include"
+           ZSTD_LIBS="-L${with_zstd_prefix}/lib"])
+
+    have_zstd=no
+    AS_IF([test x"$with_zstd_prefix" != x"no"], [
+        saved_CPPFLAGS="$CPPFLAGS"
+        saved_LIBS="$LIBS"
+        CPPFLAGS="$CPPFLAGS $ZSTD_CPPFLAGS"
+        LIBS="$LIBS $ZSTD_LIBS"
+        AC_CHECK_HEADER(
+            [zstd.h],
+            [AC_CHECK_LIB(
+                [zstd],
+                [ZSTD_decompressStream],
+                [ZSTD_LIBS="$ZSTD_LIBS -lzstd"
+                 have_zstd=yes])])
+        LIBS="$saved_LIBS"
+        CPPFLAGS="$saved_CPPFLAGS"
+    ])
+    AS_IF([test x"$have_zstd" = x"yes"],
+          [AC_DEFINE([HAVE_ZSTD], [1], [Define to 1 if you have libzstd.])],
+          [ZSTD_CPPFLAGS=""
+           ZSTD_LIBS=""])
+
+    AC_SUBST([ZSTD_CPPFLAGS])
+    AC_SUBST([ZSTD_LIBS])
+])
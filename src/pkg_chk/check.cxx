@@ -1,17 +1,66 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
+#include <iomanip>
 #include <iterator>
 #include <thread>
 
+#include <pkgxx/environment.hxx>
 #include <pkgxx/makevars.hxx>
 #include <pkgxx/mutex_guard.hxx>
 #include <pkgxx/nursery.hxx>
+#include <pkgxx/task_timings.hxx>
 
 #include "check.hxx"
 
 namespace fs = std::filesystem;
 
+namespace {
+    using clock_type = std::chrono::steady_clock;
+    using seconds    = pkgxx::task_timings::duration;
+
+    // Statistics of task durations in a single run.
+    struct run_stats {
+        seconds total   = seconds::zero();
+        seconds longest = seconds::zero();
+    };
+
+    // Measure the duration of a task and record it when the task
+    // finishes, unless it fails.
+    struct stopwatch {
+        stopwatch(std::string&& name,
+                  std::optional<pkgxx::task_timings>& timings,
+                  pkgxx::guarded<run_stats>& stats)
+            : _name(std::move(name))
+            , _timings(timings)
+            , _stats(stats)
+            , _started(clock_type::now())
+            , _uncaught(std::uncaught_exceptions()) {}
+
+        ~stopwatch() {
+            if (std::uncaught_exceptions() > _uncaught) {
+                return;
+            }
+            seconds const d = clock_type::now() - _started;
+            if (_timings) {
+                _timings->record(_name, d);
+            }
+            auto st = _stats.lock();
+            st->total  += d;
+            st->longest = std::max(st->longest, d);
+        }
+
+    private:
+        std::string _name;
+        std::optional<pkgxx::task_timings>& _timings;
+        pkgxx::guarded<run_stats>& _stats;
+        clock_type::time_point _started;
+        int _uncaught;
+    };
+}
+
 namespace pkg_chk {
     checker_base::checker_base(
         bool add_missing,
@@ -44,6 +93,20 @@ namespace pkg_chk {
                         ret.insert(name);
                     }
                     return ret;
+                }).share())
+        , _installed_build_versions(
+            std::async(
+                std::launch::deferred,
+                [this]() {
+                    // Only needed for -B. Fetch all of them at once
+                    // rather than spawning pkg_info(1) for each
+                    // package. run() forces this before starting its
+                    // tasks.
+                    verbose([](auto& out) {
+                        out << "Getting build versions of installed packages" << std::endl;
+                    });
+                    return pkgxx::build_version::from_installed(
+                        _PKG_INFO.get(), _installed_pkgnames.get(), _concurrency);
                 }).share()) {}
 
     checker_base::result
@@ -54,12 +117,43 @@ namespace pkg_chk {
         // extract variables from package Makefiles unless we are using
         // binary packages. Luckily for us each check is independent of
         // each other so we can parallelise them.
+        //
+        // Some packages take far longer to check than others. Start the
+        // ones that took the longest in previous runs first, so that a
+        // slow one picked last doesn't stretch the tail of the run.
+        std::optional<pkgxx::task_timings> timings;
+        if (auto const name = timings_file_name(); name) {
+            if (auto const dir = pkgxx::cache_dir(); dir) {
+                timings.emplace(*dir / name);
+            }
+        }
+        auto const ordered = timings
+            ? timings->longest_first(pkgpaths)
+            : std::vector<pkgxx::pkgpath>(pkgpaths.begin(), pkgpaths.end());
+
+        // Compute what every check task shares before any of them
+        // starts, so that the first tasks don't have their timings
+        // inflated by waiting for it.
+        _installed_pkgnames.wait();
+        if (_check_build_version) {
+            // The snapshot of installed build versions also runs
+            // pkg_info(1) in parallel, which would find the concurrency
+            // budget used up by the tasks if it were taken lazily within
+            // one of them.
+            _installed_build_versions.wait();
+        }
+        prefetch(pkgpaths);
+
         pkgxx::guarded<result> res;
+        pkgxx::guarded<run_stats> stats;
+        auto const started = clock_type::now();
         {
             pkgxx::nursery n(_concurrency);
-            for (pkgxx::pkgpath const& path: pkgpaths) {
+            for (pkgxx::pkgpath const& path: ordered) {
                 n.start_soon(
                     [&]() {
+                        stopwatch const sw(path.string(), timings, stats);
+
                         // Find the set of latest PKGNAMEs provided by this
                         // PKGPATH. Most PKGPATHs have just one
                         // corresponding PKGNAME but some (py-*) have more.
@@ -84,8 +178,7 @@ namespace pkg_chk {
                                     // enough if -B is given.
                                     if (_check_build_version) {
                                         auto const latest_build_version    = fetch_build_version(name, path);
-                                        auto const installed_build_version =
-                                            pkgxx::build_version::from_installed(_PKG_INFO.get(), *installed);
+                                        auto const installed_build_version = installed_build_version_of(*installed);
                                         assert(installed_build_version.has_value());
 
                                         if (latest_build_version.has_value()) {
@@ -165,6 +258,29 @@ namespace pkg_chk {
         }
         done();
 
+        if (!ordered.empty()) {
+            // The makespan can't be shorter than either the longest task
+            // or the total work evenly divided among threads.
+            seconds const makespan = clock_type::now() - started;
+            auto const st = *stats.lock();
+            auto const ideal = std::max(st.longest, st.total / std::max(1u, _concurrency));
+            verbose([&](auto& out) {
+                out << std::fixed << std::setprecision(2)
+                    << "Checked " << ordered.size() << " packages in " << makespan.count()
+                    << " s (ideal " << ideal.count() << " s)" << std::endl;
+            });
+        }
+        if (timings) {
+            try {
+                timings->save();
+            }
+            catch (std::exception const& e) {
+                verbose([&](auto& out) {
+                    out << "Failed to save task timings: " << e.what() << std::endl;
+                });
+            }
+        }
+
         // The nursery has to be destroyed before this std::move() happens,
         // otherwise we would return an empty result.
         return std::move(*res.lock());
@@ -181,6 +297,19 @@ namespace pkg_chk {
         return run(pkgpaths);
     }
 
+    std::optional<pkgxx::build_version>
+    checker_base::installed_build_version_of(pkgxx::pkgname const& name) const {
+        auto const& bvs = _installed_build_versions.get();
+        if (auto it = bvs.find(name); it != bvs.end()) {
+            return it->second;
+        }
+        else {
+            // Installed after we took the snapshot, or pkg_info(1) failed
+            // for some reason. Ask it individually.
+            return pkgxx::build_version::from_installed(_PKG_INFO.get(), name);
+        }
+    }
+
     bool
     checker_base::mark_as_deleted(pkgxx::pkgname const& name) {
         auto const& [_, inserted] = _deleted_pkgnames.insert(name);
@@ -188,8 +317,10 @@ namespace pkg_chk {
     }
 
     source_checker_base::source_checker_base(
-        std::shared_future<std::filesystem::path> const& PKGSRCDIR)
+        std::shared_future<std::filesystem::path> const& PKGSRCDIR,
+        unsigned verify_build_version)
         : _PKGSRCDIR(PKGSRCDIR)
+        , _verify_build_version(verify_build_version)
         , _installed_pkgpaths_with_pkgnames(
             std::async(
                 std::launch::deferred,
@@ -288,21 +419,65 @@ namespace pkg_chk {
 
     std::optional<pkgxx::build_version>
     source_checker_base::fetch_build_version(pkgxx::pkgname const&, pkgxx::pkgpath const& path) const {
-        return pkgxx::build_version::from_source(_PKGSRCDIR.get(), path);
+        // Take one from the remaining number of packages to verify, if
+        // any.
+        unsigned remaining = _verify_build_version.load();
+        while (remaining > 0 &&
+               !_verify_build_version.compare_exchange_weak(remaining, remaining - 1));
+
+        if (remaining == 0 || !fs::exists(_PKGSRCDIR.get() / path)) {
+            return pkgxx::build_version::from_source(_PKGSRCDIR.get(), path);
+        }
+
+        auto const native = pkgxx::build_version::from_source_native(_PKGSRCDIR.get(), path);
+        auto const bmake  = pkgxx::build_version::from_source_bmake(_PKGSRCDIR.get(), path);
+        if (!native) {
+            verbose([&](auto& out) {
+                out << path << " - build_version cannot be computed without bmake" << std::endl;
+            });
+        }
+        else if (native != bmake) {
+            warn([&](auto& out) {
+                out << path << " - build_version computed without bmake differs" << std::endl
+                    << "--native--" << std::endl
+                    << native.value()
+                    << "--bmake--"  << std::endl
+                    << bmake.value_or(pkgxx::build_version())
+                    << "----"       << std::endl;
+            });
+        }
+        else {
+            verbose([&](auto& out) {
+                out << path << " - build_version verified" << std::endl;
+            });
+        }
+        return bmake;
     }
 
     binary_checker_base::binary_checker_base(
-        std::shared_future<std::filesystem::path> const& PACKAGES,
         std::shared_future<std::string> const& PKG_SUFX,
         std::shared_future<pkgxx::summary> const& bin_pkg_summary)
-        : _PACKAGES(PACKAGES)
-        , _PKG_SUFX(PKG_SUFX)
+        : _PKG_SUFX(PKG_SUFX)
         , _bin_pkg_summary(bin_pkg_summary)
         , _bin_pkg_map(
             std::async(
                 std::launch::deferred,
                 [this]() {
                     return pkgxx::pkgmap(_bin_pkg_summary.get());
+                }).share())
+        , _bin_build_version_indices(
+            std::async(
+                std::launch::deferred,
+                [this]() {
+                    // Every repository that supplied any package may
+                    // have its own index.
+                    std::map<std::filesystem::path, pkgxx::build_version_index> indices;
+                    for (auto const& [_name, vars]: _bin_pkg_summary.get()) {
+                        if (indices.find(vars.PACKAGES) == indices.end()) {
+                            indices.emplace(vars.PACKAGES, pkgxx::build_version_index(vars.PACKAGES));
+                        }
+                    }
+                    return indices;
                 }).share()) {}
 
     std::set<pkgxx::pkgname>
@@ -356,27 +531,74 @@ namespace pkg_chk {
 
     std::optional<pkgxx::build_version>
     binary_checker_base::fetch_build_version(pkgxx::pkgname const& name, pkgxx::pkgpath const&) const {
-        if (auto const file = binary_package_file_of(name); file) {
-            return pkgxx::build_version::from_binary(_PKG_INFO.get(), *file);
+        auto const& sum = _bin_pkg_summary.get();
+        if (auto const it = sum.find(name); it != sum.end()) {
+            auto const file = it->second.binary_package_file(_PKG_SUFX.get());
+
+            // Prefer the sidecar index if the repository has one. It only
+            // returns entries whose package files haven't changed since
+            // they were indexed.
+            auto const& indices = _bin_build_version_indices.get();
+            if (auto const index = indices.find(it->second.PACKAGES); index != indices.end()) {
+                if (auto bv = index->second.find(file); bv) {
+                    return bv;
+                }
+            }
+            if (auto const bv = _remote_build_versions.find(file.string());
+                bv != _remote_build_versions.end()) {
+                return bv->second;
+            }
+            else {
+                return pkgxx::build_version::from_binary(_PKG_INFO.get(), file);
+            }
         }
         else {
             return std::nullopt;
         }
     }
 
+    void
+    binary_checker_base::prefetch(std::set<pkgxx::pkgpath> const& pkgpaths) const {
+        if (!_check_build_version) {
+            return;
+        }
+        _bin_build_version_indices.wait();
+
+        // Build versions of remote binary packages are fetched in a
+        // nursery of their own, which would run serially if it were
+        // started from a check task. They are only asked for packages
+        // being checked whose installed version is in a repository, and
+        // build version indices aren't consulted for remote
+        // repositories, so fetch exactly those at once rather than one
+        // request per check task.
+        auto const& sum = _bin_pkg_summary.get();
+        std::vector<std::string> urls;
+        for (auto const& name: _installed_pkgnames.get()) {
+            if (auto it = sum.find(name);
+                it != sum.end() &&
+                pkgpaths.count(it->second.PKGPATH) > 0 &&
+                it->second.PACKAGES.string().find("://") != std::string::npos) {
+
+                urls.push_back(it->second.binary_package_file(_PKG_SUFX.get()).string());
+            }
+        }
+        if (!urls.empty()) {
+            verbose([&](auto& out) {
+                out << "Getting build versions of " << urls.size()
+                    << " remote binary packages" << std::endl;
+            });
+            _remote_build_versions = pkgxx::build_version::from_remote_binaries(urls);
+        }
+    }
+
     std::optional<std::filesystem::path>
     binary_checker_base::binary_package_file_of(pkgxx::pkgname const& name) const {
         auto const& sum = _bin_pkg_summary.get();
 
         if (auto it = sum.find(name); it != sum.end()) {
-            if (it->second.FILE_NAME) {
-                return _PACKAGES.get() / *(it->second.FILE_NAME);
-            }
-            else {
-                auto file = _PACKAGES.get() / name.string();
-                file += _PKG_SUFX.get();
-                return file;
-            }
+            // Resolve it against the repository that supplied the
+            // package.
+            return it->second.binary_package_file(_PKG_SUFX.get());
         }
         else {
             return {};
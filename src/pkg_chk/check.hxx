@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <filesystem>
 #include <functional>
@@ -9,6 +10,7 @@
 #include <set>
 
 #include <pkgxx/build_version.hxx>
+#include <pkgxx/build_version_index.hxx>
 #include <pkgxx/pkgname.hxx>
 #include <pkgxx/stream.hxx>
 #include <pkgxx/summary.hxx>
@@ -62,6 +64,27 @@ namespace pkg_chk {
             return false;
         }
 
+        /// Return the name of the file in the cache directory to record
+        /// durations of per-package checks, or \c nullptr if they are
+        /// too cheap to be worth scheduling by their cost.
+        virtual char const*
+        timings_file_name() const {
+            return nullptr;
+        }
+
+        /// Compute lazily obtained data that the check tasks would
+        /// otherwise compute with nested parallelism, while the
+        /// concurrency budget is still available. Called at the beginning
+        /// of \c run() before any task starts, with the PKGPATHs about to
+        /// be checked.
+        virtual void prefetch(std::set<pkgxx::pkgpath> const&) const {}
+
+        /// Return the build version of an installed package. Build
+        /// versions of all the installed packages are retrieved in bulk
+        /// the first time this is called.
+        std::optional<pkgxx::build_version>
+        installed_build_version_of(pkgxx::pkgname const& name) const;
+
         /// Report the total number of packages to check. Called at the
         /// beginning of \c run().
         virtual void total(std::size_t) const {}
@@ -93,14 +116,19 @@ namespace pkg_chk {
         std::shared_future<std::string>              _PKG_INFO;
         std::shared_future<pkgxx::summary>           _installed_pkg_summary;
         std::shared_future<std::set<pkgxx::pkgname>> _installed_pkgnames;
+        std::shared_future<pkgxx::build_version_map> _installed_build_versions;
 
         std::set<pkgxx::pkgname> _deleted_pkgnames;
     };
 
     /// Obtains data from source.
     struct source_checker_base: virtual checker_base {
+        /// If \c verify_build_version is non-zero, build versions of that
+        /// many packages are computed both natively and with bmake, and
+        /// any discrepancies are reported as warnings.
         source_checker_base(
-            std::shared_future<std::filesystem::path> const& PKGSRCDIR);
+            std::shared_future<std::filesystem::path> const& PKGSRCDIR,
+            unsigned verify_build_version = 0);
 
     protected:
         virtual std::set<pkgxx::pkgname>
@@ -109,7 +137,13 @@ namespace pkg_chk {
         virtual std::optional<pkgxx::build_version>
         fetch_build_version(pkgxx::pkgname const& name, pkgxx::pkgpath const& path) const override;
 
+        virtual char const*
+        timings_file_name() const override {
+            return "source-check-timings";
+        }
+
         std::shared_future<std::filesystem::path> _PKGSRCDIR;
+        mutable std::atomic<unsigned> _verify_build_version;
         std::shared_future<
             std::map<
                 pkgxx::pkgpath,
@@ -121,7 +155,6 @@ namespace pkg_chk {
     /// Obtains data from a binary package repository.
     struct binary_checker_base: virtual checker_base {
         binary_checker_base(
-            std::shared_future<std::filesystem::path> const& PACKAGES,
             std::shared_future<std::string> const& PKG_SUFX,
             std::shared_future<pkgxx::summary> const& bin_pkg_summary);
 
@@ -137,13 +170,25 @@ namespace pkg_chk {
             return _bin_pkg_summary.get().count(name) > 0;
         }
 
+        virtual void
+        prefetch(std::set<pkgxx::pkgpath> const& pkgpaths) const override;
+
         std::optional<std::filesystem::path>
         binary_package_file_of(pkgxx::pkgname const& name) const;
 
-        std::shared_future<std::filesystem::path> _PACKAGES;
         std::shared_future<std::string>           _PKG_SUFX;
         std::shared_future<pkgxx::summary>        _bin_pkg_summary;
         std::shared_future<pkgxx::pkgmap>         _bin_pkg_map;
+        std::shared_future<
+            std::map<
+                std::filesystem::path,
+                pkgxx::build_version_index
+                >
+            > _bin_build_version_indices;
+        // Build versions of remote binary packages, keyed by their
+        // URLs. Filled by prefetch() before any check task starts, and
+        // only read afterwards.
+        mutable std::map<std::string, pkgxx::build_version> _remote_build_versions;
     };
 
     /// Obtains data from either source or binary, configurable at run
@@ -168,6 +213,20 @@ namespace pkg_chk {
                 : binary_checker_base::fetch_build_version(name, path);
         }
 
+        virtual void
+        prefetch(std::set<pkgxx::pkgpath> const& pkgpaths) const override {
+            if (!_use_source) {
+                binary_checker_base::prefetch(pkgpaths);
+            }
+        }
+
+        virtual char const*
+        timings_file_name() const override {
+            return _use_source
+                ? source_checker_base::timings_file_name()
+                : binary_checker_base::timings_file_name();
+        }
+
         bool _use_source;
     };
 }
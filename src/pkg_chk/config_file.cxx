@@ -7,6 +7,7 @@
 #include <string_view>
 #include <type_traits>
 
+#include <pkgxx/line_reader.hxx>
 #include <pkgxx/string_algo.hxx>
 
 #include "config_file.hxx"
@@ -70,20 +71,19 @@ namespace pkg_chk {
         }
         in.exceptions(std::ios_base::badbit);
 
-        for (std::string line; std::getline(in, line); ) {
-            auto const hash = line.find('#');
-            if (hash != std::string::npos) {
-                line.erase(hash);
+        for (auto line: pkgxx::line_reader(in)) {
+            if (auto const hash = line.find('#'); hash != std::string_view::npos) {
+                line = line.substr(0, hash);
             }
 
             auto const equal = line.find('=');
-            if (equal != std::string::npos) {
+            if (equal != std::string_view::npos) {
                 // Lines containing '=' are group definition lines.
                 emplace_back(group_def(line));
             }
             else {
                 auto const non_space = line.find_first_not_of(" \t");
-                if (non_space != std::string::npos) {
+                if (non_space != std::string_view::npos) {
                     // Lines containing no '=' but have anything but spaces
                     // are package definition lines.
                     emplace_back(pkg_def(line));
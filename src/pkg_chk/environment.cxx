@@ -12,6 +12,7 @@
 #include <vector>
 
 #include <pkgxx/harness.hxx>
+#include <pkgxx/line_reader.hxx>
 #include <pkgxx/makevars.hxx>
 #include <pkgxx/pkgdb.hxx>
 
@@ -43,7 +44,7 @@ namespace {
     }
 
     struct makefile_env {
-        fs::path        PACKAGES;
+        std::vector<fs::path> repositories;
         std::string     PKG_ADD;
         std::string     PKG_ADMIN;
         std::string     PKG_DELETE;
@@ -111,7 +112,7 @@ namespace pkg_chk {
                 if (opts.pkgchk_conf_path.empty()) {
                     vars.push_back("PKGCHK_CONF_PATH");
                 }
-                if (opts.bin_pkg_path.empty()) {
+                if (opts.bin_pkg_paths.empty()) {
                     vars.push_back("PACKAGES");
                 }
                 if (geteuid() != 0) {
@@ -128,10 +129,14 @@ namespace pkg_chk {
                 for (auto const& [var, value]: value_of) {
                     verbose_var(var, value);
                 }
-                _menv.PACKAGES           =
-                    opts.bin_pkg_path.empty()
-                    ? fs::path(value_of["PACKAGES"])
-                    : url_safe_absolute(opts.bin_pkg_path);
+                if (opts.bin_pkg_paths.empty()) {
+                    _menv.repositories.push_back(value_of["PACKAGES"]);
+                }
+                else {
+                    for (auto const& path: opts.bin_pkg_paths) {
+                        _menv.repositories.push_back(url_safe_absolute(path));
+                    }
+                }
                 _menv.PKG_ADD            = value_of["PKG_ADD"   ].empty() ? CFG_PKG_ADD    : value_of["PKG_ADD"   ];
                 _menv.PKG_ADMIN          = value_of["PKG_ADMIN" ].empty() ? CFG_PKG_ADMIN  : value_of["PKG_ADMIN" ];
                 _menv.PKG_DELETE         = value_of["PKG_DELETE"].empty() ? CFG_PKG_DELETE : value_of["PKG_DELETE"];
@@ -147,13 +152,15 @@ namespace pkg_chk {
                 _menv.PKGCHK_UPDATE_CONF = value_of["PKGCHK_UPDATE_CONF"];
                 _menv.SU_CMD             = value_of["SU_CMD"            ];
 
-                if (_menv.PACKAGES.empty()) {
-                    _menv.PACKAGES = PKGSRCDIR.get() / "packages";
-                    verbose_var("PACKAGES", _menv.PACKAGES.string());
-                }
-                if (fs::is_directory(_menv.PACKAGES / "All")) {
-                    _menv.PACKAGES /= "All";
-                    verbose_var("PACKAGES", _menv.PACKAGES.string());
+                for (auto& PACKAGES: _menv.repositories) {
+                    if (PACKAGES.empty()) {
+                        PACKAGES = PKGSRCDIR.get() / "packages";
+                        verbose_var("PACKAGES", PACKAGES.string());
+                    }
+                    if (fs::is_directory(PACKAGES / "All")) {
+                        PACKAGES /= "All";
+                        verbose_var("PACKAGES", PACKAGES.string());
+                    }
                 }
                 if (_menv.PKGCHK_CONF.empty()) {
                     // Check PKG_SYSCONFDIR then fall back to PKGSRCDIR.
@@ -173,7 +180,8 @@ namespace pkg_chk {
 
                 return _menv;
             }).share();
-        PACKAGES           = std::async(std::launch::deferred, [menv]() { return menv.get().PACKAGES;           }).share();
+        PACKAGES           = std::async(std::launch::deferred, [menv]() { return menv.get().repositories.front(); }).share();
+        repositories       = std::async(std::launch::deferred, [menv]() { return menv.get().repositories;       }).share();
         PKG_ADD            = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_ADD;            }).share();
         PKG_ADMIN          = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_ADMIN;          }).share();
         PKG_DELETE         = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_DELETE;         }).share();
@@ -233,13 +241,14 @@ namespace pkg_chk {
         MACHINE_ARCH = std::async(std::launch::deferred, [penv]() { return penv.get().MACHINE_ARCH; }).share();
 
         // The binary package summary is obtained by parsing a
-        // pkg_summary(5) file or by scanning PACKAGES.
+        // pkg_summary(5) file or by scanning PACKAGES, for each
+        // repository.
         bin_pkg_summary = std::async(
             std::launch::deferred,
             [this, &opts]() {
                 auto m = msg();
                 auto v = verbose();
-                pkgxx::summary sum(m, v, opts.concurrency, PACKAGES.get(), PKG_INFO.get(), PKG_SUFX.get());
+                pkgxx::summary sum(m, v, opts.concurrency, repositories.get(), PKG_INFO.get(), PKG_SUFX.get());
                 v << "Binary packages: " << sum.size() << std::endl;
                 return sum;
             }).share();
@@ -270,7 +279,7 @@ namespace pkg_chk {
                 pkg_info.cin().close();
 
                 std::set<pkgxx::pkgpath> pkgpaths;
-                for (std::string line; std::getline(pkg_info.cout(), line); ) {
+                for (auto const line: pkgxx::line_reader(pkg_info.cout())) {
                     if (!line.empty()) {
                         pkgpaths.emplace(line);
                     }
@@ -6,6 +6,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <pkgxx/environment.hxx>
 #include <pkgxx/summary.hxx>
@@ -54,7 +55,7 @@ namespace pkg_chk {
         std::shared_future<std::string>           MACHINE_ARCH;
         std::shared_future<std::string>           OPSYS;
         std::shared_future<std::string>           OS_VERSION;
-        std::shared_future<std::filesystem::path> PACKAGES;
+        std::shared_future<std::filesystem::path> PACKAGES; ///< The first of repositories
         std::shared_future<std::string>           PKG_ADD;
         std::shared_future<std::string>           PKG_ADMIN;
         std::shared_future<std::string>           PKG_DELETE;
@@ -66,6 +67,9 @@ namespace pkg_chk {
         std::shared_future<std::filesystem::path> PKGCHK_UPDATE_CONF;
         std::shared_future<std::string>           SU_CMD;
 
+        /// Binary package repositories in the order of precedence.
+        std::shared_future<std::vector<std::filesystem::path>> repositories;
+
         std::shared_future<pkgxx::summary> bin_pkg_summary;
         std::shared_future<pkgxx::pkgmap>  bin_pkg_map;
 
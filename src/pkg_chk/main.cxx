@@ -12,7 +12,11 @@
 #include <regex>
 #include <tuple>
 
+#include <pkgxx/adaptive_concurrency.hxx>
+#include <pkgxx/build_version_index.hxx>
+#include <pkgxx/concurrency_budget.hxx>
 #include <pkgxx/config.h>
+#include <pkgxx/environment.hxx>
 #include <pkgxx/graph.hxx>
 #include <pkgxx/harness.hxx>
 #include <pkgxx/nursery.hxx>
@@ -44,7 +48,8 @@ namespace {
         std::vector<std::string> const& args,
         bool fail_ok,
         std::optional<std::filesystem::path> const& cwd = std::nullopt,
-        std::function<void (std::map<std::string, std::string>&)> const& env_mod = [](auto&) {}) {
+        std::function<void (std::map<std::string, std::string>&)> const& env_mod = [](auto&) {},
+        bool interactive = false) {
 
         if (env.opts.list_ver_diffs) {
             return true;
@@ -72,7 +77,10 @@ namespace {
                 "env_mod"_na       = env_mod,
                 "stdin_action"_na  = pkgxx::harness::fd_action::pipe,
                 "stdout_action"_na = pkgxx::harness::fd_action::pipe,
-                "stderr_action"_na = pkgxx::harness::fd_action::merge_with_stdout);
+                "stderr_action"_na = pkgxx::harness::fd_action::merge_with_stdout,
+                // SU_CMD may ask for a password on the terminal, which
+                // it can only read from the foreground process group.
+                "own_pgroup"_na    = !interactive);
             prog.cin() << "exec " << cmd << " \"$@\"" << std::endl;
             prog.cin().close();
 
@@ -108,7 +116,7 @@ namespace {
         std::function<void (std::map<std::string, std::string>&)> const& env_mod = [](auto&) {}) {
 
         if (!env.SU_CMD.get().empty()) {
-            return run_cmd(env, env.SU_CMD.get(), {cmd + ' ' + pkgxx::stringify_argv(args)}, fail_ok, cwd, env_mod);
+            return run_cmd(env, env.SU_CMD.get(), {cmd + ' ' + pkgxx::stringify_argv(args)}, fail_ok, cwd, env_mod, true);
         }
         else {
             return run_cmd(env, cmd, args, fail_ok, cwd, env_mod);
@@ -145,9 +153,8 @@ namespace {
                 env.opts.update,
                 env.opts.delete_mismatched,
                 env.PKG_INFO)
-            , source_checker_base(env.PKGSRCDIR)
+            , source_checker_base(env.PKGSRCDIR, env.opts.verify_build_version)
             , binary_checker_base(
-                env.PACKAGES,
                 env.PKG_SUFX,
                 env.bin_pkg_summary)
             , configurable_checker_base(env.opts.build_from_source)
@@ -289,7 +296,7 @@ namespace {
         else if (env.opts.use_binary_pkgs && env.is_binary_available(name)) {
             return run_cmd_su(
                 env, env.PKG_ADD.get(),
-                {(env.PACKAGES.get() / (name.string() + env.PKG_SUFX.get())).string()},
+                {env.bin_pkg_summary.get().at(name).binary_package_file(env.PKG_SUFX.get()).string()},
                 true,
                 std::nullopt,
                 [&](auto& env_map) {
@@ -453,6 +460,43 @@ namespace {
         }
     }
 
+    void
+    update_build_version_index(pkg_chk::environment const& env) {
+        for (fs::path const& PACKAGES: env.repositories.get()) {
+            if (PACKAGES.string().find("://") != std::string::npos) {
+                env.fatal([&](auto& out) {
+                    out << "Cannot update the build version index of a remote repository: "
+                        << PACKAGES << std::endl;
+                });
+            }
+        }
+
+        for (fs::path const& PACKAGES: env.repositories.get()) {
+            // The merged summary omits packages shadowed by other
+            // repositories, but the index has to cover all of them.
+            auto m = env.msg();
+            auto v = env.verbose();
+            std::string    const& sufx = env.PKG_SUFX.get();
+            pkgxx::summary const  sum(
+                m, v, env.opts.concurrency, PACKAGES, env.PKG_INFO.get(), sufx);
+            std::vector<fs::path> files;
+            for (auto const& [name, vars]: sum) {
+                files.push_back(vars.binary_package_file(sufx));
+            }
+
+            v << "Update " << PACKAGES / pkgxx::build_version_index::file_name
+              << " for " << files.size() << " packages" << std::endl;
+            pkgxx::build_version_index index(PACKAGES);
+            auto const stats = index.update(files, env.PKG_INFO.get(), env.opts.concurrency);
+            if (!env.opts.dry_run) {
+                index.save();
+            }
+            m << "Build version index of " << PACKAGES << ": " << stats.reused << " unchanged, "
+              << stats.extracted << " extracted, "
+              << stats.removed << " removed" << std::endl;
+        }
+    }
+
     void
     list_bin_pkgs(pkg_chk::environment const& env) {
         std::string    const& sufx = env.PKG_SUFX.get();
@@ -520,8 +564,17 @@ namespace {
         }
 
         try {
-            for (auto name: topology.tsort()) {
-                std::cout << name << sufx << std::endl;
+            // List packages level by level, so that packages without
+            // dependencies between them are adjacent and can be installed
+            // in parallel.
+            auto const levels = topology.tsort_levels();
+            env.verbose() << "Packages to list form " << levels.size()
+                          << (levels.size() == 1 ? " level" : " levels")
+                          << " of dependencies" << std::endl;
+            for (auto const& level: levels) {
+                for (auto name: level) {
+                    std::cout << name << sufx << std::endl;
+                }
             }
         }
         catch (pkgxx::not_a_dag<pkgname_cref>& e) {
@@ -547,7 +600,20 @@ int main(int argc, char* argv[]) {
             }
             msg << std::endl;
         }
+        if (opts.adaptive_concurrency) {
+            pkgxx::adaptive_concurrency::enable(
+                opts.concurrency,
+                [&env](unsigned limit, pkgxx::load_sample const& s) {
+                    env.verbose() << "Concurrency adjusted to " << limit
+                                  << " (" << s << ")" << std::endl;
+                });
+        }
 
+        bool const join_jobserver = !pkgxx::cgetenv("PKGCHKXX_NO_JOBSERVER");
+        if (auto const js = pkgxx::concurrency_budget::enable(opts.concurrency, join_jobserver);
+            !js.empty()) {
+            env.verbose() << "Joined the jobserver of make: " << js << std::endl;
+        }
         switch (opts.mode) {
         case pkg_chk::mode::ADD_DELETE_UPDATE:
             add_delete_update(env);
@@ -569,6 +635,10 @@ int main(int argc, char* argv[]) {
             lookup_todo(env);
             break;
 
+        case pkg_chk::mode::UPDATE_BUILD_VERSION_INDEX:
+            update_build_version_index(env);
+            break;
+
         default:
             std::cerr << "panic: unknown operation mode" << std::endl;
             std::abort();
@@ -1,10 +1,14 @@
 #include <cstdlib>
+#include <getopt.h>
 #include <iostream>
 #include <optional>
+#include <string_view>
 #include <thread>
 #include <unistd.h>
 #include <vector>
 
+#include <pkgxx/adaptive_concurrency.hxx>
+
 #include "options.hxx"
 
 using namespace std::literals;
@@ -14,6 +18,21 @@ extern "C" {
     extern int optind;
 }
 
+namespace {
+    // Long options have no short equivalents. Give them values that
+    // can't collide with any characters.
+    enum long_option: int {
+        OPT_VERIFY_BUILD_VERSION = 256,
+        OPT_UPDATE_BUILD_VERSION_INDEX
+    };
+
+    struct option const long_options[] = {
+        {"verify-build-version", optional_argument, nullptr, OPT_VERIFY_BUILD_VERSION},
+        {"update-build-version-index", no_argument, nullptr, OPT_UPDATE_BUILD_VERSION_INDEX},
+        {nullptr, 0, nullptr, 0}
+    };
+}
+
 namespace pkg_chk {
     options::options(int argc, char* const argv[])
         : add_missing(false)
@@ -22,6 +41,7 @@ namespace pkg_chk {
         , no_clean(false)
         , fetch(false)
         , concurrency(std::max(1u, std::thread::hardware_concurrency()))
+        , adaptive_concurrency(false)
         , continue_on_errors(false)
         , dry_run(false)
         , print_pkgpaths_to_check(false)
@@ -29,11 +49,12 @@ namespace pkg_chk {
         , delete_mismatched(false)
         , build_from_source(false)
         , update(false)
-        , verbose(false) {
+        , verbose(false)
+        , verify_build_version(0) {
 
         std::optional<pkg_chk::mode> mode_;
         int ch;
-        while ((ch = getopt(argc, argv, "BC:D:L:P:U:abcdfghij:klNnpqrsuv")) != -1) {
+        while ((ch = getopt_long(argc, argv, "BC:D:L:P:U:abcdfghij:klNnpqrsuv", long_options, nullptr)) != -1) {
             switch (ch) {
             case 'a':
                 mode_       = mode::ADD_DELETE_UPDATE;
@@ -73,11 +94,12 @@ namespace pkg_chk {
                 list_ver_diffs = true;
                 break;
             case 'j':
-                if (int const n = std::atoi(optarg); n > 0) {
-                    concurrency = static_cast<unsigned>(n);
+                if (auto const j = pkgxx::concurrency_option::parse(optarg); j) {
+                    concurrency          = j->concurrency;
+                    adaptive_concurrency = j->adaptive;
                 }
                 else {
-                    std::cerr << argv[0] << ": option -j takes a positive integer" << std::endl;
+                    std::cerr << argv[0] << ": option -j takes a positive integer or \"auto\"" << std::endl;
                     throw bad_options();
                 }
                 break;
@@ -104,7 +126,7 @@ namespace pkg_chk {
                 print_pkgpaths_to_check = true;
                 break;
             case 'P':
-                bin_pkg_path = optarg;
+                bin_pkg_paths.push_back(optarg);
                 break;
             case 'q':
                 list_ver_diffs = true;
@@ -126,6 +148,21 @@ namespace pkg_chk {
             case 'v':
                 verbose = true;
                 break;
+            case OPT_VERIFY_BUILD_VERSION:
+                if (!optarg) {
+                    verify_build_version = 20;
+                }
+                else if (int const n = std::atoi(optarg); n > 0) {
+                    verify_build_version = static_cast<unsigned>(n);
+                }
+                else {
+                    std::cerr << argv[0] << ": option --verify-build-version takes a positive integer" << std::endl;
+                    throw bad_options();
+                }
+                break;
+            case OPT_UPDATE_BUILD_VERSION_INDEX:
+                mode_ = mode::UPDATE_BUILD_VERSION_INDEX;
+                break;
             case '?':
                 throw bad_options();
             default:
@@ -146,7 +183,7 @@ namespace pkg_chk {
         else {
             std::cerr
                 << argv[0]
-                << ": must specify at least one of -a, -g, -l, -r, -u, or -N" << std::endl;
+                << ": must specify at least one of -a, -g, -l, -r, -u, -N, or --update-build-version-index" << std::endl;
             throw bad_options();
         }
 
@@ -158,6 +195,14 @@ namespace pkg_chk {
             throw bad_options();
         }
 
+        if (verify_build_version > 0 && !(check_build_version && build_from_source)) {
+            std::cerr
+                << argv[0]
+                << ": --verify-build-version compares build versions computed from source,"
+                << " which only happens with -B and -s" << std::endl;
+            throw bad_options();
+        }
+
         if (argc > optind) {
             std::cerr
                 << argv[0]
@@ -179,19 +224,26 @@ namespace pkg_chk {
             << "    -g       Generate an initial pkgchk.conf file" << std::endl
             << "    -h       Print this help" << std::endl
             << "    -j conc  Parallelize certain operations with a given concurrency" << std::endl
+            << "             ('auto' to adapt it to the system load)" << std::endl
             << "    -k       Continue with further packages if errors are encountered" << std::endl
             << "    -L file  Redirect output from commands run into file (should be fullpath)" << std::endl
             << "    -l       List binary packages including dependencies" << std::endl
             << "    -N       List installed packages for which a newer version is in TODO" << std::endl
             << "    -n       Display actions that would be taken, but do not perform them" << std::endl
             << "    -p       Display the list of pkgpaths that match the current tags" << std::endl
-            << "    -P dir   Set PACKAGES dir (overrides any other setting)" << std::endl
+            << "    -P dir   Set PACKAGES dir (overrides any other setting). Can be given" << std::endl
+            << "             more than once, earlier ones taking precedence" << std::endl
             << "    -q       Do not display actions or take any action; only list packages" << std::endl
             << "    -r       Recursively remove mismatches (use with care)" << std::endl
             << "    -s       Use source for building packages" << std::endl
             << "    -U tags  Comma separated list of pkgchk.conf tags to unset ('*' for all)" << std::endl
             << "    -u       Update all mismatched packages" << std::endl
             << "    -v       Be verbose" << std::endl
+            << "    --verify-build-version[=n]" << std::endl
+            << "             Cross-check build versions computed without bmake against" << std::endl
+            << "             bmake for the first n packages (default: 20)" << std::endl
+            << "    --update-build-version-index" << std::endl
+            << "             Create or update the build version index in the PACKAGES dir" << std::endl
             << std::endl
             << "pkg_chk verifies installed packages against pkgsrc." << std::endl
             << "The most common usage is 'pkg_chk -u -q' to check all installed packages or" << std::endl
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "tag.hxx"
 
@@ -15,6 +16,7 @@ namespace pkg_chk {
         HELP,                 // -h
         LIST_BIN_PKGS,        // -l
         LOOKUP_TODO,          // -N
+        UPDATE_BUILD_VERSION_INDEX, // --update-build-version-index
     };
 
     struct bad_options: virtual std::runtime_error {
@@ -37,10 +39,11 @@ namespace pkg_chk {
         bool no_clean;                          // -d
         bool fetch;                             // -f
         unsigned concurrency;                   // -j
+        bool adaptive_concurrency;              // -j auto
         bool continue_on_errors;                // -k
         mutable std::ofstream logfile;          // -L
         bool dry_run;                           // -n
-        std::filesystem::path bin_pkg_path;     // -P
+        std::vector<std::filesystem::path> bin_pkg_paths; // -P (repeatable)
         bool print_pkgpaths_to_check;           // -p
         bool list_ver_diffs;                    // -q
         bool delete_mismatched;                 // -r
@@ -48,6 +51,7 @@ namespace pkg_chk {
         tagset remove_tags;                     // -U
         bool update;                            // -u
         bool verbose;                           // -v
+        unsigned verify_build_version;          // --verify-build-version
     };
 
     // Does *not* exit the program.
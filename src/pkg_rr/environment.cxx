@@ -13,6 +13,7 @@ namespace {
     struct makefile_env {
         std::optional<pkgxx::pkgbase> FETCH_USING;
         std::string PKG_ADMIN;
+        fs::path PKG_DBDIR;
         std::string PKG_INFO;
         std::string SU_CMD;
     };
@@ -40,6 +41,7 @@ namespace pkg_rr {
                 std::vector<std::string> vars = {
                     "FETCH_USING",
                     "PKG_ADMIN",
+                    "PKG_DBDIR",
                     "PKG_INFO",
                     "SU_CMD"
                 };
@@ -56,12 +58,14 @@ namespace pkg_rr {
                 }
                 _menv.FETCH_USING = value_of["FETCH_USING"].empty() ? std::nullopt  : std::make_optional(value_of["FETCH_USING"]);
                 _menv.PKG_ADMIN   = value_of["PKG_ADMIN"  ].empty() ? CFG_PKG_ADMIN : value_of["PKG_ADMIN"];
+                _menv.PKG_DBDIR   = value_of["PKG_DBDIR"  ];
                 _menv.PKG_INFO    = value_of["PKG_INFO"   ].empty() ? CFG_PKG_INFO  : value_of["PKG_INFO" ];
                 _menv.SU_CMD      = value_of["SU_CMD"     ];
                 return _menv;
             }).share();
         FETCH_USING = std::async(std::launch::deferred, [menv]() { return menv.get().FETCH_USING; }).share();
         PKG_ADMIN   = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_ADMIN;   }).share();
+        PKG_DBDIR   = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_DBDIR;   }).share();
         PKG_INFO    = std::async(std::launch::deferred, [menv]() { return menv.get().PKG_INFO;    }).share();
         SU_CMD      = std::async(std::launch::deferred, [menv]() { return menv.get().SU_CMD;      }).share();
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <filesystem>
 #include <functional>
 #include <future>
 #include <optional>
@@ -81,6 +82,7 @@ namespace pkg_rr {
         pkg_rr::options const& opts;
         std::shared_future<std::optional<pkgxx::pkgbase>> FETCH_USING;
         std::shared_future<std::string> PKG_ADMIN;
+        std::shared_future<std::filesystem::path> PKG_DBDIR;
         std::shared_future<std::string> PKG_INFO;
         std::shared_future<std::string> SU_CMD;
 
@@ -1,5 +1,9 @@
 #include <exception>
 
+#include <pkgxx/adaptive_concurrency.hxx>
+#include <pkgxx/concurrency_budget.hxx>
+#include <pkgxx/environment.hxx>
+
 #include "environment.hxx"
 #include "options.hxx"
 #include "replacer.hxx"
@@ -14,6 +18,19 @@ int main(int argc, char* argv[]) {
         }
 
         pkg_rr::environment env(opts);
+        if (opts.adaptive_concurrency) {
+            pkgxx::adaptive_concurrency::enable(
+                opts.concurrency,
+                [&env](unsigned limit, pkgxx::load_sample const& s) {
+                    env.verbose() << "Concurrency adjusted to " << limit
+                                  << " (" << s << ")" << std::endl;
+                });
+        }
+        bool const join_jobserver = !pkgxx::cgetenv("PKGCHKXX_NO_JOBSERVER");
+        if (auto const js = pkgxx::concurrency_budget::enable(opts.concurrency, join_jobserver);
+            !js.empty()) {
+            env.verbose() << "Joined the jobserver of make: " << js << std::endl;
+        }
         pkg_rr::rolling_replacer(argv[0], opts, env).run();
     }
     catch (pkg_rr::bad_options& e) {
@@ -4,9 +4,12 @@
 #include <thread>
 #include <unistd.h>
 
+#include <pkgxx/adaptive_concurrency.hxx>
 #include <pkgxx/string_algo.hxx>
 #include "options.hxx"
 
+using namespace std::literals;
+
 extern "C" {
     extern char* optarg;
     extern int optind;
@@ -35,6 +38,7 @@ namespace pkg_rr {
         , just_fetch(false)
         , help(false)
         , concurrency(std::max(1u, std::thread::hardware_concurrency()))
+        , adaptive_concurrency(false)
         , continue_on_errors(false)
         , dry_run(false)
         , just_replace(false)
@@ -60,11 +64,12 @@ namespace pkg_rr {
                 help = true;
                 break;
             case 'j':
-                if (int const n = std::atoi(optarg); n > 0) {
-                    concurrency = static_cast<unsigned>(n);
+                if (auto const j = pkgxx::concurrency_option::parse(optarg); j) {
+                    concurrency          = j->concurrency;
+                    adaptive_concurrency = j->adaptive;
                 }
                 else {
-                    std::cerr << argv[0] << ": option -j takes a positive integer" << std::endl;
+                    std::cerr << argv[0] << ": option -j takes a positive integer or \"auto\"" << std::endl;
                     throw bad_options();
                 }
                 break;
@@ -26,6 +26,7 @@ namespace pkg_rr {
         bool just_fetch;                              // -F
         bool help;                                    // -h
         unsigned concurrency;                         // -j
+        bool adaptive_concurrency;                    // -j auto
         bool continue_on_errors;                      // -k
         std::optional<std::filesystem::path> log_dir; // -L
         bool dry_run;                                 // -n
@@ -1,9 +1,12 @@
 #include <exception>
+#include <fcntl.h>
 #include <filesystem>
-#include <fstream>
 #include <memory>
+#include <unistd.h>
 
 #include <pkgxx/config.h>
+#include <pkgxx/depends_cache.hxx>
+#include <pkgxx/fd_tee.hxx>
 #include <pkgxx/progress_bar.hxx>
 #include <pkgxx/string_algo.hxx>
 
@@ -90,6 +93,25 @@ namespace {
             },
             static_cast<pkgxx::pkgpattern::pattern_type const&>(pat));
     }
+
+    // Owns a file descriptor and closes it on destruction.
+    struct owned_fd {
+        explicit owned_fd(int fd)
+            : fd(fd) {}
+
+        owned_fd(owned_fd const&) = delete;
+
+        owned_fd&
+        operator= (owned_fd const&) = delete;
+
+        ~owned_fd() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        int const fd;
+    };
 }
 
 namespace pkg_rr {
@@ -316,6 +338,7 @@ namespace pkg_rr {
 
     void
     rolling_replacer::refresh_todo() {
+        auto const old_todo = std::move(REPLACE_TODO);
         if (opts.just_fetch) {
             REPLACE_TODO = MISMATCH_TODO;
             REPLACE_TODO.insert(MISSING_TODO.begin(), MISSING_TODO.end());
@@ -334,6 +357,40 @@ namespace pkg_rr {
         for (auto const& base: FAILED) {
             REPLACE_TODO.erase(base);
         }
+
+        // Usually only a few packages come and go, so update the ordered
+        // TODO in place instead of looking up positions of all of them
+        // again. Both maps are sorted by PKGBASE.
+        if (REPLACE_TODO_generation == topology.tsort_generation()) {
+            auto const update =
+                [&](pkgxx::pkgbase const& base, bool insert) {
+                    if (auto const pos = topology.tsort_position(base); pos) {
+                        if (insert) {
+                            REPLACE_TODO_ordered.emplace(*pos, base);
+                        }
+                        else {
+                            REPLACE_TODO_ordered.erase(std::make_pair(*pos, base));
+                        }
+                    }
+                };
+            auto old_it = old_todo.begin();
+            auto new_it = REPLACE_TODO.begin();
+            while (old_it != old_todo.end() || new_it != REPLACE_TODO.end()) {
+                if (new_it == REPLACE_TODO.end() ||
+                    (old_it != old_todo.end() && old_it->first < new_it->first)) {
+                    update(old_it->first, false);
+                    old_it++;
+                }
+                else if (old_it == old_todo.end() || new_it->first < old_it->first) {
+                    update(new_it->first, true);
+                    new_it++;
+                }
+                else {
+                    old_it++;
+                    new_it++;
+                }
+            }
+        }
     }
 
     void
@@ -434,6 +491,24 @@ namespace pkg_rr {
             decltype(depgraph_installed())
             > depgraph;
 
+        // Listing installed packages at once is far cheaper than asking
+        // pkg_info(1) about each of them.
+        std::map<pkgxx::pkgbase, pkgxx::pkgname> installed;
+        for (auto&& name: pkgxx::installed_pkgnames(PKG_INFO)) {
+            auto const base = name.base;
+            installed.insert_or_assign(base, std::move(name));
+        }
+
+        // Dependencies of installed packages rarely change between runs,
+        // so reuse the ones we found last time unless the package has
+        // been replaced since then.
+        std::optional<pkgxx::depends_cache> cache;
+        if (auto const& PKG_DBDIR = env.PKG_DBDIR.get(); !PKG_DBDIR.empty()) {
+            if (auto const dir = pkgxx::cache_dir(); dir) {
+                cache.emplace(*dir / "depends", PKG_DBDIR);
+            }
+        }
+
         std::set<pkgxx::pkgbase> to_scan;
         for (auto const& [base, _path]: REPLACE_TODO) {
             to_scan.insert(base);
@@ -451,16 +526,22 @@ namespace pkg_rr {
                     // building packages. It's perfectly okay, as we'll
                     // later discover dependencies of such packages in the
                     // "new depends" phase.
-                    if (!is_pkg_installed(base))
+                    auto const name = installed.find(base);
+                    if (name == installed.end())
                         continue;
+                    definitely_installed.insert(base);
 
                     n.start_soon(
                         // Don't need to move-capture 'base' because it
-                        // is guaranteed to outlive the closure.
-                        [&]() {
+                        // is guaranteed to outlive the closure. 'name' is
+                        // an iterator to 'installed' which also outlives
+                        // it, but the iterator itself doesn't.
+                        [&, name]() {
                             // This operation is expensive so we shouldn't
                             // lock guarded values while doing it.
-                            auto const& deps = pkgxx::build_depends(PKG_INFO, base);
+                            auto const& deps = cache
+                                ? cache->build_depends(PKG_INFO, name->second)
+                                : pkgxx::build_depends(PKG_INFO, base);
                             if (deps.empty()) {
                                 // A package may have no dependencies at
                                 // all. Add at least a vertex in that case,
@@ -495,17 +576,36 @@ namespace pkg_rr {
             depgraph.lock()->remove_in_edges(FETCH_USING.value());
         }
 
+        if (cache) {
+            try {
+                cache->save();
+            }
+            catch (std::exception const& e) {
+                env.verbose() << "Failed to save the dependency cache: " << e.what() << std::endl;
+            }
+        }
+
         return std::move(*(depgraph.lock()));
     }
 
     std::pair<pkgxx::pkgbase, pkgxx::pkgpath>
     rolling_replacer::choose_one() const {
-        for (auto const& base: topology.tsort(true)) {
-            if (auto it = REPLACE_TODO.find(base); it != REPLACE_TODO.end()) {
-                return *it;
+        // Choose the one that comes first in the topological order. The
+        // graph maintains the order as edges change, and most edges don't
+        // move anything, so positions only have to be looked up again
+        // when it has actually been reordered.
+        if (REPLACE_TODO_generation != topology.tsort_generation()) {
+            REPLACE_TODO_ordered.clear();
+            for (auto const& [base, _path]: REPLACE_TODO) {
+                if (auto const pos = topology.tsort_position(base); pos) {
+                    REPLACE_TODO_ordered.emplace(*pos, base);
+                }
             }
+            // tsort_position() may have established the order.
+            REPLACE_TODO_generation = topology.tsort_generation();
         }
-        assert("Internal inconsistency: cannot choose one" && false);
+        assert("Internal inconsistency: cannot choose one" && !REPLACE_TODO_ordered.empty());
+        return *REPLACE_TODO.find(REPLACE_TODO_ordered.begin()->second);
     }
 
     pkgxx::pkgversion
@@ -642,12 +742,15 @@ namespace pkg_rr {
             auto const log_file = log_dir / pkgxx::pkgname(base, version->second).string();
             fs::create_directories(log_dir);
 
-            std::ofstream log_out(log_file, std::ios_base::app);
-            if (!log_out) {
+            // Append to the log by seeking to its end rather than with
+            // O_APPEND, which splice(2) refuses. Nobody else writes to
+            // it while we do.
+            owned_fd const log(
+                open(log_file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666));
+            if (log.fd == -1 || lseek(log.fd, 0, SEEK_END) == -1) {
                 throw std::system_error(
                     errno, std::generic_category(), "Failed to open " + log_file.string());
             }
-            log_out.exceptions(std::ios_base::badbit);
 
             using namespace na::literals;
             pkgxx::harness make(
@@ -656,19 +759,10 @@ namespace pkg_rr {
                 "stdout_action"_na = pkgxx::harness::fd_action::pipe,
                 "stderr_action"_na = pkgxx::harness::fd_action::merge_with_stdout);
 
-            std::array<char, 1024> buf;
-            using traits = std::decay_t<decltype(make.cin())>::traits_type;
-            while (true) {
-                if (auto const n_read = make.cout().readsome(buf.data(), buf.size()); n_read > 0) {
-                    std::cout.write(buf.data(), n_read);
-                    log_out.write(buf.data(), n_read);
-                }
-                else if (traits::eq_int_type(make.cout().peek(), traits::eof())) {
-                    // There were no characters readily available, and even
-                    // peek() could not get more.
-                    break;
-                }
-            }
+            // Copy the output of make(1) to both stdout and the log
+            // without letting it go through our stream buffers.
+            std::cout.flush();
+            pkgxx::tee_fd(make.cout().fd().value(), STDOUT_FILENO, log.fd);
 
             if (make.wait_exit().status != 0) {
                 throw replace_failed("Command failed: " + pkgxx::stringify_argv(argv));
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <optional>
+#include <set>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
@@ -146,6 +148,13 @@ namespace pkg_rr {
         todo_type UNSAFE_TODO;
         todo_type REPLACE_TODO;
 
+        /* REPLACE_TODO ordered by the positions of packages in topology,
+         * so that choose_one() doesn't have to look at all of them. It's
+         * only valid while topology.tsort_generation() equals
+         * REPLACE_TODO_generation, and is rebuilt otherwise. */
+        std::set<std::pair<std::size_t, pkgxx::pkgbase>> mutable REPLACE_TODO_ordered;
+        std::optional<std::size_t> mutable REPLACE_TODO_generation;
+
         std::vector<pkgxx::pkgbase> SUCCEEDED;
         std::vector<pkgxx::pkgbase> FAILED;
 
@@ -0,0 +1,92 @@
+#include <cstdlib>
+#include <filesystem>
+#include <set>
+#include <string>
+
+#include <pkgxx/build_version.hxx>
+#include <pkgxx/harness.hxx>
+
+#include "test.hxx"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // A fake pkg_info(1) whose installed packages are files in
+    // $FAKE_PKGDB containing their build versions. Like the real one, -b
+    // fails if any of the packages isn't installed. A package whose
+    // build version is "broken" makes it fail for another reason.
+    char const* const fake_pkg_info = R"SH(#!/bin/sh
+case "$1" in
+    -e)
+        ls "$FAKE_PKGDB"
+        exit 0;;
+    -b)
+        shift
+        rc=0
+        for pkg; do
+            if [ ! -f "$FAKE_PKGDB/$pkg" ]; then
+                echo "pkg_info: can't find package \`$pkg'" >&2
+                rc=1
+            elif [ "$(cat "$FAKE_PKGDB/$pkg")" = broken ]; then
+                exit 2
+            else
+                echo "Information for $pkg:"
+                echo
+                echo "Build version:"
+                cat "$FAKE_PKGDB/$pkg"
+                echo
+            fi
+        done
+        exit $rc;;
+esac
+exit 1
+)SH";
+
+    std::set<pkgxx::pkgname>
+    names(std::initializer_list<char const*> strs) {
+        std::set<pkgxx::pkgname> result;
+        for (auto const str: strs) {
+            result.emplace(str);
+        }
+        return result;
+    }
+}
+
+int main() {
+    test::temp_dir tmp;
+    auto const pkgdb    = tmp.path / "pkgdb";
+    auto const pkg_info = tmp.path / "pkg_info";
+    fs::create_directory(pkgdb);
+    test::write_file(pkg_info, fake_pkg_info);
+    fs::permissions(pkg_info, fs::perms::owner_all);
+    setenv("FAKE_PKGDB", pkgdb.c_str(), 1);
+
+    test::write_file(pkgdb / "foo-1.0", "devel/foo/Makefile: $NetBSD: Makefile,v 1.1 $\n");
+    test::write_file(pkgdb / "bar-2.0", "devel/bar/Makefile: $NetBSD: Makefile,v 1.2 $\n");
+
+    // Installed packages.
+    {
+        auto const bvs = pkgxx::build_version::from_installed(
+            pkg_info.string(), names({"foo-1.0", "bar-2.0"}), 2);
+        CHECK(bvs.size() == 2);
+        CHECK(bvs.count(pkgxx::pkgname("foo-1.0")) == 1);
+        CHECK(bvs.count(pkgxx::pkgname("bar-2.0")) == 1);
+    }
+
+    // A package that has gone away is omitted.
+    {
+        auto const bvs = pkgxx::build_version::from_installed(
+            pkg_info.string(), names({"foo-1.0", "bar-2.0", "baz-3.0"}), 1);
+        CHECK(bvs.size() == 2);
+        CHECK(bvs.count(pkgxx::pkgname("baz-3.0")) == 0);
+    }
+
+    // Other failures aren't hidden.
+    test::write_file(pkgdb / "qux-4.0", "broken");
+    CHECK_THROWS(
+        pkgxx::build_version::from_installed(
+            pkg_info.string(), names({"foo-1.0", "qux-4.0"}), 1),
+        pkgxx::process_exited_for_failure);
+
+    return test::result();
+}
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <string>
+#include <variant>
+
+#include <pkgxx/cancellation.hxx>
+#include <pkgxx/harness.hxx>
+
+#include "test.hxx"
+
+using namespace na::literals;
+using namespace std::literals;
+
+int main() {
+    // Cancelling a token terminates the descendants of the processes
+    // registered to it too. The background sleep(1) holds the pipe open,
+    // so we would see EOF only after it exits.
+    {
+        pkgxx::cancellation_token token;
+        pkgxx::cancellation_token::scope const sc(token);
+
+        pkgxx::harness sh(
+            pkgxx::shell, {pkgxx::shell, "-c", "sleep 60 & echo started; wait"},
+            "stdin_action"_na = pkgxx::harness::fd_action::close,
+            "dtor_action"_na  = pkgxx::harness::dtor_action::wait);
+
+        std::string line;
+        CHECK(std::getline(sh.cout(), line) && line == "started");
+
+        auto const start = std::chrono::steady_clock::now();
+        token.cancel();
+        while (std::getline(sh.cout(), line));
+        CHECK(std::chrono::steady_clock::now() - start < 30s);
+        CHECK(std::holds_alternative<pkgxx::harness::signaled>(sh.wait()));
+    }
+
+    // Spawning a process with a cancelled token fails.
+    {
+        pkgxx::cancellation_token token;
+        pkgxx::cancellation_token::scope const sc(token);
+        token.cancel();
+        CHECK_THROWS(
+            pkgxx::harness(pkgxx::shell, {pkgxx::shell, "-c", "exit 0"}),
+            pkgxx::operation_cancelled);
+    }
+
+    return test::result();
+}
@@ -0,0 +1,216 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <string_view>
+#include <strings.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "http_server.hxx"
+
+namespace {
+    char const* const http_date_format = "%a, %d %b %Y %H:%M:%S GMT";
+
+    std::string
+    format_http_date(std::time_t t) {
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char buf[64];
+        return std::string(buf, strftime(buf, sizeof(buf), http_date_format, &tm));
+    }
+
+    std::optional<std::time_t>
+    parse_http_date(std::string const& str) {
+        struct tm tm = {};
+        if (strptime(str.c_str(), http_date_format, &tm)) {
+            return timegm(&tm);
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+
+    void
+    send_all(int fd, std::string const& data) {
+        for (std::size_t off = 0; off < data.size(); ) {
+            auto const n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // The client went away. That's its business.
+                return;
+            }
+            off += static_cast<std::size_t>(n);
+        }
+    }
+}
+
+namespace test {
+    http_server::http_server()
+        : _listen_fd(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0))
+        , _port(0)
+        , _stopping(false)
+        , _delay(0) {
+
+        if (_listen_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+
+        struct sockaddr_in addr = {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port        = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            listen(_listen_fd, 64) != 0 ||
+            getsockname(_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0) {
+
+            auto const err = errno;
+            close(_listen_fd);
+            throw std::system_error(err, std::generic_category(), "bind");
+        }
+        _port = ntohs(addr.sin_port);
+
+        _acceptor = std::thread(&http_server::accept_loop, this);
+    }
+
+    http_server::~http_server() {
+        _stopping = true;
+        _acceptor.join();
+        close(_listen_fd);
+
+        std::vector<std::thread> handlers;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            handlers.swap(_handlers);
+        }
+        for (auto& th: handlers) {
+            th.join();
+        }
+    }
+
+    std::string
+    http_server::url(std::string const& path) const {
+        return "http://127.0.0.1:" + std::to_string(_port) + path;
+    }
+
+    void
+    http_server::put(std::string const& path, resource res) {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _resources.insert_or_assign(path, std::move(res));
+    }
+
+    void
+    http_server::remove(std::string const& path) {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _resources.erase(path);
+    }
+
+    void
+    http_server::set_delay(std::chrono::milliseconds delay) {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _delay = delay;
+    }
+
+    std::vector<http_server::request>
+    http_server::requests() const {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _requests;
+    }
+
+    void
+    http_server::clear_requests() {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _requests.clear();
+    }
+
+    void
+    http_server::accept_loop() {
+        while (!_stopping) {
+            // Wake up periodically to notice the destructor.
+            struct pollfd pfd = {_listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+
+            int const fd = accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            _handlers.emplace_back(&http_server::handle, this, fd);
+        }
+    }
+
+    void
+    http_server::handle(int fd) {
+        std::string head;
+        while (head.find("\r\n\r\n") == std::string::npos) {
+            char buf[1024];
+            auto const n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            else if (n <= 0) {
+                close(fd);
+                return;
+            }
+            head.append(buf, static_cast<std::size_t>(n));
+        }
+
+        request req;
+        {
+            std::istringstream in(head);
+            in >> req.method >> req.path;
+
+            std::string line;
+            std::getline(in, line); // The rest of the request line.
+            while (std::getline(in, line) && line != "\r") {
+                static constexpr std::string_view const ims = "If-Modified-Since:";
+                if (strncasecmp(line.c_str(), ims.data(), ims.size()) == 0) {
+                    auto const value = line.substr(line.find_first_not_of(' ', ims.size()));
+                    req.if_modified_since = parse_http_date(value);
+                }
+            }
+        }
+
+        std::optional<resource> res;
+        std::chrono::milliseconds delay;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _requests.push_back(req);
+            if (auto it = _resources.find(req.path); it != _resources.end()) {
+                res = it->second;
+            }
+            delay = _delay;
+        }
+        std::this_thread::sleep_for(delay);
+
+        if (!res) {
+            send_all(fd, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        }
+        else if (req.if_modified_since && res->mtime && *res->mtime <= *req.if_modified_since) {
+            send_all(fd, "HTTP/1.0 304 Not Modified\r\n\r\n");
+        }
+        else {
+            std::string resp =
+                "HTTP/1.0 200 OK\r\n"
+                "Content-Length: " + std::to_string(res->body.size()) + "\r\n";
+            if (res->mtime) {
+                resp += "Last-Modified: " + format_http_date(*res->mtime) + "\r\n";
+            }
+            resp += "\r\n";
+            if (req.method == "GET") {
+                resp += res->body;
+            }
+            send_all(fd, resp);
+        }
+        close(fd);
+    }
+}
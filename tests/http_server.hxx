@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace test {
+    /** A minimal HTTP/1.0 server on the loopback interface. It serves
+     * in-memory resources to \c GET and \c HEAD requests, honors \c
+     * If-Modified-Since, and records every request it receives. Each
+     * connection is handled on its own thread so that a delayed
+     * response doesn't hold up others.
+     */
+    struct http_server {
+        struct resource {
+            std::string body;
+            /// Sent as \c Last-Modified if present.
+            std::optional<std::time_t> mtime;
+        };
+
+        struct request {
+            std::string method;
+            std::string path;
+            std::optional<std::time_t> if_modified_since;
+        };
+
+        http_server();
+        ~http_server();
+
+        http_server(http_server const&) = delete;
+        http_server& operator= (http_server const&) = delete;
+
+        /// Return the URL of a path on this server.
+        std::string
+        url(std::string const& path) const;
+
+        /// Serve a resource at a given path, replacing any existing one.
+        void
+        put(std::string const& path, resource res);
+
+        /// Stop serving a path, so that it gets 404.
+        void
+        remove(std::string const& path);
+
+        /// Delay every response by a given duration.
+        void
+        set_delay(std::chrono::milliseconds delay);
+
+        /// Return the requests received so far, in order of arrival.
+        std::vector<request>
+        requests() const;
+
+        /// Forget the requests received so far.
+        void
+        clear_requests();
+
+    private:
+        void
+        accept_loop();
+
+        void
+        handle(int fd);
+
+        int _listen_fd;
+        unsigned short _port;
+        std::atomic<bool> _stopping;
+
+        mutable std::mutex _mtx;
+        std::map<std::string, resource> _resources;
+        std::vector<request> _requests;
+        std::chrono::milliseconds _delay;
+        std::vector<std::thread> _handlers;
+
+        std::thread _acceptor;
+    };
+}
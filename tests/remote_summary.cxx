@@ -0,0 +1,155 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pkgxx/gzipstream.hxx>
+#include <pkgxx/summary.hxx>
+#include <pkgxx/wwwstream.hxx>
+
+#include "http_server.hxx"
+#include "test.hxx"
+
+using namespace std::literals;
+
+namespace {
+    std::string
+    gzip(std::string const& str) {
+        std::ostringstream raw;
+        {
+            pkgxx::gzipostream out(raw);
+            out << str;
+            out.close();
+        }
+        return raw.str();
+    }
+
+    std::string
+    summary_of(std::string const& pkgname, std::string const& pkgpath) {
+        return "PKGNAME=" + pkgname + "\nPKGPATH=" + pkgpath + "\n\n";
+    }
+
+    pkgxx::summary
+    load(std::string const& PACKAGES) {
+        std::ostringstream msg;
+        std::ostringstream verbose;
+        return pkgxx::summary(msg, verbose, 4, PACKAGES, "pkg_info", ".tgz");
+    }
+
+    bool
+    has(pkgxx::summary const& sum, std::string const& name) {
+        return sum.count(pkgxx::pkgname(name)) > 0;
+    }
+
+    std::size_t
+    count_requests(test::http_server const& server, std::string const& method) {
+        std::size_t n = 0;
+        for (auto const& req: server.requests()) {
+            if (req.method == method) {
+                n++;
+            }
+        }
+        return n;
+    }
+}
+
+int main() {
+    unsetenv("PKGCHKXX_MIRRORS");
+    std::time_t const t0 = 1700000000;
+    auto const delay = 300ms;
+
+    {
+        test::temp_dir cache;
+        setenv("PKGCHKXX_CACHE_DIR", cache.path.c_str(), 1);
+
+        test::http_server server;
+        server.set_delay(delay);
+        server.put("/repo/pkg_summary.gz", {gzip(summary_of("foo-1.0", "devel/foo")), t0});
+
+        // A single mirror with nothing cached: every variant is probed
+        // at once, so the missing ones cost a single round trip in total
+        // however many there are.
+        auto const start = std::chrono::steady_clock::now();
+        auto const sum = load(server.url("/repo"));
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        CHECK(has(sum, "foo-1.0"));
+        CHECK(count_requests(server, "GET") == 1);
+        CHECK(server.requests().back().path == "/repo/pkg_summary.gz");
+        // There are at least 3 variants. Probing them one by one would
+        // take 3 round trips before the download.
+        CHECK(elapsed < delay * 3);
+
+        // The cached variant is revalidated without probing.
+        server.clear_requests();
+        CHECK(has(load(server.url("/repo")), "foo-1.0"));
+        {
+            auto const reqs = server.requests();
+            CHECK(reqs.size() == 1);
+            CHECK(reqs.at(0).method == "GET");
+            CHECK(reqs.at(0).if_modified_since == t0);
+        }
+
+        // When the cached variant goes away, the others are probed.
+        server.remove("/repo/pkg_summary.gz");
+        server.put("/repo/pkg_summary.txt", {summary_of("bar-1.0", "devel/bar"), t0});
+        {
+            auto const sum2 = load(server.url("/repo"));
+            CHECK(has(sum2, "bar-1.0"));
+            CHECK(!has(sum2, "foo-1.0"));
+        }
+
+        // Nothing at all.
+        server.remove("/repo/pkg_summary.txt");
+        CHECK_THROWS(load(server.url("/repo")), pkgxx::remote_file_unavailable);
+    }
+
+    {
+        test::temp_dir cache;
+        setenv("PKGCHKXX_CACHE_DIR", cache.path.c_str(), 1);
+
+        // The freshest mirror wins regardless of the order.
+        test::http_server primary;
+        test::http_server mirror;
+        primary.put("/repo/pkg_summary.gz", {gzip(summary_of("foo-1.0", "devel/foo")), t0});
+        mirror .put("/repo/pkg_summary.gz", {gzip(summary_of("foo-1.1", "devel/foo")), t0 + 3600});
+        setenv("PKGCHKXX_MIRRORS", mirror.url("/repo").c_str(), 1);
+
+        auto const sum = load(primary.url("/repo"));
+        CHECK(has(sum, "foo-1.1"));
+        CHECK(!has(sum, "foo-1.0"));
+        CHECK(count_requests(primary, "GET") == 0);
+
+        // A mirror lacking summaries is skipped.
+        mirror.remove("/repo/pkg_summary.gz");
+        CHECK(has(load(primary.url("/repo")), "foo-1.0"));
+    }
+
+    {
+        test::temp_dir cache;
+        setenv("PKGCHKXX_CACHE_DIR", cache.path.c_str(), 1);
+        unsetenv("PKGCHKXX_MIRRORS");
+
+        // Earlier repositories take precedence per PKGBASE, so a newer
+        // version in a later one doesn't shadow them.
+        test::http_server first;
+        test::http_server second;
+        first .put("/repo/pkg_summary.gz", {gzip(summary_of("foo-1.0", "devel/foo")), t0});
+        second.put("/repo/pkg_summary.gz", {gzip(summary_of("foo-1.1", "devel/foo") +
+                                                 summary_of("bar-1.0", "devel/bar")), t0});
+
+        std::ostringstream msg;
+        std::ostringstream verbose;
+        pkgxx::summary const sum(
+            msg, verbose, 4,
+            std::vector<std::filesystem::path> {first.url("/repo"), second.url("/repo")},
+            "pkg_info", ".tgz");
+        CHECK(has(sum, "foo-1.0"));
+        CHECK(!has(sum, "foo-1.1"));
+        CHECK(has(sum, "bar-1.0"));
+        CHECK(sum.at(pkgxx::pkgname("bar-1.0")).PACKAGES == second.url("/repo"));
+    }
+
+    return test::result();
+}
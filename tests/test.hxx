@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+/** Check that an expression holds. A failure is reported but doesn't
+ * abort the test, so that a single run shows every failed check.
+ */
+#define CHECK(expr) \
+    ::test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+/** Check that evaluating an expression throws an exception of a given
+ * type.
+ */
+#define CHECK_THROWS(expr, type)                                        \
+    do {                                                                \
+        bool threw_ = false;                                            \
+        try {                                                           \
+            static_cast<void>(expr);                                    \
+        }                                                               \
+        catch (type const&) {                                           \
+            threw_ = true;                                              \
+        }                                                               \
+        ::test::check(threw_, #expr " throws " #type, __FILE__, __LINE__); \
+    } while (false)
+
+namespace test {
+    inline int n_failures = 0;
+
+    inline void
+    check(bool cond, char const* expr, char const* file, int line) {
+        if (!cond) {
+            std::cerr << file << ":" << line << ": check failed: " << expr << std::endl;
+            n_failures++;
+        }
+    }
+
+    /** Return the exit status of a test program: 0 if every check passed,
+     * or 1 otherwise.
+     */
+    inline int
+    result() {
+        return n_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /** A temporary directory that is removed recursively on
+     * destruction.
+     */
+    struct temp_dir {
+        temp_dir() {
+            auto tmpl = (std::filesystem::temp_directory_path() / "pkgxx-test.XXXXXX").string();
+            if (!mkdtemp(tmpl.data())) {
+                throw std::system_error(errno, std::generic_category(), "mkdtemp");
+            }
+            path = tmpl;
+        }
+
+        ~temp_dir() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+
+        temp_dir(temp_dir const&) = delete;
+        temp_dir& operator= (temp_dir const&) = delete;
+
+        std::filesystem::path path;
+    };
+
+    /// Read the whole content of a file.
+    inline std::string
+    read_file(std::filesystem::path const& path) {
+        std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    /// Write a string to a file, replacing its content.
+    inline void
+    write_file(std::filesystem::path const& path, std::string const& content) {
+        std::ofstream out(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        out << content;
+    }
+}
@@ -0,0 +1,81 @@
+#include <filesystem>
+#include <string>
+#include <sys/stat.h>
+
+#include <pkgxx/www_cache.hxx>
+
+#include "http_server.hxx"
+#include "test.hxx"
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::time_t
+    mtime_of(fs::path const& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_mtime : -1;
+    }
+}
+
+int main() {
+    test::http_server server;
+    test::temp_dir cache;
+
+    auto const url = server.url("/pkg_summary.gz");
+    std::time_t const t0 = 1700000000;
+
+    // The first call downloads the file unconditionally, and records
+    // Last-Modified as the mtime of the cached copy.
+    server.put("/pkg_summary.gz", {"first", t0});
+    auto const path = pkgxx::fetch_cached(url, cache.path);
+    CHECK(test::read_file(path) == "first");
+    CHECK(mtime_of(path) == t0);
+    {
+        auto const reqs = server.requests();
+        CHECK(reqs.size() == 1);
+        CHECK(reqs.at(0).method == "GET");
+        CHECK(!reqs.at(0).if_modified_since);
+    }
+
+    // An unchanged file is revalidated with If-Modified-Since and not
+    // transferred again.
+    server.clear_requests();
+    CHECK(pkgxx::fetch_cached(url, cache.path) == path);
+    CHECK(test::read_file(path) == "first");
+    {
+        auto const reqs = server.requests();
+        CHECK(reqs.size() == 1);
+        CHECK(reqs.at(0).if_modified_since == t0);
+    }
+
+    // A modified file replaces the cached copy.
+    server.put("/pkg_summary.gz", {"second", t0 + 60});
+    CHECK(pkgxx::fetch_cached(url, cache.path) == path);
+    CHECK(test::read_file(path) == "second");
+    CHECK(mtime_of(path) == t0 + 60);
+
+    // A file without Last-Modified is downloaded every time.
+    server.put("/pkg_summary.gz", {"third", std::nullopt});
+    CHECK(test::read_file(pkgxx::fetch_cached(url, cache.path)) == "third");
+    server.clear_requests();
+    server.put("/pkg_summary.gz", {"fourth", std::nullopt});
+    CHECK(test::read_file(pkgxx::fetch_cached(url, cache.path)) == "fourth");
+    {
+        auto const reqs = server.requests();
+        CHECK(reqs.size() == 1);
+        CHECK(!reqs.at(0).if_modified_since);
+    }
+
+    // A file that has gone away takes its cached copy with it.
+    server.remove("/pkg_summary.gz");
+    CHECK_THROWS(pkgxx::fetch_cached(url, cache.path), pkgxx::remote_file_unavailable);
+    CHECK(!fs::exists(path));
+
+    // Distinct URLs never share a cached copy.
+    server.put("/a/b", {"ab", t0});
+    server.put("/a%2Fb", {"a%2Fb", t0});
+    CHECK(test::read_file(pkgxx::fetch_cached(server.url("/a/b"), cache.path)) == "ab");
+    CHECK(test::read_file(pkgxx::fetch_cached(server.url("/a%2Fb"), cache.path)) == "a%2Fb");
+
+    return test::result();
+}
@@ -0,0 +1,119 @@
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <pkgxx/harness.hxx>
+#include <pkgxx/xargs_fold.hxx>
+
+#include "test.hxx"
+
+namespace {
+    std::vector<std::string>
+    numbers(std::size_t n) {
+        std::vector<std::string> args;
+        for (std::size_t i = 0; i < n; i++) {
+            args.push_back(std::to_string(i));
+        }
+        return args;
+    }
+
+    std::vector<std::string>
+    concat(std::vector<std::vector<std::string>> const& batches) {
+        std::vector<std::string> args;
+        for (auto const& batch: batches) {
+            args.insert(args.end(), batch.begin(), batch.end());
+        }
+        return args;
+    }
+
+    struct word_count {
+        std::size_t words = 0;
+        std::size_t invocations = 0;
+
+        word_count&
+        operator+= (word_count&& other) {
+            words       += other.words;
+            invocations += other.invocations;
+            return *this;
+        }
+    };
+}
+
+int main() {
+    using pkgxx::detail::xargs_batches;
+
+    // Arguments are spread evenly over as many batches as we can run in
+    // parallel, keeping their order.
+    {
+        auto const batches = xargs_batches(numbers(1000), 1000000, 4, std::nullopt);
+        CHECK(batches.size() == 4);
+        CHECK(concat(batches) == numbers(1000));
+    }
+
+    // ARG_MAX wins over the concurrency.
+    {
+        auto const batches = xargs_batches(numbers(1000), 1000, 4, std::nullopt);
+        CHECK(batches.size() > 4);
+        for (auto const& batch: batches) {
+            std::size_t bytes = 0;
+            for (auto const& arg: batch) {
+                bytes += pkgxx::detail::xargs_arg_size(arg);
+            }
+            CHECK(bytes <= 1000);
+        }
+        CHECK(concat(batches) == numbers(1000));
+    }
+
+    // So does the batch size if given.
+    {
+        auto const batches = xargs_batches(numbers(1000), 1000000, 4, 32);
+        CHECK(batches.size() == 32);
+        CHECK(batches.front().size() == 32);
+        CHECK(concat(batches) == numbers(1000));
+    }
+
+    // An argument exceeding the budget gets its own batch.
+    {
+        std::vector<std::string> args = {"a", std::string(100, 'b'), "c"};
+        auto const batches = xargs_batches(std::vector<std::string>(args), 50, 1, std::nullopt);
+        CHECK(batches.size() == 3);
+        CHECK(concat(batches) == args);
+    }
+
+    CHECK(xargs_batches({}, 1000, 4, std::nullopt).empty());
+
+    // Plain commands are run directly, and anything else by the shell.
+    CHECK(pkgxx::command_argv("/usr/sbin/pkg_info") ==
+          std::vector<std::string>({"/usr/sbin/pkg_info"}));
+    CHECK(pkgxx::command_argv("  pkg_info  -K /var/db/pkg ") ==
+          std::vector<std::string>({"pkg_info", "-K", "/var/db/pkg"}));
+    CHECK(pkgxx::command_argv("PKG_DBDIR=/var/db/pkg pkg_info").front() == pkgxx::shell);
+    CHECK(pkgxx::command_argv("pkg_info 2>/dev/null").front() == pkgxx::shell);
+
+    // Every argument reaches the command exactly once.
+    for (auto const& cmd: {
+            pkgxx::command_argv("echo"),
+            pkgxx::command_argv("echo 2>/dev/null")
+        }) {
+        auto const result = pkgxx::xargs_fold(
+            cmd,
+            [](auto&& args) {
+                for (auto const& arg: numbers(1000)) {
+                    args.push_back(arg);
+                }
+            },
+            [](std::istream& in) {
+                word_count wc;
+                for (std::string word; in >> word; ) {
+                    wc.words++;
+                }
+                wc.invocations = 1;
+                return wc;
+            },
+            4);
+        CHECK(result.words == 1000);
+        CHECK(result.invocations == 4);
+    }
+
+    return test::result();
+}